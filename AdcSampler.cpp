@@ -0,0 +1,137 @@
+/**
+ *  Interrupt driven ADC sampler
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "AdcSampler.h"
+
+/** the one and only ADC sampler */
+AdcSampler g_adc;
+
+/**
+ * ADC conversion complete
+ */
+ISR(ADC_vect)
+{
+  g_adc.onConversion();
+}
+
+byte AdcSampler::addChannel(short int pin)
+{
+  // analog pins are numbered A0.. but the mux wants 0..
+  if(pin >= A0)
+    pin -= A0;
+  noInterrupts();
+  byte ch = m_numChannels;
+  if(ch < adcMaxChannels)
+  {
+    m_channels[ch].mux = pin & 0x07;
+    m_channels[ch].sum = 0;
+    m_channels[ch].head = 0;
+    m_channels[ch].updates = 0;
+    m_numChannels = ch + 1;
+  }
+  else
+  {
+    // reuse the last one rather than overflow
+    ch = adcMaxChannels - 1;
+  }
+  interrupts();
+  LOG_DEBUG(logAdc, "AdcSampler::addChannel %d => %d", pin, ch);
+  return ch;
+}
+
+void AdcSampler::begin()
+{
+  if(m_numChannels == 0)
+    return;
+  sample();
+  // each channel needs (1 + adcOversample) conversions of ~104us to be primed
+  for(byte ch = 0; ch < m_numChannels; ch++)
+    while(getUpdates(ch) == 0)
+      ;
+}
+
+void AdcSampler::sample()
+{
+  if(m_bBusy || m_numChannels == 0)
+    return;
+  m_bBusy = true;
+  m_cur = 0;
+  m_n = 0;
+  m_acc = 0;
+  // enable ADC, complete interrupt, prescaler 128 => 125kHz ADC clock @16MHz.
+  // The first conversion after that takes 25 ADC clocks and is discarded
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  startConversion();
+}
+
+unsigned int AdcSampler::getUpdates(byte ch)
+{
+  noInterrupts();
+  unsigned int res = m_channels[ch].updates;
+  interrupts();
+  return res;
+}
+
+unsigned int AdcSampler::readSum(byte ch)
+{
+  noInterrupts();
+  unsigned int res = m_channels[ch].sum;
+  interrupts();
+  return res;
+}
+
+void AdcSampler::startConversion()
+{
+  ADMUX = (m_ref << 6) | m_channels[m_cur].mux;
+  ADCSRA |= _BV(ADSC);
+}
+
+/**
+ * Called from ISR.  Accumulate the sample, decimate when the burst is done,
+ * switch channels and start the next conversion, or switch the ADC off when
+ * the round is done.
+ */
+void AdcSampler::onConversion()
+{
+  unsigned int sample = ADC;
+  // first sample after the mux switch fluctuates a lot.  Disregard it
+  if(m_n++ != 0)
+    m_acc += sample;
+  if(m_n > adcOversample)
+  {
+    // according to http://www.atmel.com/dyn/resources/prod_documents/doc8003.pdf
+    // 16 samples and >> 2 give 12 bit resolution out of 10 bit ADC
+    unsigned int value = m_acc >> 2;
+    volatile Channel &c = m_channels[m_cur];
+    if(c.updates == 0)
+    {
+      // prime the ring so that the average is meaningful from the start
+      for(byte i = 0; i < adcRingSize; i++)
+        c.ring[i] = value;
+      c.sum = value * adcRingSize;
+    }
+    else
+    {
+      c.sum = c.sum - c.ring[c.head] + value;
+      c.ring[c.head] = value;
+    }
+    if(++c.head >= adcRingSize)
+      c.head = 0;
+    c.updates++;
+    if(c.updates == 0)
+      c.updates = 1;
+    // move on to the next channel
+    m_acc = 0;
+    m_n = 0;
+    if(++m_cur >= m_numChannels)
+    {
+      m_cur = 0;
+      ADCSRA = 0;
+      m_bBusy = false;
+      return;
+    }
+  }
+  startConversion();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+/** max # of analog channels the sampler can handle */
+const byte adcMaxChannels = 4;
+/** raw 10 bit samples accumulated into one decimated value, 16 => 12 bit */
+const byte adcOversample = 16;
+/** decimated values kept per channel for the moving average */
+const byte adcRingSize = 8;
+
+/**
+ * Interrupt driven ADC sampler.
+ * sample() starts a round, the conversions are chained from the ADC complete
+ * ISR.  The sampler dwells on a channel for one burst: the first conversion
+ * after the mux switch is discarded, the next adcOversample ones are
+ * accumulated and decimated into a 12 bit value which goes into the channel
+ * ring buffer.  Then it moves on to the next channel.  After the last one the
+ * ADC is switched off till the next round, rather than waking the CPU up
+ * every conversion, ~10000 times a second.
+ * read() returns the ring average and never waits for the ADC.
+ */
+class AdcSampler
+{
+public:
+  AdcSampler()
+  {
+  }
+
+  /** INTERNAL, DEFAULT or EXTERNAL - same as for analogReference() */
+  void setReference(byte ref)
+  {
+    m_ref = ref;
+  }
+  /**
+   * Register analog input pin for sampling.
+   * Returns channel index to be used with read()
+   */
+  byte addChannel(short int pin);
+  /**
+   * Start the first round.  Waits (a few ms) until every registered channel
+   * got its first decimated value so that read() is meaningful right away.
+   */
+  void begin();
+  /**
+   * Start a round unless one is in progress: a burst of every channel,
+   * (1 + adcOversample) conversions of ~104us each.  The ring average then
+   * spans the last adcRingSize rounds.
+   */
+  void sample();
+  /** filtered 10 bit reading, same scale as analogRead() */
+  unsigned int read(byte ch)
+  {
+    return readSum(ch) >> 5;
+  }
+  /** filtered 12 bit reading, oversampled */
+  unsigned int read12(byte ch)
+  {
+    return readSum(ch) >> 3;
+  }
+  /** # of decimated values produced so far for this channel */
+  unsigned int getUpdates(byte ch);
+
+  /** called from the ADC complete ISR */
+  void onConversion();
+
+private:
+  struct Channel
+  {
+    /** ADMUX channel bits */
+    byte mux;
+    /** decimated values, 12 bit each */
+    unsigned int ring[adcRingSize];
+    /** running sum of ring[] */
+    unsigned int sum;
+    /** where the next decimated value goes */
+    byte head;
+    /** count of decimated values produced, wraps */
+    unsigned int updates;
+  };
+  volatile Channel m_channels[adcMaxChannels];
+  /** # of meaningful elements in m_channels */
+  volatile byte m_numChannels = 0;
+  /** reference selection, analogReference() style */
+  byte m_ref = DEFAULT;
+
+  /** a round is in progress */
+  volatile bool m_bBusy = false;
+  /** channel being sampled now */
+  byte m_cur = 0;
+  /** conversions done in the current burst, 0 is the discarded one */
+  byte m_n = 0;
+  /** accumulator for the current burst */
+  unsigned int m_acc = 0;
+
+  /** ring sum read atomically */
+  unsigned int readSum(byte ch);
+  /** select channel and kick off the conversion */
+  void startConversion();
+};
+
+/** the one and only ADC sampler */
+extern AdcSampler g_adc;
@@ -0,0 +1,50 @@
+/**
+ * Attribute registry lookups, see Attribute.h
+ */
+#include <Arduino.h>
+#include "Attribute.h"
+
+/**
+ * Binary search by name, the table is sorted - that is checked at compile time
+ */
+const Attribute *attributeFind(const char *name)
+{
+  short int lo = 0;
+  short int hi = g_attributeCount - 1;
+  while(lo <= hi)
+  {
+    short int mid = (lo + hi) / 2;
+    int cmp = strcmp_P(name, g_attributes[mid].name);
+    if(cmp == 0)
+      return &g_attributes[mid];
+    if(cmp < 0)
+      hi = mid - 1;
+    else
+      lo = mid + 1;
+  }
+  return 0;
+}
+
+const Attribute *attributeFind(byte id)
+{
+  if(id >= attrIdCount)
+    return 0;
+  byte i = pgm_read_byte(&g_attributeById[id]);
+  return (i == 0xFF) ? 0 : &g_attributes[i];
+}
+
+long attributeGet(const Attribute *p)
+{
+  long (*get)() = (long (*)())pgm_read_ptr(&p->get);
+  return (*get)();
+}
+
+byte attributeSet(const Attribute *p, long value)
+{
+  bool (*set)(long) = (bool (*)(long))pgm_read_ptr(&p->set);
+  if(set == 0)
+    return attrErrReadOnly;
+  if(value < (long)pgm_read_dword(&p->min) || value > (long)pgm_read_dword(&p->max))
+    return attrErrValue;
+  return (*set)(value) ? attrOk : attrErrValue;
+}
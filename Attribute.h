@@ -0,0 +1,178 @@
+/**
+ *  Attribute is something that has name and value.
+ *  e.g. Temperature=>40Celsius
+ *       Fan speed - 100pwm
+ *  And you can GET and maybe SET it.
+ *  You can find it by name (text commands) or by ID (binary protocol).
+ *
+ *  The attributes are a table in flash defined by the sketch, sorted by name
+ *  so that a name is found with a binary search, plus an ID to index table
+ *  generated from it at compile time.  Neither costs any RAM.
+ */
+#pragma once
+
+/** max name length, including the terminating 0 */
+const byte attrNameMax = 20;
+
+/** attributeSet() result */
+const byte attrOk = 0;
+const byte attrErrReadOnly = 1;
+/** out of bounds or the current opmode refused it */
+const byte attrErrValue = 2;
+
+/**
+ * ID size bits: the 2 top bits of an ID are the size of its value in the
+ * binary protocol.  The whole ID is unique, the same low bits may be used
+ * with another size.
+ */
+const byte attrSize1 = 0x00;
+const byte attrSize2 = 0x40;
+const byte attrSize4 = 0x80;
+
+/** value size in bytes of the attribute with this ID, 0 if invalid */
+constexpr byte attrSizeOf(byte id)
+{
+  return ((id & 0xC0) == 0xC0) ? 0 : (1 << (id >> 6));
+}
+
+/**
+ * Attribute IDs.  Never reuse or renumber those, host software relies on them.
+ * attrSize1 0x02, 0x1F to 0x21 and 0x33 to 0x3A were the PWMs when they were
+ * 8 bits, attrSize2 0x2A and 0x2B the model predictive opmode settings, they
+ * are retired.
+ */
+const byte attrOpMode = attrSize1 | 0x01;
+/** PWMs are in Timer1 counts, see Fan.h */
+const byte attrFan = attrSize2 | 0x2C;
+/** C, as used by the current opmode */
+const byte attrTemp = attrSize2 | 0x03;
+/** LM35 reading in tenths of C */
+const byte attrTempLM35 = attrSize2 | 0x04;
+const byte attrPidKp = attrSize2 | 0x05;
+const byte attrPidKi = attrSize2 | 0x06;
+const byte attrPidKd = attrSize2 | 0x07;
+const byte attrPidSetpoint = attrSize2 | 0x08;
+/** ms since boot */
+const byte attrUptime = attrSize4 | 0x09;
+/** frames dropped by the binary protocol */
+const byte attrFrameErrors = attrSize4 | 0x0A;
+/** 1 for the binary protocol */
+const byte attrProtocol = attrSize1 | 0x0B;
+const byte attrTempSetpointMin = attrSize2 | 0x0C;
+const byte attrTempSetpointMax = attrSize2 | 0x0D;
+/** telemetry telXXX channel bits */
+const byte attrTelemetryChannels = attrSize1 | 0x0E;
+/** ms between telemetry records, 0 for none */
+const byte attrTelemetryPeriod = attrSize2 | 0x0F;
+/** RPM of fan N is attrFanRPM + N, up to 8 fans */
+const byte attrFanRPM = attrSize4 | 0x10;
+/** telemetry records dropped */
+const byte attrTelemetryDrops = attrSize4 | 0x18;
+/** output bytes dropped, per class */
+const byte attrTxDropsResponse = attrSize4 | 0x19;
+const byte attrTxDropsTelemetry = attrSize4 | 0x1A;
+const byte attrTxDropsDebug = attrSize4 | 0x1B;
+/** fans self-test result, testXXX, 1 to run it */
+const byte attrSelfTest = attrSize1 | 0x1C;
+/** bit mask of the fans which failed it */
+const byte attrSelfTestFailed = attrSize1 | 0x1D;
+/** sequence # of the saved config, 1 to save it now, 0 for the defaults */
+const byte attrConfig = attrSize4 | 0x1E;
+/** PWMs to use, see Config.h */
+const byte attrPwmMin = attrSize2 | 0x2D;
+const byte attrPwmStart = attrSize2 | 0x2E;
+const byte attrPwmMax = attrSize2 | 0x2F;
+/** opmode to boot into */
+const byte attrOpModeBoot = attrSize1 | 0x22;
+/** curve of fan N is attrFanCurve + N, up to 8 fans */
+const byte attrFanCurve = attrSize1 | 0x23;
+/** per channel OPMODE, FAN and TEMP, channel N is + N, up to 8 channels */
+const byte attrFanOpMode = attrSize1 | 0x2B;
+const byte attrFanPwm = attrSize2 | 0x30;
+const byte attrFanTemp = attrSize2 | 0x10;
+/** fans characterization result, testXXX, 1 to run it, see FanChar.h */
+const byte attrCharacterize = attrSize1 | 0x3B;
+/** per fan min and start PWMs, 0 for the global ones, fan N is + N, up to 8 fans */
+const byte attrFanPwmMin = attrSize2 | 0x18;
+const byte attrFanPwmStart = attrSize2 | 0x20;
+/** bit mask of the fans in stall alarm, see StallMonitor.h */
+const byte attrStallAlarms = attrSize1 | 0x3C;
+/** max stall detection latency, ms */
+const byte attrStallLatency = attrSize2 | 0x28;
+/** # of stalls detected */
+const byte attrStalls = attrSize4 | 0x28;
+/** how the temperature inputs are fused, fuseXXX, see TempInput.h */
+const byte attrFusion = attrSize1 | 0x3D;
+/** # of fresh temperature inputs */
+const byte attrTempInputs = attrSize1 | 0x3E;
+/** temperature input readings older than this are stale, ms */
+const byte attrTempStale = attrSize4 | 0x29;
+/** max serial request latency, us, see Usart.h */
+const byte attrCmdLatency = attrSize4 | 0x2A;
+/** black box recXXX state, 0 to re-arm it, see Recorder.h */
+const byte attrBlackBox = attrSize1 | 0x3F;
+/** bit mask of the modules logging, see Trace.h */
+const byte attrLogMask = attrSize2 | 0x29;
+
+struct Attribute
+{
+  /** full upper case name */
+  char name[attrNameMax];
+  byte id;
+  /** SET bounds */
+  long min;
+  long max;
+  long (*get)();
+  /** 0 for read only, returns false if the value is refused */
+  bool (*set)(long value);
+};
+
+/** defined by the sketch, sorted by name */
+extern const Attribute g_attributes[] PROGMEM;
+extern const byte g_attributeCount;
+/** # of valid IDs, those with the size bits 11 are not */
+const byte attrIdCount = 0xC0;
+/** index into g_attributes by the ID, 0xFF for none */
+extern const byte g_attributeById[attrIdCount] PROGMEM;
+
+/** find by name, 0 if none.  Result points into flash. */
+const Attribute *attributeFind(const char *name);
+/** find by ID, 0 if none */
+const Attribute *attributeFind(byte id);
+long attributeGet(const Attribute *p);
+/** bounds checked set, returns attrOk or attrErrXXX */
+byte attributeSet(const Attribute *p, long value);
+
+/**
+ * Compile time checks and the ID index generation, C++11 constexpr
+ */
+constexpr int attributeNameCmp(const char *a, const char *b)
+{
+  return (*a != *b || *a == 0) ? (*a - *b) : attributeNameCmp(a + 1, b + 1);
+}
+constexpr bool attributesSorted(const Attribute *t, byte n, byte i = 0)
+{
+  return (i + 1 >= n) ? true :
+    (attributeNameCmp(t[i].name, t[i + 1].name) < 0 && attributesSorted(t, n, i + 1));
+}
+/** index of the attribute with this ID, 0xFF for none */
+constexpr byte attributeIndexOf(const Attribute *t, byte n, byte id, byte i = 0)
+{
+  return (i >= n) ? 0xFF : (t[i].id == id) ? i : attributeIndexOf(t, n, id, i + 1);
+}
+constexpr bool attributeIdsUnique(const Attribute *t, byte n, byte i = 0)
+{
+  return (i >= n) ? true :
+    (attrSizeOf(t[i].id) != 0 && attributeIndexOf(t, n, t[i].id) == i && attributeIdsUnique(t, n, i + 1));
+}
+
+/** initializer for g_attributeById */
+#define ATTRIBUTE_INDEX1(t, id) attributeIndexOf(t, sizeof(t) / sizeof(t[0]), id)
+#define ATTRIBUTE_INDEX8(t, id) \
+  ATTRIBUTE_INDEX1(t, id), ATTRIBUTE_INDEX1(t, id + 1), ATTRIBUTE_INDEX1(t, id + 2), ATTRIBUTE_INDEX1(t, id + 3), \
+  ATTRIBUTE_INDEX1(t, id + 4), ATTRIBUTE_INDEX1(t, id + 5), ATTRIBUTE_INDEX1(t, id + 6), ATTRIBUTE_INDEX1(t, id + 7)
+#define ATTRIBUTE_INDEX64(t, id) \
+  ATTRIBUTE_INDEX8(t, id), ATTRIBUTE_INDEX8(t, id + 8), ATTRIBUTE_INDEX8(t, id + 16), ATTRIBUTE_INDEX8(t, id + 24), \
+  ATTRIBUTE_INDEX8(t, id + 32), ATTRIBUTE_INDEX8(t, id + 40), ATTRIBUTE_INDEX8(t, id + 48), ATTRIBUTE_INDEX8(t, id + 56)
+#define ATTRIBUTE_ID_INDEX(t) { \
+  ATTRIBUTE_INDEX64(t, attrSize1), ATTRIBUTE_INDEX64(t, attrSize2), ATTRIBUTE_INDEX64(t, attrSize4) }
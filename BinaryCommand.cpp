@@ -0,0 +1,255 @@
+/**
+ * Compact binary protocol, see BinaryCommand.h for the framing
+ */
+#include <Arduino.h>
+#include <util/crc16.h>
+#define LOG_LEVEL logWarn
+#include "Trace.h"
+#include "Fan.h"
+#include "Attribute.h"
+#include "Curve.h"
+#include "TempInput.h"
+#include "Channel.h"
+#include "BinaryCommand.h"
+
+/** binary command handler */
+BinaryCommand g_bc;
+
+void BinaryCommand::begin()
+{
+  m_bActive = true;
+  m_state = stateSof;
+}
+
+bool BinaryCommand::parse(byte b)
+{
+  unsigned long now = nowMillis();
+  if(m_state != stateSof && (now - m_ulLastByteMs) > bcTimeoutMs)
+  {
+    // the rest of the frame got lost, hunt for the next one.  No logging, this is the RX ISR.
+    m_ulErrors++;
+    m_state = stateSof;
+  }
+  m_ulLastByteMs = now;
+  switch(m_state)
+  {
+    case stateSof:
+      // anything between the frames, e.g. debug output echoed back, is ignored
+      if(b == bcSof)
+        m_state = stateLen;
+      break;
+    case stateLen:
+      if(b < 2 || b > bcMaxPayload)
+      {
+        m_ulErrors++;
+        m_state = stateSof;
+        break;
+      }
+      m_len = b;
+      m_pos = 0;
+      m_crc = _crc_xmodem_update(0xFFFF, b);
+      m_state = statePayload;
+      break;
+    case statePayload:
+      m_in[m_pos++] = b;
+      m_crc = _crc_xmodem_update(m_crc, b);
+      if(m_pos == m_len)
+        m_state = stateCrcLo;
+      break;
+    case stateCrcLo:
+      if(b != (byte)m_crc)
+      {
+        m_ulErrors++;
+        m_state = stateSof;
+        break;
+      }
+      m_state = stateCrcHi;
+      break;
+    case stateCrcHi:
+      m_state = stateSof;
+      if(b != (byte)(m_crc >> 8))
+      {
+        m_ulErrors++;
+        break;
+      }
+      return true;
+  }
+  return false;
+}
+
+void BinaryCommand::dispatch()
+{
+  byte cmd = m_in[0];
+  byte status = bcOk;
+  byte len = 0;
+  m_out[0] = cmd | bcResponse;
+  m_out[1] = m_in[1];
+  switch(cmd)
+  {
+    case bcCmdGet:
+      len = onGet(status);
+      break;
+    case bcCmdSet:
+      len = onSet(status);
+      break;
+    case bcCmdCurve:
+      len = onCurve(status);
+      break;
+    case bcCmdTemp:
+      len = onTemp(status);
+      break;
+    case bcCmdText:
+      break;
+    default:
+      status = bcErrCommand;
+      break;
+  }
+  m_out[2] = status;
+  m_ulFrames++;
+  sendFrame(g_txResponse, m_out, 3 + len);
+  if(cmd == bcCmdText)
+    end();
+}
+
+/**
+ * Requested IDs are in m_in[2..], put ID, value records into m_out[3..]
+ */
+byte BinaryCommand::onGet(byte &status)
+{
+  byte *out = m_out + 3;
+  const byte outMax = bcMaxPayload - 3;
+  byte len = 0;
+  for(byte i = 2; i < m_len; i++)
+  {
+    byte id = m_in[i];
+    byte size = attrSizeOf(id);
+    const Attribute *p = attributeFind(id);
+    if(p == 0)
+      status = bcErrAttribute;
+    else if(len + 1 + size > outMax)
+      status = bcErrLength;
+    if(status != bcOk)
+    {
+      out[0] = id;
+      return 1;
+    }
+    long value = attributeGet(p);
+    out[len++] = id;
+    for(byte j = 0; j < size; j++)
+    {
+      out[len++] = (byte)value;
+      value >>= 8;
+    }
+  }
+  return len;
+}
+
+/**
+ * ID, value records are in m_in[2..], apply them in order, stop at the
+ * first failure
+ */
+byte BinaryCommand::onSet(byte &status)
+{
+  byte i = 2;
+  while(i < m_len)
+  {
+    byte id = m_in[i++];
+    byte size = attrSizeOf(id);
+    const Attribute *p = attributeFind(id);
+    if(p == 0)
+      status = bcErrAttribute;
+    else if(i + size > m_len)
+      status = bcErrLength;
+    if(status == bcOk)
+    {
+      unsigned long value = 0;
+      for(byte j = 0; j < size; j++)
+        value |= (unsigned long)m_in[i++] << (8 * j);
+      // sign extend 2 byte values
+      long lValue = (size == 2) ? (long)(int16_t)value : (long)value;
+      byte res = attributeSet(p, lValue);
+      if(res == attrErrReadOnly)
+        status = bcErrAttribute;
+      else if(res != attrOk)
+        status = bcErrValue;
+    }
+    if(status != bcOk)
+    {
+      m_out[3] = id;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * temperature, PWM (2 bytes) points are in m_in[2..]
+ */
+byte BinaryCommand::onCurve(byte &status)
+{
+  byte len = m_len - 2;
+  if(len % 3 != 0 || len / 3 > curvePointsMax)
+  {
+    status = bcErrLength;
+    return 0;
+  }
+  CurvePoint points[curvePointsMax];
+  const byte *p = m_in + 2;
+  for(byte i = 0; i < len / 3; i++, p += 3)
+  {
+    points[i].temp = p[0];
+    points[i].pwm = p[1] | (p[2] << 8);
+  }
+  if(!curveLoad(points, len / 3))
+    status = bcErrValue;
+  return 0;
+}
+
+/**
+ * temperature, age, name length, name records are in m_in[2..], apply them
+ * in order, stop at the first failure
+ */
+byte BinaryCommand::onTemp(byte &status)
+{
+  char name[tempNameMax];
+  byte i = 2;
+  for(byte rec = 0; i < m_len; rec++)
+  {
+    byte len = (i + 5 <= m_len) ? m_in[i + 4] : 0;
+    if(len == 0 || len >= tempNameMax || i + 5 + len > m_len)
+      status = bcErrLength;
+    else
+    {
+      short int temp = (short int)(m_in[i] | (m_in[i + 1] << 8));
+      unsigned int age = m_in[i + 2] | (m_in[i + 3] << 8);
+      memcpy(name, m_in + i + 5, len);
+      name[len] = 0;
+      if(!g_tempInputs.put(name, temp, age))
+        status = bcErrValue;
+      i += 5 + len;
+    }
+    if(status != bcOk)
+    {
+      m_out[3] = rec;
+      break;
+    }
+  }
+  return (status == bcOk) ? 0 : 1;
+}
+
+bool BinaryCommand::sendFrame(TxChannel &out, const byte *payload, byte len)
+{
+  // queued as one message so that nothing gets in between
+  byte frame[bcMaxPayload + 4];
+  unsigned short crc = _crc_xmodem_update(0xFFFF, len);
+  frame[0] = bcSof;
+  frame[1] = len;
+  for(byte i = 0; i < len; i++)
+  {
+    frame[2 + i] = payload[i];
+    crc = _crc_xmodem_update(crc, payload[i]);
+  }
+  frame[2 + len] = (byte)crc;
+  frame[3 + len] = (byte)(crc >> 8);
+  return out.writeMessage(frame, len + 4);
+}
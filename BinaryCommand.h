@@ -0,0 +1,133 @@
+/**
+ * Compact binary alternative to the text SerialCommand interface.
+ * Entered with the text command "SET PROTOCOL 1", left with bcCmdText.
+ *
+ * Frame:    SOF, LEN, payload[LEN], CRC16 (lo, hi)
+ *           CRC16 is CRC-CCITT (0x1021, init 0xFFFF) over LEN and payload.
+ * Request:  cmd, seq, body
+ *           bcCmdGet body is a list of attribute IDs
+ *           bcCmdSet body is a list of attribute ID, value records
+ *           bcCmdCurve body is a list of temperature, PWM (2 bytes) points, see
+ *           Curve.h
+ *           bcCmdTemp body is a list of temperature in C (2 bytes), its age
+ *           in ms (2 bytes), name length, name records, see TempInput.h
+ * Response: cmd | bcResponse, seq, status, body
+ *           bcCmdGet body is a list of attribute ID, value records
+ *           on error the body is the ID of the offending attribute or the
+ *           index of the offending bcCmdTemp record, if any
+ * Telemetry: bcTelemetry, seq, record, see Telemetry.h
+ * Alarm:    bcAlarm, fan, state, detection latency in ms (2 bytes), see
+ *           StallMonitor.h
+ * Log:      bcLog, seq, message ID, ms, arguments, see Trace.h
+ *
+ * Attributes and their IDs are in Attribute.h.  The 2 top bits of an ID are
+ * the size of its value: 1, 2 or 4 bytes, so that a host can walk the
+ * records without knowing the IDs.
+ * Values are little-endian, 2 byte ones are signed, the others unsigned.
+ * Frames failing the CRC, too long or stalled for bcTimeoutMs are dropped
+ * silently, it is up to the host to retry.
+ */
+#pragma once
+#include "TxQueue.h"
+
+/** start of frame marker */
+const byte bcSof = 0xA5;
+/** max LEN */
+const byte bcMaxPayload = 40;
+/** a partial frame is dropped if the next byte does not come within this, ms */
+const unsigned long bcTimeoutMs = 50;
+
+/** commands */
+const byte bcCmdGet = 0x01;
+const byte bcCmdSet = 0x02;
+/** load the RAM fan curve */
+const byte bcCmdCurve = 0x03;
+/** named temperature input readings, as many as fit */
+const byte bcCmdTemp = 0x04;
+/** back to the text protocol, after the response */
+const byte bcCmdText = 0x0F;
+/** set in the response cmd */
+const byte bcResponse = 0x80;
+/** unsolicited frame with a telemetry record, see Telemetry.h */
+const byte bcTelemetry = 0x40;
+/** unsolicited frame with a fan stall alarm */
+const byte bcAlarm = 0x41;
+/** unsolicited frame with a log record */
+const byte bcLog = 0x42;
+
+/** response status */
+const byte bcOk = 0;
+const byte bcErrCommand = 1;
+const byte bcErrAttribute = 2;
+const byte bcErrValue = 3;
+const byte bcErrLength = 4;
+
+class BinaryCommand
+{
+public:
+  /** are we talking binary? */
+  bool isActive()
+  {
+    return m_bActive;
+  }
+  /** switch to the binary protocol */
+  void begin();
+  /** back to text */
+  void end()
+  {
+    m_bActive = false;
+  }
+  /**
+   * Main entry point, feed it a byte at a time, e.g. from the RX ISR.
+   * True once a frame is complete, it is to be dispatch()ed before any more
+   * bytes are fed.
+   */
+  bool parse(byte b);
+  /** respond to the complete frame */
+  void dispatch();
+  /** # of frames responded to */
+  unsigned long getFrames()
+  {
+    return m_ulFrames;
+  }
+  /** # of frames dropped */
+  unsigned long getErrors()
+  {
+    return m_ulErrors;
+  }
+  /** queue a frame with this payload, whatever the protocol.  False if dropped. */
+  static bool sendFrame(TxChannel &out, const byte *payload, byte len);
+
+private:
+  /** parser states */
+  enum
+  {
+    stateSof,
+    stateLen,
+    statePayload,
+    stateCrcLo,
+    stateCrcHi
+  };
+  bool m_bActive = false;
+  byte m_state = stateSof;
+  byte m_len = 0;
+  byte m_pos = 0;
+  unsigned short m_crc = 0;
+  /** nowMillis() of the last byte received */
+  unsigned long m_ulLastByteMs = 0;
+  /** request payload */
+  byte m_in[bcMaxPayload];
+  /** response payload */
+  byte m_out[bcMaxPayload];
+  unsigned long m_ulFrames = 0;
+  unsigned long m_ulErrors = 0;
+
+  /** fill m_out body, return its length */
+  byte onGet(byte &status);
+  byte onSet(byte &status);
+  byte onCurve(byte &status);
+  byte onTemp(byte &status);
+};
+
+/** global binary command handler */
+extern BinaryCommand g_bc;
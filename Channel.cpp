@@ -0,0 +1,127 @@
+/**
+ * Control channels, see Channel.h
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Config.h"
+#include "Led.h"
+#include "OperationalMode.h"
+#include "Scheduler.h"
+#include "Channel.h"
+#include "StallMonitor.h"
+#include "TxQueue.h"
+#include "Recorder.h"
+
+/** one per fan, only the first channelsCount() are used */
+Channel g_channels[configFans] = { Channel(0), Channel(1), Channel(2) };
+
+/**
+ * All the channels are run in one pass of the control task, as often as the
+ * most demanding of their opmodes needs
+ */
+static void channelsSchedule()
+{
+  unsigned long period = 0;
+  for(short int i = 0; i < channelsCount(); i++)
+  {
+    OpMode *p = g_channels[i].getOpMode();
+    unsigned long ul = (p == 0) ? 0 : p->getControlPeriod();
+    if(ul != 0 && (period == 0 || ul < period))
+      period = ul;
+  }
+  g_scheduler.setPeriod(taskControl, period);
+}
+
+byte Channel::getCurve()
+{
+  return g_config.curve[m_index];
+}
+
+unsigned short Channel::getPwmMin()
+{
+  unsigned short pwm = g_config.fanPwmMin[m_index];
+  return (pwm == 0) ? g_config.pwmMin : pwm;
+}
+
+unsigned short Channel::getPwmStart()
+{
+  unsigned short pwm = g_config.fanPwmStart[m_index];
+  return (pwm == 0) ? g_config.pwmStart : pwm;
+}
+
+short int Channel::getOpModeId()
+{
+  return (m_pOpMode == 0) ? opModeInvalid : m_pOpMode->getOpMode();
+}
+
+bool Channel::setOpMode(unsigned short int mode)
+{
+  OpMode *p = OpMode::find(mode);
+  if(p == 0)
+  {
+    LOG_WARN(logOpMode, "Can't set mode to %u", mode);
+    return false;
+  }
+  if(m_pOpMode != 0 && m_pOpMode != p)
+    g_recorder.event(recEvOpMode, (m_index << 4) | (byte)mode);
+  m_pOpMode = p;
+  p->onActivate(*this);
+  channelsSchedule();
+  return true;
+}
+
+void Channel::setHot(bool bHot)
+{
+  if(bHot && !m_bHot)
+    g_recorder.event(recEvHot, m_index);
+  m_bHot = bHot;
+}
+
+unsigned short int Channel::getTemp()
+{
+  return (m_pOpMode == 0) ? 0 : m_pOpMode->getTemp(*this);
+}
+
+bool Channel::setTemp(unsigned short int temp)
+{
+  return (m_pOpMode != 0) && m_pOpMode->onCommandSetTemp(*this, temp);
+}
+
+bool Channel::setFan(unsigned short int pwm)
+{
+  return (m_pOpMode != 0) && m_pOpMode->onCommandSetFan(*this, pwm);
+}
+
+void Channel::control()
+{
+  if(m_pOpMode != 0)
+    m_pOpMode->control(*this);
+}
+
+bool channelsSetOpMode(unsigned short int mode)
+{
+  if(OpMode::find(mode) == 0)
+    return false;
+  for(short int i = 0; i < channelsCount(); i++)
+    g_channels[i].setOpMode(mode);
+  return true;
+}
+
+void channelsControl()
+{
+  for(short int i = 0; i < channelsCount(); i++)
+    g_channels[i].control();
+  channelsUpdateLed();
+}
+
+void channelsUpdateLed()
+{
+  bool bOn = (g_stallMonitor.getAlarms() != 0);
+  for(short int i = 0; i < channelsCount(); i++)
+    bOn = bOn || g_channels[i].isHot();
+  if(bOn)
+    g_led.on();
+  else
+    g_led.off();
+}
@@ -0,0 +1,100 @@
+/**
+ * Control channel: a fan and what drives it - the opmode, the temperature
+ * it works with and the curve.  Channel i drives g_fan[i].
+ *
+ * The temperature comes from where the channel's opmode takes it: the
+ * potentiometer, the LM35 or, in the externally measured temperature mode,
+ * what was supplied over serial for this very channel.  The curve is
+ * g_config.curve[i], see Curve.h.  So are the fan min and start PWMs.
+ *
+ * Over serial a channel is addressed as FANn_XXX, n being 1 based, e.g.
+ * FAN2_OPMODE.  The plain OPMODE, TEMP and FAN address all of them.
+ * The control task runs every channel's opmode in a single pass.
+ */
+#pragma once
+#include "Pid.h"
+#include "Fan.h"
+
+class OpMode;
+
+class Channel
+{
+public:
+  Channel(byte index) :
+    m_index(index), m_pid(0, 0, 0, 0, Fan::pwmLimit)
+  {
+  }
+
+  byte getIndex()
+  {
+    return m_index;
+  }
+  Fan &getFan()
+  {
+    return g_fan[m_index];
+  }
+  /** curveXXX to use */
+  byte getCurve();
+  /** min PWM the fan keeps spinning at and starts at: its own, if it was
+   * characterized, see FanChar.h, the global one otherwise */
+  unsigned short getPwmMin();
+  unsigned short getPwmStart();
+  OpMode *getOpMode()
+  {
+    return m_pOpMode;
+  }
+  /** opModeXXX */
+  short int getOpModeId();
+  /** switch to this opmode, false if there is no such */
+  bool setOpMode(unsigned short int mode);
+
+  /** temperature in C the opmode works with */
+  unsigned short int getTemp();
+  /** these are up to the opmode, false if it refused */
+  bool setTemp(unsigned short int temp);
+  bool setFan(unsigned short int pwm);
+
+  /** temperature in C supplied over serial */
+  unsigned short int getExternalTemp()
+  {
+    return m_uExternalTemp;
+  }
+  void setExternalTemp(unsigned short int temp)
+  {
+    m_uExternalTemp = temp;
+  }
+  /** is the temperature over the max?  Set by the opmode. */
+  bool isHot()
+  {
+    return m_bHot;
+  }
+  void setHot(bool bHot);
+  /** PID loop state */
+  Pid &getPid()
+  {
+    return m_pid;
+  }
+
+  /** run the opmode */
+  void control();
+
+private:
+  byte m_index;
+  OpMode *m_pOpMode = 0;
+  unsigned short int m_uExternalTemp = 0;
+  bool m_bHot = false;
+  Pid m_pid;
+};
+
+extern Channel g_channels[];
+/** as many as there are fans */
+inline short int channelsCount()
+{
+  return fansCount();
+}
+/** switch all the channels to this opmode */
+bool channelsSetOpMode(unsigned short int mode);
+/** the control task body, runs every channel */
+void channelsControl();
+/** the LED is on if any channel is hot or any fan stalled, see StallMonitor.h */
+void channelsUpdateLed();
@@ -0,0 +1,133 @@
+/**
+ * Settings kept in EEPROM, see Config.h
+ */
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#define LOG_LEVEL logWarn
+#include "Trace.h"
+#include "Fan.h"
+#include "OperationalMode.h"
+#include "Curve.h"
+#include "Scheduler.h"
+#include "Config.h"
+
+/** defaults, also what an unprogrammed board runs with */
+static const Config configDefaults PROGMEM = {
+  30,     // tempMin
+  45,     // tempMax
+  38,     // pwmMin
+  75,     // pwmStart
+  Fan::pwmLimit, // pwmMax
+  opModeInternallyMeasuredTemperature,
+  {curveRam, curveRam, curveRam},
+  {0, 0, 0},
+  {0, 0, 0},
+  {},
+};
+
+/** load() fills it in */
+Config g_config;
+ConfigStore g_configStore;
+
+static ConfigRecord *slotAddress(byte slot)
+{
+  return (ConfigRecord *)(slot * sizeof(ConfigRecord));
+}
+
+unsigned short ConfigStore::crc(const ConfigRecord &r)
+{
+  const byte *p = (const byte *)&r;
+  unsigned short crc = 0xFFFF;
+  for(byte i = 0; i < offsetof(ConfigRecord, crc); i++)
+    crc = _crc_xmodem_update(crc, p[i]);
+  return crc;
+}
+
+void ConfigStore::load()
+{
+  memcpy_P(&g_config, &configDefaults, sizeof(g_config));
+  bool bFound = false;
+  ConfigRecord r;
+  for(byte slot = 0; slot < configSlots; slot++)
+  {
+    eeprom_read_block(&r, slotAddress(slot), sizeof(r));
+    if(r.version != configVersion || r.crc != crc(r))
+      continue;
+    // sequence # wraps around, newer is ahead by less than half the range
+    if(bFound && (short)(r.seq - m_seq) <= 0)
+      continue;
+    bFound = true;
+    m_slot = slot;
+    m_seq = r.seq;
+    g_config = r.config;
+  }
+  if(bFound)
+    LOG_INFO(logConfig, "Config loaded");
+  else
+    LOG_INFO(logConfig, "Config defaults");
+}
+
+void ConfigStore::changed()
+{
+  schedule();
+  m_bDirty = true;
+  m_ulChanged = nowMillis();
+}
+
+void ConfigStore::save()
+{
+  changed();
+  m_ulChanged -= configSaveDelayMs;
+}
+
+void ConfigStore::reset()
+{
+  memcpy_P(&g_config, &configDefaults, sizeof(g_config));
+  save();
+}
+
+void ConfigStore::schedule()
+{
+  if(!m_bDirty && m_pos == sizeof(m_record))
+    g_scheduler.setPeriod(taskConfig, configPeriod);
+}
+
+void ConfigStore::run()
+{
+  if(m_pos == sizeof(m_record))
+  {
+    if(!m_bDirty || (nowMillis() - m_ulChanged) < configSaveDelayMs)
+      return;
+    // snapshot, g_config may change while this is being written
+    memset(&m_record, 0, sizeof(m_record));
+    m_record.seq = ++m_seq;
+    m_record.version = configVersion;
+    m_record.config = g_config;
+    m_record.crc = crc(m_record);
+    m_slot = (m_slot + 1) % configSlots;
+    m_pos = 0;
+    m_bDirty = false;
+  }
+  // a byte write takes 3.3ms, don't wait for it, come back later instead
+  byte *dst = (byte *)slotAddress(m_slot);
+  const byte *src = (const byte *)&m_record;
+  while(m_pos < sizeof(m_record) && eeprom_is_ready())
+  {
+    eeprom_update_byte(dst + m_pos, src[m_pos]);
+    m_pos++;
+  }
+  if(m_pos < sizeof(m_record))
+    return;
+  m_ulWrites++;
+  LOG_INFO(logConfig, "Config saved in slot %u", m_slot);
+  if(!m_bDirty)
+    g_scheduler.setPeriod(taskConfig, 0);
+}
+
+void ConfigStore::dumpStats(Print &out, char buf[])
+{
+  sprintf_P(buf, PSTR("Config: seq=%u, slot=%d of %d, writes=%lu%S"), 
+    m_seq, (int)m_slot, (int)configSlots, m_ulWrites, (m_bDirty || m_pos < sizeof(m_record)) ? PSTR(", pending") : PSTR(""));
+  out.println(buf);
+}
@@ -0,0 +1,105 @@
+/**
+ * Settings which survive a reset, kept in EEPROM.
+ *
+ * g_config is the RAM copy everybody reads, loaded once at boot.  Changes
+ * are written back by the config task configSaveDelayMs after the last one,
+ * so that a burst of SETs costs a single write.  The writes go round the
+ * EEPROM as a log of configSlots records so that the cells wear evenly:
+ * a record goes into the slot after the newest one and carries the next
+ * sequence #.  Records failing the CRC or of another configVersion - a
+ * write cut short by a reset, a blank chip, a new layout - are skipped,
+ * the newest valid one wins.  With none g_config keeps the defaults.
+ */
+#pragma once
+
+/** bump when Config changes, records of other versions are ignored */
+const byte configVersion = 4;
+/** write back this long after the last change, ms */
+const unsigned long configSaveDelayMs = 5000;
+/** how often the config task runs while there is something to write, ms */
+const unsigned long configPeriod = 10;
+/** max # of fans there are settings for */
+const byte configFans = 3;
+/** # of points in the per fan PWM to RPM curve, see FanChar.h */
+const byte configRpmPoints = 8;
+
+struct Config
+{
+  /** the temperature in C to start the fan */
+  byte tempMin;
+  /** the maximum temperature in C when fan is at 100% */
+  byte tempMax;
+  /** min fan PWM at which the fan continues to spin */
+  unsigned short pwmMin;
+  /** min fan PWM value at which a fan can start */
+  unsigned short pwmStart;
+  /** max fan PWM value to use */
+  unsigned short pwmMax;
+  /** opmode to boot into */
+  byte opMode;
+  /** per fan curveXXX, see Curve.h */
+  byte curve[configFans];
+  /** per fan pwmMin and pwmStart found by FanChar, 0 if none - use the above */
+  unsigned short fanPwmMin[configFans];
+  unsigned short fanPwmStart[configFans];
+  /** per fan RPM / 32 at the FanChar sweep points */
+  byte fanRpm[configFans][configRpmPoints];
+};
+
+/** what goes into an EEPROM slot */
+struct ConfigRecord
+{
+  unsigned short seq;
+  byte version;
+  Config config;
+  /** over all of the above, written last */
+  unsigned short crc;
+};
+
+/** # of records the EEPROM takes */
+const byte configSlots = (E2END + 1) / sizeof(ConfigRecord);
+
+class ConfigStore
+{
+public:
+  /** read the newest valid record into g_config */
+  void load();
+  /** g_config was changed, write it back in a while */
+  void changed();
+  /** write it back now */
+  void save();
+  /** back to the defaults, which are saved too */
+  void reset();
+  /** the config task body */
+  void run();
+  /** sequence # of the record g_config was loaded from or last saved as, 0 if none */
+  unsigned short getSeq()
+  {
+    return m_seq;
+  }
+  /** print the stats */
+  void dumpStats(Print &out, char buf[]);
+
+private:
+  /** slot of the newest record */
+  byte m_slot = configSlots - 1;
+  unsigned short m_seq = 0;
+  /** record being written */
+  ConfigRecord m_record;
+  /** its next byte to write, sizeof(m_record) if none */
+  byte m_pos = sizeof(ConfigRecord);
+  /** g_config differs from the newest record */
+  bool m_bDirty = false;
+  /** nowMillis() of the last change */
+  unsigned long m_ulChanged = 0;
+  /** # of records written */
+  unsigned long m_ulWrites = 0;
+
+  static unsigned short crc(const ConfigRecord &r);
+  /** schedule the config task unless it is running already */
+  void schedule();
+};
+
+/** the RAM copy */
+extern Config g_config;
+extern ConfigStore g_configStore;
@@ -0,0 +1,58 @@
+/**
+ * Fan curves, see Curve.h
+ */
+#include <Arduino.h>
+#include "Config.h"
+#include "Curve.h"
+
+/**
+ * Built-in curves, temperature in C, PWM
+ */
+constexpr CurvePoint curveQuietPoints[] = {{40, 50}, {50, 100}, {60, 200}, {70, Fan::pwmLimit}};
+constexpr CurvePoint curvePerformancePoints[] = {{25, 75}, {35, 200}, {45, Fan::pwmLimit}};
+constexpr CurvePoint curveFullPoints[] = {{0, Fan::pwmLimit}};
+
+static_assert(curveValid(curveQuietPoints, sizeof(curveQuietPoints) / sizeof(curveQuietPoints[0])), "bad curve");
+static_assert(curveValid(curvePerformancePoints, sizeof(curvePerformancePoints) / sizeof(curvePerformancePoints[0])), "bad curve");
+static_assert(curveValid(curveFullPoints, sizeof(curveFullPoints) / sizeof(curveFullPoints[0])), "bad curve");
+
+/** indexed by curve ID - 1 */
+const unsigned short g_curves[curveCount - 1][curveTemps] PROGMEM = {
+  CURVE_LUT(curveQuietPoints),
+  CURVE_LUT(curvePerformancePoints),
+  CURVE_LUT(curveFullPoints),
+};
+
+unsigned short g_curveRam[curveTemps];
+/** g_curveRam is the g_config ramp, not uploaded points */
+static bool g_bCurveRamp = true;
+
+static bool curveExpand(const CurvePoint *points, byte n)
+{
+  if(!curveValid(points, n))
+    return false;
+  for(byte t = 0; t < curveTemps; t++)
+    g_curveRam[t] = curvePwmAt(points, n, t);
+  return true;
+}
+
+bool curveLoad(const CurvePoint *points, byte n)
+{
+  if(!curveExpand(points, n))
+    return false;
+  g_bCurveRamp = false;
+  return true;
+}
+
+void curveLoadRamp()
+{
+  CurvePoint points[] = {{g_config.tempMin, g_config.pwmMin}, {g_config.tempMax, g_config.pwmMax}};
+  curveExpand(points, 2);
+  g_bCurveRamp = true;
+}
+
+void curveUpdateRamp()
+{
+  if(g_bCurveRamp)
+    curveLoadRamp();
+}
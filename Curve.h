@@ -0,0 +1,99 @@
+/**
+ * Fan curves: temperature in C to PWM, in Timer1 counts, see Fan.h.
+ *
+ * A curve is defined by up to curvePointsMax points, sorted by temperature,
+ * and is linear in between.  Below the first point the fan is stopped, above
+ * the last one it stays at the last point's PWM.  To make the control path a
+ * single table index every curve is expanded into a per degree table of
+ * curveTemps entries:
+ *  - built-in curves at compile time, into flash, see Curve.cpp,
+ *  - the RAM curve when points are uploaded, see curveLoad().  Until then it
+ *    is the g_config ramp: tempMin, pwmMin to tempMax, pwmMax, rebuilt as
+ *    these change.  Uploaded points are not saved, the ramp is back after
+ *    a reset.
+ * Every fan has its own curve, see Config::curve.
+ */
+#pragma once
+#include "Fan.h"
+
+/** temperatures the tables cover, 0 to curveTemps - 1 C, above that is the same as the top one */
+const byte curveTemps = 100;
+/** max # of points defining a curve */
+const byte curvePointsMax = 16;
+
+/** curve IDs */
+const byte curveRam = 0;
+/** starts late, reaches the max at 70C */
+const byte curveQuiet = 1;
+/** starts early, reaches the max at 45C */
+const byte curvePerformance = 2;
+/** always at max */
+const byte curveFull = 3;
+/** # of curves */
+const byte curveCount = 4;
+
+struct CurvePoint
+{
+  byte temp;
+  unsigned short pwm;
+};
+
+/** the tables */
+extern unsigned short g_curveRam[curveTemps];
+extern const unsigned short g_curves[curveCount - 1][curveTemps] PROGMEM;
+
+/** PWM for this temperature on this curve */
+inline unsigned short curveRead(byte curve, unsigned short int temp)
+{
+  if(temp >= curveTemps)
+    temp = curveTemps - 1;
+  if(curve == curveRam)
+    return g_curveRam[temp];
+  return pgm_read_word(&g_curves[curve - 1][temp]);
+}
+
+/** expand these points into the RAM curve, false if they are not a valid curve */
+bool curveLoad(const CurvePoint *points, byte n);
+/** make the RAM curve the g_config ramp */
+void curveLoadRamp();
+/** g_config changed, rebuild the RAM curve unless it is uploaded points */
+void curveUpdateRamp();
+
+/**
+ * Compile time expansion and checks, C++11 constexpr, also used at run time
+ * by curveLoad()
+ */
+constexpr long curveDiv(long num, long den)
+{
+  return (num >= 0) ? (num + den / 2) / den : (num - den / 2) / den;
+}
+constexpr unsigned short curveLerp(const CurvePoint &a, const CurvePoint &b, byte temp)
+{
+  return a.pwm + curveDiv(((long)b.pwm - a.pwm) * (temp - a.temp), b.temp - a.temp);
+}
+constexpr unsigned short curvePwmAt(const CurvePoint *p, byte n, byte temp, byte i = 0)
+{
+  return (temp < p[0].temp) ? 0 :
+    (i + 1 >= n) ? p[n - 1].pwm :
+    (temp < p[i + 1].temp) ? curveLerp(p[i], p[i + 1], temp) :
+    curvePwmAt(p, n, temp, i + 1);
+}
+/**
+ * 1 to curvePointsMax points with increasing temperatures in the table range
+ * and PWMs up to fanPwmTop
+ */
+constexpr bool curveValid(const CurvePoint *p, byte n, byte i = 0)
+{
+  return (n == 0 || n > curvePointsMax || p[i].pwm > fanPwmTop) ? false :
+    (i + 1 >= n) ? (p[i].temp < curveTemps) :
+    (p[i].temp < p[i + 1].temp && curveValid(p, n, i + 1));
+}
+
+/** initializer for a table in g_curves */
+#define CURVE_AT(p, t) curvePwmAt(p, sizeof(p) / sizeof(p[0]), t)
+#define CURVE_LUT10(p, t) \
+  CURVE_AT(p, t), CURVE_AT(p, t + 1), CURVE_AT(p, t + 2), CURVE_AT(p, t + 3), CURVE_AT(p, t + 4), \
+  CURVE_AT(p, t + 5), CURVE_AT(p, t + 6), CURVE_AT(p, t + 7), CURVE_AT(p, t + 8), CURVE_AT(p, t + 9)
+#define CURVE_LUT(p) { \
+  CURVE_LUT10(p, 0), CURVE_LUT10(p, 10), CURVE_LUT10(p, 20), CURVE_LUT10(p, 30), CURVE_LUT10(p, 40), \
+  CURVE_LUT10(p, 50), CURVE_LUT10(p, 60), CURVE_LUT10(p, 70), CURVE_LUT10(p, 80), CURVE_LUT10(p, 90) }
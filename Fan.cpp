@@ -1,193 +1,192 @@
 #include <Arduino.h>
 #include "Trace.h"
 #include "Fan.h"
+#include "Config.h"
+#include "Channel.h"
 #include "pcb.h"
 
 /** These are the fans we control */
 Fan g_fan[] = {
   {pinFan1pwm, pinFan1sen},
-  //{pinFan2pwm, pinFan2sen},
-  //{pinFan3pwm, pinFan3sen}
+  {pinFan2pwm, pinFan2sen},
+  {pinFan3pwm, pinFan3sen}
 };
 /** # of fans we control */
 const short int iFans = sizeof(g_fan) / sizeof(g_fan[0]);
 
 /**
- * fan sensor increments this
+ * fan sense pins cause these interrupts, one per fan
  */
-static volatile unsigned long g_ulFanTick = 0;
-
-/**
- * fan sense pin causes this interrupt
- */
-static void fanISR()
+template<short int i> static void fanISR()
 {
-  g_ulFanTick++;
+  if(i < iFans)
+    g_fan[i].onTachEdge();
 }
+static void (* const g_fanISRs[])() = { fanISR<0>, fanISR<1>, fanISR<2> };
 
 /**
- * used by begin/end calculateRPM
- */
-static unsigned long g_ulRPMcalcMillis = 0;
-
-/**
- * starts calculation of fan RPM
- * Side effect - zeros g_ulFanTick
+ * Timer0 is left to the Arduino core, so these are plain millis() and
+ * micros(), wrapping around every 49 days and 71 minutes respectively.
+ * Safe to call from an ISR.
  */
-void beginCalculateRPM() 
+unsigned long nowMillis()
 {
-  noInterrupts();
-  g_ulRPMcalcMillis = nowMillis();
-  g_ulFanTick = 0;
-  interrupts();
+  return millis();
 }
-
-/**
- * calculates fan RPM
- * return RPM or 0 if beginCalculateRPM was not called before
- * Side effect - zeros g_ulFanTick
- */
-unsigned long endCalculateRPM() 
+unsigned long nowMicros()
 {
-  if(g_ulRPMcalcMillis == 0)
-    return 0;
-  noInterrupts();
-  unsigned long revolutions = g_ulFanTick/2;
-  interrupts();
-  float elapsedS = (nowMillis() - g_ulRPMcalcMillis)/1000.0;
-  g_ulRPMcalcMillis = 0;
-  float revPerS = revolutions / elapsedS;
-  unsigned long rpm = revPerS * 60.0;
-  DEBUG_PRINT("RPM="); DEBUG_PRINTDEC(rpm); DEBUG_PRINTLN("");
-  return rpm;
+  return micros();
 }
 
 /**
- * We mess with timer 0 - see fanSetup() - so need this correction
+ * Fan PWM timers setup.
+ * For Arduino Uno, Nano, Pro Mini and any other board using ATmega 168 or 328.
+ * Timer0 drives millis() and delay() and is not touched, so D5 and D6 stay at
+ * its 976Hz.  Timer1, D9 and D10, is switched to phase correct PWM with ICR1
+ * as TOP (mode 10) and no prescaling, i.e. fanPwmHz with fanPwmTop steps.
+ * Timer2, D3 and D11, has no TOP register to spare for its compare outputs,
+ * so it only loses the prescaler: phase correct 8 bits at 31.37kHz.
+ * The 8 bit timers get the PWM scaled down, see output().
+ * See pcb.h for which fan is on which pin.
  */
-unsigned long nowMillis()
+static void fansSetupTimers()
 {
-  return (millis() / 64);
-}
-
-void myDelay(unsigned long ms)
-{
-  delay(ms * 64);
+  byte com1 = 0;
+  bool bTimer2 = false;
+  for(short int i = 0; i < iFans; i++)
+  {
+    short int pin = g_fan[i].getPin();
+    if(pin == 9)
+      com1 |= _BV(COM1A1);
+    else if(pin == 10)
+      com1 |= _BV(COM1B1);
+    else if(pin == 3 || pin == 11)
+      bTimer2 = true;
+  }
+  if(com1 != 0)
+  {
+    // stop it while it is being set up
+    TCCR1B = 0;
+    TCNT1 = 0;
+    ICR1 = fanPwmTop;
+    OCR1A = 0;
+    OCR1B = 0;
+    TCCR1A = com1 | _BV(WGM11);
+    TCCR1B = _BV(WGM13) | _BV(CS10);
+  }
+  if(bTimer2)
+    TCCR2B = (TCCR2B & ~(_BV(CS22) | _BV(CS21) | _BV(CS20))) | _BV(CS20);
 }
 
 /**
- * Fan startup sequence
+ * Fan setup
  */
 void fansSetup()
 {
-  // For Arduino Uno, Nano, Micro Magician, Mini Driver, Lilly Pad and any other board using ATmega 8, 168 or 328**
-  // The Arduino uses Timer 0 internally for the millis() and delay() functions
-  //---------------------------------------------- Set PWM frequency for D5 & D6 -------------------------------
-  TCCR0B = TCCR0B & B11111000 | B00000001;    // set timer 0 divisor to     1 for PWM frequency of 62500.00 Hz
-  //TCCR0B = TCCR0B & B11111000 | B00000010;    // set timer 0 divisor to     8 for PWM frequency of  7812.50 Hz
-  //TCCR0B = TCCR0B & B11111000 | B00000011;    // set timer 0 divisor to    64 for PWM frequency of   976.56 Hz (The DEFAULT)
-  //TCCR0B = TCCR0B & B11111000 | B00000100;    // set timer 0 divisor to   256 for PWM frequency of   244.14 Hz
-  //TCCR0B = TCCR0B & B11111000 | B00000101;    // set timer 0 divisor to  1024 for PWM frequency of    61.04 Hz
-
-  //---------------------------------------------- Set PWM frequency for D9 & D10 ------------------------------
-  //TCCR1B = TCCR1B & B11111000 | B00000001;    // set timer 1 divisor to     1 for PWM frequency of 31372.55 Hz
-  //TCCR1B = TCCR1B & B11111000 | B00000010;    // set timer 1 divisor to     8 for PWM frequency of  3921.16 Hz
-  //TCCR1B = TCCR1B & B11111000 | B00000011;    // set timer 1 divisor to    64 for PWM frequency of   490.20 Hz (The DEFAULT)
-  //TCCR1B = TCCR1B & B11111000 | B00000100;    // set timer 1 divisor to   256 for PWM frequency of   122.55 Hz
-  //TCCR1B = TCCR1B & B11111000 | B00000101;    // set timer 1 divisor to  1024 for PWM frequency of    30.64 Hz
-
-  //---------------------------------------------- Set PWM frequency for D3 & D11 ------------------------------
-  //TCCR2B = TCCR2B & B11111000 | B00000001;    // set timer 2 divisor to     1 for PWM frequency of 31372.55 Hz
-  //TCCR2B = TCCR2B & B11111000 | B00000010;    // set timer 2 divisor to     8 for PWM frequency of  3921.16 Hz
-  //TCCR2B = TCCR2B & B11111000 | B00000011;    // set timer 2 divisor to    32 for PWM frequency of   980.39 Hz
-  //TCCR2B = TCCR2B & B11111000 | B00000100;    // set timer 2 divisor to    64 for PWM frequency of   490.20 Hz (The DEFAULT)
-  //TCCR2B = TCCR2B & B11111000 | B00000101;    // set timer 2 divisor to   128 for PWM frequency of   245.10 Hz
-  //TCCR2B = TCCR2B & B11111000 | B00000110;    // set timer 2 divisor to   256 for PWM frequency of   122.55 Hz
-  //TCCR2B = TCCR2B & B11111000 | B00000111;    // set timer 2 divisor to  1024 for PWM frequency of    30.64 Hz
-  
+  fansSetupTimers();
   for(short int i = 0; i < iFans; i++)
-    g_fan[i].setup();
-  //g_fan[0].test();
-
-  //
-  // stop the fan
-  //
-  DEBUG_PRINTLN("Stopping fans...");
+    g_fan[i].setup(g_fanISRs[i]);
+  // fans are tested in the background, see FanTest.h
   fansStop();
-  myDelay(4*1000);
-  //
-  // spin the fan at start PWM
-  //
-  DEBUG_PRINTLN("Spinning fans at start PWM...");
-  for(short int i = 0; i < iFans; i++)
-    g_fan[i].start();
-  beginCalculateRPM();
-  unsigned long ulFanTick = g_ulFanTick;  
-  myDelay(4*1000);
-  unsigned long rpm = endCalculateRPM();
-  if(ulFanTick == g_ulFanTick)
-  {
-    DEBUG_PRINTLN("Fan seem to be absent or failed to start!");
-  }
-  else
-  {
-    DEBUG_PRINT("Fan ticks="); DEBUG_PRINTDEC(g_ulFanTick); DEBUG_PRINTLN("");
-  }
-  
-  //
-  // spin the fan at max RPM
-  //
-  DEBUG_PRINTLN("Spinning fans at max PWM...");
-  fansSpin(Fan::pwmMax);
-  beginCalculateRPM();
-  myDelay(4*1000);
-  rpm = endCalculateRPM();
-  //
-  // spin the fan at min RPM
-  //
-  DEBUG_PRINTLN("Spinning fans at min PWM...");
-  fansSpin(Fan::pwmMin);
-  beginCalculateRPM();
-  myDelay(4*1000);
-  rpm = endCalculateRPM();
-
-  beginCalculateRPM();
 }
 
 
-void fansStop()
+short int fansCount()
 {
-  for(short int i = 0; i < iFans; i++)
-    g_fan[i].stop();
+  return iFans;
 }
 
-void fansSpin(unsigned short pwm)
+void fansStop()
 {
-  //DEBUG_PRINT("fansSpin "); DEBUG_PRNTLN(pwm);
   for(short int i = 0; i < iFans; i++)
-    g_fan[i].spin(pwm);
+    g_fan[i].stop();
 }
 
-void fansDumpStats(char buf[])
+void fansDumpStats(Print &out, char buf[], short int i)
 {
-  unsigned short pwm = g_fan[0].getPWM();
-  sprintf(buf, "Now=%lums, PWM=%d, FanTicks=%lu, ", nowMillis(), (int)pwm, g_ulFanTick);
-  Serial.print(buf);
-  endCalculateRPM();  // this will print "RPM=xxx\n"
-  beginCalculateRPM();
+  Fan &f = g_fan[i];
+  sprintf_P(buf, PSTR("Fan%d: PWM=%d, FanTicks=%lu, RPM=%lu, opmode=%d, curve=%d"), 
+    (int)i, (int)f.getPWM(), f.getTicks(), f.getRPM(), (int)g_channels[i].getOpModeId(), (int)g_config.curve[i]);
+  out.println(buf);
 }
 
 /** 
  * Setup the fan
  */
-void Fan::setup()
+void Fan::setup(void (*tachISR)())
 {
   pinMode(m_pinFan, OUTPUT);
-  if(m_pinSensor > 0)
+  if(hasSensor())
   {
     pinMode(m_pinSensor, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(m_pinSensor), fanISR, FALLING);
+    attachInterrupt(digitalPinToInterrupt(m_pinSensor), tachISR, FALLING);
+  }
+}
+
+/**
+ * Called from the tach ISR.  Timestamp the edge and keep the period.
+ */
+void Fan::onTachEdge()
+{
+  unsigned long now = nowMicros();
+  unsigned long ulPeriod = now - m_ulLastEdgeUs;
+  if(ulPeriod < fanTachMinPeriodUs)
+    return; // glitch
+  m_ulTicks++;
+  m_ulLastEdgeUs = now;
+  if(ulPeriod > fanTachTimeoutUs)
+  {
+    // first edge after a stop, there is no meaningful period yet
+    m_valid = 0;
+    m_ulPeriodsSum = 0;
+    m_head = 0;
+    return;
   }
+  if(m_valid < fanTachPeriods)
+    m_valid++;
+  else
+    m_ulPeriodsSum -= m_ulPeriods[m_head];
+  m_ulPeriods[m_head] = ulPeriod;
+  m_ulPeriodsSum += ulPeriod;
+  if(++m_head >= fanTachPeriods)
+    m_head = 0;
+}
+
+unsigned long Fan::getTicks()
+{
+  noInterrupts();
+  unsigned long res = m_ulTicks;
+  interrupts();
+  return res;
+}
+
+unsigned long Fan::getLastEdgeUs()
+{
+  noInterrupts();
+  unsigned long res = m_ulLastEdgeUs;
+  interrupts();
+  return res;
+}
+
+/**
+ * RPM from the average tach period
+ */
+unsigned long Fan::getRPM()
+{
+  // timestamp with the interrupts off, an edge after it would make the time
+  // since the last edge wrap around
+  noInterrupts();
+  unsigned long ulSince = nowMicros() - m_ulLastEdgeUs;
+  unsigned long ulSum = m_ulPeriodsSum;
+  byte valid = m_valid;
+  interrupts();
+  if(valid == 0 || ulSince > fanTachTimeoutUs)
+    return 0;
+  unsigned long ulPeriod = ulSum / valid;
+  // the fan is slowing down - the current period is longer than the average
+  if(ulSince > ulPeriod)
+    ulPeriod = ulSince;
+  return periodToRPM(ulPeriod);
 }
 
 /**
@@ -195,8 +194,8 @@ void Fan::setup()
  */
 void Fan::start()
 {
-  DEBUG_PRINTLN("Starting fan.. ");
-  spin(pwmStart);
+  LOG_DEBUG(logFan, "Starting fan %d", m_pinFan);
+  spin(g_config.pwmStart);
 }
 /**
  * Stop the fan if it is spinning
@@ -205,9 +204,10 @@ void Fan::stop()
 {
   if(m_pwm == 0)
     return;
-  DEBUG_PRINTLN("Stopping fan...");
-  digitalWrite(m_pinFan, LOW);
+  LOG_DEBUG(logFan, "Stopping fan %d", m_pinFan);
   m_pwm = 0;
+  if(!m_bOverride)
+    output(0);
 }
 /** 
  * spin the fan at this pwm 
@@ -216,28 +216,44 @@ void Fan::spin(unsigned short pwm)
 {
   if(pwm == m_pwm)
     return;
-  analogWrite(m_pinFan, pwm);
   m_pwm = pwm;
-  DEBUG_PRINT("analogWrite("); DEBUG_PRNT(m_pinFan); DEBUG_PRINT(", "); DEBUG_PRNT(pwm); DEBUG_PRINTLN(")");
+  if(!m_bOverride)
+    output(pwm);
 }
 
-/**
- * utility to find the min PWM at which this fan starts
- */
-/*void Fan::test()
+void Fan::override(unsigned short pwm)
 {
-  
-  Serial.println("Starting a test to find a min pwm at which this fan can be started...");
-  Serial.println("Note the value when we first FAIL to start the fan");
-  for(unsigned short int pwm = 90; pwm > 10; pwm = pwm - 8)
+  m_bOverride = true;
+  output(pwm);
+}
+
+void Fan::release()
+{
+  if(!m_bOverride)
+    return;
+  m_bOverride = false;
+  output(m_pwm);
+}
+
+void Fan::output(unsigned short pwm)
+{
+  if(m_pinFan == 9 || m_pinFan == 10)
   {
-    stop();
-    myDelay(4*1000);
-    // try to start the fan
-    spin(pwm);
-    myDelay(4*1000);
-  } 
-     
-}*/
-
-
+    // Timer1, PWM is in its counts, 0 and TOP are steady low and high
+    if(m_pinFan == 9)
+      OCR1A = pwm;
+    else
+      OCR1B = pwm;
+    LOG_DEBUG(logFan, "OCR1(%d, %u)", m_pinFan, pwm);
+    return;
+  }
+  // 8 bit timers
+  byte duty = ((unsigned long)pwm * 255 + pwmLimit / 2) / pwmLimit;
+  if(duty == 0)
+  {
+    digitalWrite(m_pinFan, LOW);
+    return;
+  }
+  analogWrite(m_pinFan, duty);
+  LOG_DEBUG(logFan, "analogWrite(%d, %u)", m_pinFan, duty);
+}
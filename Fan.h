@@ -1,5 +1,19 @@
 #pragma once
 
+/** # of tach periods RPM is averaged over, 2 periods per revolution */
+const byte fanTachPeriods = 4;
+/** tach edges closer than this are considered noise, in us */
+const unsigned long fanTachMinPeriodUs = 1000;
+/** no tach edges for that long means the fan is not spinning, in us */
+const unsigned long fanTachTimeoutUs = 500000;
+/** PWM frequency of the 4-wire fan spec, Hz */
+const unsigned long fanPwmHz = 25000;
+/**
+ * Timer1 TOP for fanPwmHz in phase correct mode, i.e. steps of duty.  It is
+ * the PWM scale all over: curves, opmodes, settings.
+ */
+const unsigned int fanPwmTop = F_CPU / 2 / fanPwmHz;
+
 /**
  * PWM-controled fan connected to an output pin
  * Fan sensor may be connected to another input pin
@@ -7,12 +21,11 @@
 class Fan
 { 
 public:  
-  /** min fan PWM at which the fan continues to spin */
-  static const unsigned short pwmMin = 30; // 16;
-  /** min fan PWM value at which a fan can start  */
-  static const unsigned short pwmStart = 60; // 30;
-  /** max fan PWM value to use */
-  static const unsigned short pwmMax = 255;
+  /** 
+   * max fan PWM value there is, Timer1 counts.  Min, start and max PWMs to
+   * use are in g_config, see Config.h
+   */
+  static const unsigned short pwmLimit = fanPwmTop;
   /**
    * 
    */
@@ -25,47 +38,99 @@ public:
   {
     return (m_pwm != 0);
   }
+  /** PWM the fan is to spin at, what the opmode asked for */
   unsigned short getPWM()
   {
     return m_pwm;
   }
+  /** PWM output pin */
+  short int getPin()
+  {
+    return m_pinFan;
+  }
+  /** does it have a tach? */
+  bool hasSensor()
+  {
+    return (m_pinSensor > 0);
+  }
+  /** 
+   * RPM derived from the time between the tach edges averaged over
+   * the last fanTachPeriods periods.  0 if the fan is not spinning.
+   */
+  unsigned long getRPM();
+  /** # of tach edges seen so far */
+  unsigned long getTicks();
+  /** nowMicros() of the last tach edge */
+  unsigned long getLastEdgeUs();
+  /** fan sensor ISR calls this on every falling edge */
+  void onTachEdge();
+  /** 
+   * 2 tach pulses per revolution, hence RPM = 60*1000000 / (2 * period).
+   * One 32 bit integer division - no soft-float.
+   */
+  static unsigned long periodToRPM(unsigned long ulPeriodUs)
+  {
+    return 30000000UL / ulPeriodUs;
+  }
 
   void start();
   void stop();
   /** spin the fan at this pwm */
   void spin(unsigned short pwm);
+  /**
+   * Take over the fan, e.g. to test it, and drive it at this pwm no matter
+   * what spin() is asked for.  release() gives it back at the last spin() pwm.
+   */
+  void override(unsigned short pwm);
+  void release();
+  bool isOverridden()
+  {
+    return m_bOverride;
+  }
   /** 
-   * Setup the fan
+   * Setup the fan, tachISR is to call onTachEdge() for this fan
    */
-  void setup();
+  void setup(void (*tachISR)());
 
 protected:
   /** PWM output pin controlling the fan's speed */
   short int m_pinFan;
   /** input pin attached to fan's sensor */
   short int m_pinSensor;
-  /** last PWM value we sent to the fan */
-  short unsigned m_pwm = 255;
+  /** last PWM value we were asked to spin the fan at */
+  short unsigned m_pwm = pwmLimit;
+  /** spin() only updates m_pwm, see override() */
+  bool m_bOverride = false;
+
+  /** drive the output pin */
+  void output(unsigned short pwm);
+
+  /** tach edges counter */
+  volatile unsigned long m_ulTicks = 0;
+  /** nowMicros() of the last tach edge */
+  volatile unsigned long m_ulLastEdgeUs = 0;
+  /** last tach periods in us, ring buffer */
+  volatile unsigned long m_ulPeriods[fanTachPeriods];
+  /** sum of the valid m_ulPeriods */
+  volatile unsigned long m_ulPeriodsSum = 0;
+  /** where the next period goes */
+  volatile byte m_head = 0;
+  /** # of valid periods in m_ulPeriods */
+  volatile byte m_valid = 0;
 };
 
 extern Fan g_fan[];
 /** # of fans we control */
 //const short int iFans = 3; //sizeof(g_fan) / sizeof(g_fan[0]);
-//extern volatile unsigned long g_ulFanTick;
 
 void fansSetup();
 void fansStop();
-void fansSpin(unsigned short pwm);
-void fansDumpStats(char buf[]);
-
-inline unsigned short fansGetPWM()
-{
-  return g_fan[0].getPWM();
-}
-
-extern void beginCalculateRPM();
-extern unsigned long endCalculateRPM();
+/** print stats of fan i */
+void fansDumpStats(Print &out, char buf[], short int i);
+/** # of fans we control */
+short int fansCount();
 
+/** monotonic time since boot, wraps around */
 unsigned long nowMillis();
-void myDelay(unsigned long ms);
+unsigned long nowMicros();
 
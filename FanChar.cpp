@@ -0,0 +1,307 @@
+/**
+ * Fan characterization, see FanChar.h
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "FanTest.h"
+#include "Config.h"
+#include "Scheduler.h"
+#include "FanChar.h"
+
+FanChar g_fanChar;
+
+short int FanChar::fans()
+{
+  short int n = fansCount();
+  return (n > configFans) ? configFans : n;
+}
+
+void FanChar::begin()
+{
+  LOG_INFO(logTest, "Fans characterization started");
+  m_ulStart = nowMillis();
+  m_result = testRunning;
+  for(short int i = 0; i < fans(); i++)
+  {
+    FanCharState &s = m_fans[i];
+    memset(&s, 0, sizeof(s));
+    if(!g_fan[i].hasSensor())
+    {
+      s.result = testNoTach;
+      continue;
+    }
+    s.result = testRunning;
+    // from the top down
+    s.point = configRpmPoints - 1;
+    startPhase(i, charPhaseSweep, charSweepPwm(s.point));
+  }
+  g_scheduler.setPeriod(taskFanChar, charPeriod);
+}
+
+void FanChar::abort()
+{
+  if(m_result != testRunning)
+    return;
+  LOG_INFO(logTest, "Fans characterization aborted");
+  m_result = testNone;
+  for(short int i = 0; i < fans(); i++)
+  {
+    FanCharState &s = m_fans[i];
+    if(s.result != testRunning)
+      continue;
+    s.result = testNone;
+    s.phase = charPhaseIdle;
+    g_fan[i].release();
+  }
+  end();
+}
+
+void FanChar::end()
+{
+  m_ulDuration = nowMillis() - m_ulStart;
+  g_scheduler.setPeriod(taskFanChar, 0);
+}
+
+void FanChar::startPhase(short int i, byte phase, unsigned short pwm)
+{
+  FanCharState &s = m_fans[i];
+  s.phase = phase;
+  s.pwm = pwm;
+  s.ulPhaseStart = nowMillis();
+  s.count = 0;
+  g_fan[i].override(pwm);
+}
+
+bool FanChar::isStable(FanCharState &s, unsigned int rpm)
+{
+  // compare with charSettlePeriods samples ago
+  if(rpm == 0 || s.count < charSettlePeriods)
+    return false;
+  unsigned int then = s.samples[s.head];
+  unsigned int delta = (rpm > then) ? (rpm - then) : (then - rpm);
+  return (delta <= (then >> 5));
+}
+
+void FanChar::run()
+{
+  if(m_result != testRunning)
+    return;
+  bool bDone = true;
+  for(short int i = 0; i < fans(); i++)
+  {
+    if(m_fans[i].result != testRunning)
+      continue;
+    run(i);
+    if(m_fans[i].result == testRunning)
+      bDone = false;
+  }
+  if(!bDone)
+    return;
+  m_result = testPassed;
+  bool bSave = false;
+  for(short int i = 0; i < fans(); i++)
+  {
+    if(m_fans[i].result == testFailed)
+      m_result = testFailed;
+    else if(m_fans[i].result == testPassed)
+      bSave = true;
+  }
+  if(bSave)
+    g_configStore.changed();
+  end();
+  LOG_INFO(logTest, "Fans characterization done in %lums", m_ulDuration);
+}
+
+void FanChar::run(short int i)
+{
+  FanCharState &s = m_fans[i];
+  unsigned long rpm = g_fan[i].getRPM();
+  unsigned int uRpm = (rpm > 0xFFFF) ? 0xFFFF : (unsigned int)rpm;
+  bool bStable = isStable(s, uRpm);
+  // started is confirmed by two RPM readings in a row
+  byte prev = (s.head == 0) ? (charSettlePeriods - 1) : (s.head - 1);
+  bool bStarted = (uRpm != 0 && s.count > 0 && s.samples[prev] != 0);
+  // a slowly coasting fan reads 0 too, stopped is 0 for a while
+  bool bStopped = (uRpm == 0 && s.count >= charSettlePeriods);
+  for(byte j = 0; bStopped && j < charSettlePeriods; j++)
+    bStopped = (s.samples[j] == 0);
+  unsigned long ulElapsed = nowMillis() - s.ulPhaseStart;
+  // a stalled fan coasting down may look stable for a while
+  bool bSpinning = bStable && ulElapsed >= charSpinMs;
+  bool bStalled = (uRpm == 0 && ulElapsed >= charStartMaxMs) || ulElapsed >= charSettleMaxMs;
+  // s.head is the oldest sample, it is replaced now
+  s.samples[s.head] = uRpm;
+  if(++s.head >= charSettlePeriods)
+    s.head = 0;
+  if(s.count < 0xFF)
+    s.count++;
+
+  switch(s.phase)
+  {
+    case charPhaseSweep:
+      if(bSpinning)
+      {
+        unsigned int rpm32 = uRpm >> 5;
+        s.rpm[s.point] = (rpm32 > 0xFF) ? 0xFF : (byte)rpm32;
+        if(s.point > 0)
+        {
+          s.point--;
+          startPhase(i, charPhaseSweep, charSweepPwm(s.point));
+          break;
+        }
+        // spins all the way down, the min is under the lowest sweep point
+        s.lo = 0;
+        s.hi = s.pwm;
+        searchSpin(i);
+      }
+      else if(bStalled)
+      {
+        if(s.point == configRpmPoints - 1)
+        {
+          // not even at the max
+          finish(i, testFailed);
+          break;
+        }
+        s.lo = s.pwm;
+        s.hi = charSweepPwm(s.point + 1);
+        searchSpin(i);
+      }
+      break;
+    case charPhaseKick:
+      if(bStarted)
+        startPhase(i, charPhasePrime, s.hi);
+      else if(ulElapsed >= charStartMaxMs)
+        finish(i, testFailed);
+      break;
+    case charPhasePrime:
+      if(bStable || ulElapsed >= charSettleMaxMs)
+        startPhase(i, charPhaseSpin, (s.lo + s.hi) / 2);
+      break;
+    case charPhaseSpin:
+      if(bSpinning)
+      {
+        s.hi = s.pwm;
+        // still spinning, go on from here
+        if(s.hi - s.lo > 1)
+          startPhase(i, charPhaseSpin, (s.lo + s.hi) / 2);
+        else
+          searchSpin(i);
+      }
+      else if(uRpm == 0 || ulElapsed >= charSettleMaxMs)
+      {
+        s.lo = s.pwm;
+        searchSpin(i);
+      }
+      break;
+    case charPhaseStop:
+      if(bStopped)
+        startPhase(i, charPhaseStart, (s.lo + s.hi) / 2);
+      else if(ulElapsed >= charSettleMaxMs)
+        finish(i, testFailed);
+      break;
+    case charPhaseStart:
+      if(bStarted)
+      {
+        s.hi = s.pwm;
+        searchStart(i);
+      }
+      else if(ulElapsed >= charStartMaxMs)
+      {
+        s.lo = s.pwm;
+        searchStart(i);
+      }
+      break;
+  }
+}
+
+void FanChar::searchSpin(short int i)
+{
+  FanCharState &s = m_fans[i];
+  if(s.hi - s.lo > 1)
+  {
+    // get it going at the upper end, then try the middle
+    startPhase(i, charPhaseKick, Fan::pwmLimit);
+    return;
+  }
+  s.pwmSpin = s.hi;
+  // it starts at least where it keeps spinning, and it started at the max
+  s.lo = s.pwmSpin - 1;
+  s.hi = Fan::pwmLimit;
+  searchStart(i);
+}
+
+void FanChar::searchStart(short int i)
+{
+  FanCharState &s = m_fans[i];
+  if(s.hi - s.lo > 1)
+  {
+    startPhase(i, charPhaseStop, 0);
+    return;
+  }
+  s.pwmStart = s.hi;
+  finish(i, testPassed);
+}
+
+void FanChar::finish(short int i, byte result)
+{
+  FanCharState &s = m_fans[i];
+  s.phase = charPhaseIdle;
+  g_fan[i].release();
+  // the fan needs more than it is allowed to get, the opmodes would never
+  // start it
+  if(result == testPassed && s.pwmStart > g_config.pwmMax)
+  {
+    LOG_WARN(logTest, "Fan %d starts at PWM %d over the max", i, s.pwmStart);
+    result = testFailed;
+  }
+  s.result = result;
+  if(result != testPassed)
+  {
+    LOG_WARN(logTest, "Fan %d characterization failed", i);
+    return;
+  }
+  // the margin is not worth going over the max for
+  unsigned short pwm = s.pwmSpin + charMargin;
+  g_config.fanPwmMin[i] = (pwm > g_config.pwmMax) ? g_config.pwmMax : pwm;
+  pwm = s.pwmStart + charMargin;
+  g_config.fanPwmStart[i] = (pwm > g_config.pwmMax) ? g_config.pwmMax : pwm;
+  memcpy(g_config.fanRpm[i], s.rpm, sizeof(s.rpm));
+}
+
+unsigned int charRpm(short int i, unsigned short pwm)
+{
+  const byte *rpm = g_config.fanRpm[i];
+  // below the first sweep point it could as well be stopped
+  if(rpm[configRpmPoints - 1] == 0 || pwm < charSweepPwm(0))
+    return 0;
+  byte j = 0;
+  while(j < configRpmPoints - 1 && pwm > charSweepPwm(j + 1))
+    j++;
+  // linear between the sweep points
+  int lo = rpm[j] << 5;
+  int hi = rpm[j + 1] << 5;
+  return lo + (long)(hi - lo) * (pwm - charSweepPwm(j)) / charSweepStep;
+}
+
+void FanChar::dumpStats(Print &out, char buf[], short int i)
+{
+  if(i >= fans())
+    return;
+  const FanCharState &s = m_fans[i];
+  sprintf_P(buf, PSTR("Fan%d char: %S"), (int)i, g_testResults[s.result]);
+  out.print(buf);
+  if(s.result == testRunning)
+  {
+    sprintf_P(buf, PSTR(" in phase %d at PWM=%d"), (int)s.phase, (int)s.pwm);
+    out.print(buf);
+  }
+  sprintf_P(buf, PSTR(", spin=%d start=%d, RPM/32"), (int)s.pwmSpin, (int)s.pwmStart);
+  out.print(buf);
+  for(byte j = 0; j < configRpmPoints; j++)
+  {
+    sprintf_P(buf, PSTR("%c%d"), (j == 0) ? '=' : ',', (int)s.rpm[j]);
+    out.print(buf);
+  }
+  out.println();
+}
@@ -0,0 +1,127 @@
+/**
+ * On demand fan characterization, runs in the background like FanTest.
+ *
+ * Every fan with a tach is taken over, see Fan::override(), and:
+ *  - swept from the max PWM down over configRpmPoints duties, the settled
+ *    RPM at each is recorded, until it stalls,
+ *  - the lowest PWM it keeps spinning at is binary searched for between the
+ *    stall duty and the one above it: spin it up at the upper end, drop to
+ *    the middle and see if the RPM settles or decays,
+ *  - the lowest PWM it starts at from stop is binary searched for between
+ *    that and the max: stop it, apply the middle and see if it starts.
+ * The fans are characterized in parallel.  The results plus charMargin are
+ * saved in g_config as the fan own min and start PWMs, see Channel, along
+ * with the PWM to RPM curve.
+ */
+#pragma once
+
+/** phases, per fan */
+const byte charPhaseIdle = 0;
+const byte charPhaseSweep = 1;
+/** kick it to get it spinning */
+const byte charPhaseKick = 2;
+/** settle at the upper end of the min spin PWM bracket */
+const byte charPhasePrime = 3;
+/** does it keep spinning at this PWM? */
+const byte charPhaseSpin = 4;
+const byte charPhaseStop = 5;
+/** does it start at this PWM? */
+const byte charPhaseStart = 6;
+
+/** how often the tachs are looked at, ms */
+const unsigned long charPeriod = 100;
+/** give up waiting for the RPM to settle or for the fan to stop after this long, ms */
+const unsigned long charSettleMaxMs = 8000;
+/** a fan has to keep spinning for this long, a stalled one is stopped by then, ms */
+const unsigned long charSpinMs = 5000;
+/** a stopped fan has to start within this, ms */
+const unsigned long charStartMaxMs = 3000;
+/** RPM is stable when it changed by less than 1/32 over this many periods */
+const byte charSettlePeriods = 5;
+/** added to the PWMs found before they are saved */
+const byte charMargin = 5;
+
+/** PWM between the sweep points */
+const unsigned short charSweepStep = Fan::pwmLimit / configRpmPoints;
+/** duty of the sweep point i, the last one is the max */
+inline unsigned short charSweepPwm(byte i)
+{
+  return Fan::pwmLimit - (configRpmPoints - 1 - i) * charSweepStep;
+}
+
+struct FanCharState
+{
+  byte phase;
+  /** testXXX, see FanTest.h */
+  byte result;
+  /** PWM it is driven at */
+  unsigned short pwm;
+  /** binary search bracket: fails at lo, works at hi */
+  unsigned short lo;
+  unsigned short hi;
+  /** sweep point */
+  byte point;
+  /** what was found */
+  unsigned short pwmSpin;
+  unsigned short pwmStart;
+  /** RPM / 32 at the sweep points */
+  byte rpm[configRpmPoints];
+  /** nowMillis() at the start of the phase */
+  unsigned long ulPhaseStart;
+  /** last RPMs, ring buffer */
+  unsigned int samples[charSettlePeriods];
+  byte head;
+  /** # of samples taken in this phase */
+  byte count;
+};
+
+class FanChar
+{
+public:
+  /** start characterizing, the fans are taken over */
+  void begin();
+  /** stop it, the fans are given back, nothing is saved */
+  void abort();
+  /** the characterization task body, once per charPeriod */
+  void run();
+  /** testXXX for all the fans */
+  byte getResult()
+  {
+    return m_result;
+  }
+  bool isRunning()
+  {
+    return m_result == testRunning;
+  }
+  /** how long the last one took, ms */
+  unsigned long getDuration()
+  {
+    return m_ulDuration;
+  }
+  /** print results of fan i */
+  void dumpStats(Print &out, char buf[], short int i);
+
+private:
+  byte m_result = testNone;
+  unsigned long m_ulStart = 0;
+  unsigned long m_ulDuration = 0;
+  FanCharState m_fans[configFans];
+
+  /** # of fans characterized */
+  short int fans();
+  /** advance fan i state machine */
+  void run(short int i);
+  void startPhase(short int i, byte phase, unsigned short pwm);
+  /** next step of the min spin PWM search */
+  void searchSpin(short int i);
+  /** next step of the min start PWM search */
+  void searchStart(short int i);
+  void finish(short int i, byte result);
+  /** RPM settled? */
+  bool isStable(FanCharState &s, unsigned int rpm);
+  void end();
+};
+
+extern FanChar g_fanChar;
+/** RPM fan i does at this pwm by its saved characterization, 0 if unknown */
+unsigned int charRpm(short int i, unsigned short pwm);
@@ -7,12 +7,31 @@
 #include "Trace.h"
 #include "Fan.h"
 #include "SerialCommand.h"
+#include "BinaryCommand.h"
+#include "Attribute.h"
+#include "Telemetry.h"
+#include "TxQueue.h"
+#include "FanTest.h"
+#include "Config.h"
+#include "FanChar.h"
+#include "StallMonitor.h"
+#include "TempInput.h"
+#include "Curve.h"
 #include "Led.h"
+#include "AdcSampler.h"
 #include "LM35.h"
 #include "pcb.h"
 #include "OperationalMode.h"
+#include "Channel.h"
+#include "Scheduler.h"
+#include "Usart.h"
+#include "Profiler.h"
+#include "Recorder.h"
+#include "IdleSleep.h"
 
 
+void onCommandUnrecognized(const char *command);
+
 /** LM35 temperature sensor is connected to this pin */
 LM35 g_lm35(pinLM35);
 
@@ -34,37 +53,6 @@ Led g_led(pinLed);
   g_uiCounter++;
 }*/
 
-/**
- * analogRead wrapper with better precision
- */
-unsigned int myAnalogRead(short int pin)
-{
-  // first sample seems to fluctuate a lot. Disregard it
-  {
-    unsigned int intmp = analogRead(pin);
-    //Serial.println(intmp);
-    myDelay(60);
-  }
-  // according to http://www.atmel.com/dyn/resources/prod_documents/doc8003.pdf
-  // 11 bit virtual resolution arduino ADC is 10 bit real resolution
-  // for 12 bit resolution 16 samples and >> 4 is needed
-  unsigned int reading = 0; // accumulate samples here
-  for(int i=0; i<=3; i++)
-  {
-    unsigned int intmp = analogRead(pin);
-    reading = reading + intmp;
-    //Serial.println(intmp);
-    delay(60);
-  }
-  reading = reading>>2; // averaged over 4 samples
-  /*
-  unsigned int reading = analogRead(pin);
-  Serial.print("analogRead() => ");
-  Serial.println(reading);
-  */
-  return reading;
-}
-
 /**
  * This works on Arduinos with a 328 or 168 only
  * https://code.google.com/archive/p/tinkerit/wikis/SecretVoltmeter.wiki
@@ -109,89 +97,762 @@ unsigned int myAnalogRead(short int pin)
 }*/
 
 
+/** longest stats line, incl. the queue overhead */
+const int statsLineMax = 100;
+/** where the stats dump in progress goes, 0 if none */
+static TxChannel *g_pStatsOut = 0;
+/** next section of it */
+static byte g_statsSection = 0;
+
+/** first of the task sections */
+static byte statsSectionTasks()
+{
+  return 5 + 4 * fansCount() + tempInputsMax;
+}
+#ifdef PROFILER
+/** first of the profiler sections, the last ones */
+static byte statsSectionProf()
+{
+  return statsSectionTasks() + taskCount + 3;
+}
+#endif
+
+/**
+ * Print a line or so of the statistics, false if there is no such section
+ */
+static bool dumpStatsSection(Print &out, byte section, char buf[])
+{
+  byte fans = fansCount();
+  byte tasks = statsSectionTasks();
+  if(section == 0)
+  {
+    //sprintf(buf, "Vcc=%ld mV, temp=%ld,", readVcc(), readTemp());
+    //out.println(buf);
+    sprintf_P(buf, PSTR("Settings: tempMin=%d, tempMax=%d, pwmMin=%d, pwmStart=%d, pwmMax=%d"), 
+      (int)g_config.tempMin, (int)g_config.tempMax, (int)g_config.pwmMin, (int)g_config.pwmStart, (int)g_config.pwmMax);
+    out.println(buf);
+  }
+  else if(section == 1)
+  {
+    g_configStore.dumpStats(out, buf);
+  }
+  else if(section == 2)
+  {
+    int temp = (int)g_lm35.read();
+    sprintf_P(buf, PSTR("Observed: g_tempMin=%d, g_tempMax=%d, temp=%d"), (int)LM35::g_tempMin, (int)LM35::g_tempMax, temp);
+    out.println(buf);
+  }
+  else if(section == 3)
+  {
+    sprintf_P(buf, PSTR("Now=%lums"), nowMillis());
+    out.println(buf);
+  }
+  else if(section < 4 + fans)
+  {
+    fansDumpStats(out, buf, section - 4);
+  }
+  else if(section < 4 + 2 * fans)
+  {
+    g_fanTest.dumpStats(out, buf, section - 4 - fans);
+  }
+  else if(section < 4 + 3 * fans)
+  {
+    g_fanChar.dumpStats(out, buf, section - 4 - 2 * fans);
+  }
+  else if(section < 4 + 4 * fans)
+  {
+    g_stallMonitor.dumpStats(out, buf, section - 4 - 3 * fans);
+  }
+  else if(section == 4 + 4 * fans)
+  {
+    g_tempInputs.dumpStats(out, buf);
+  }
+  else if(section < tasks)
+  {
+    g_tempInputs.dumpStats(out, buf, section - 5 - 4 * fans);
+  }
+  else if(section < tasks + taskCount)
+  {
+    g_scheduler.dumpStats(out, buf, section - tasks);
+  }
+  else if(section == tasks + taskCount)
+  {
+    g_usart.dumpStats(out, buf);
+  }
+  else if(section == tasks + taskCount + 1)
+  {
+    sprintf_P(buf, PSTR("Tx dropped: response=%lu, telemetry=%lu, debug=%lu bytes"), 
+      g_txResponse.getDroppedBytes(), g_txTelemetry.getDroppedBytes(), g_txDebug.getDroppedBytes());
+    out.println(buf);
+  }
+  else if(section == tasks + taskCount + 2)
+  {
+    g_idleSleep.dumpStats(out, buf);
+  }
+#ifdef PROFILER
+  else if(section < statsSectionProf() + 2 * profCount)
+  {
+    g_profiler.dumpStats(out, buf, section - statsSectionProf());
+  }
+#endif
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
 /**
  * Dump some statistics so that we can see how the controller and environment are doing...
+ * This only starts the dump, dumpStatsMore() prints it as the output queue drains.
+ * The dump starts from this section.
  */
-void dumpStats()
+void dumpStats(TxChannel &out, byte section = 0)
+{
+  g_pStatsOut = &out;
+  g_statsSection = section;
+}
+
+/** print as much of the stats dump in progress as the queue takes */
+static void dumpStatsMore()
 {
+  PROF_SCOPE(profStats);
   char buf[80];
-  //sprintf(buf, "Vcc=%ld mV, temp=%ld,", readVcc(), readTemp());
-  //Serial.println(buf);
-  sprintf(buf, "Settings: tempMin=%d, tempMax=%d,", (int)OpMode::tempMin, (int)OpMode::tempMax);
-  Serial.println(buf);
-  int temp = (int)g_lm35.read();
-  sprintf(buf, "Observed: g_tempMin=%d, g_tempMax=%d, temp=%d", (int)LM35::g_tempMin, (int)LM35::g_tempMax, temp);
-  Serial.println(buf);
-  fansDumpStats(buf);
+  while(g_pStatsOut != 0 && g_pStatsOut->availableForWrite() >= statsLineMax)
+  {
+    if(!dumpStatsSection(*g_pStatsOut, g_statsSection++, buf))
+      g_pStatsOut = 0;
+  }
+}
+
+/** called from the RX ISR, the request may not switch the protocol until dispatched */
+static bool parseSerial(byte b)
+{
+  return g_bc.isActive() ? g_bc.parse(b) : g_sc.parse(b);
 }
 
 /**
- * Dump some statistics if it is a right time.
+ * Task bodies
  */
-void dumpStatsMaybe(unsigned long now)
-{
-  /** how often to dump stats */
-  const unsigned long ulStatsDumpPeriod = 3*1000;
-  /** when we dumped stats last */
-  static unsigned long g_ulToDumpStats = 0;
-  // the following will handle rollover just fine!
-  if(now > g_ulToDumpStats)
+/** respond to the serial request the RX ISR has put together, see Usart.h */
+static void runSerial()
+{
+  while(g_usart.isHeld())
   {
-    g_ulToDumpStats = now + ulStatsDumpPeriod;
-    dumpStats();
+    PROF_SCOPE(profSerial);
+    if(g_bc.isActive())
+      g_bc.dispatch();
+    else
+      g_sc.dispatch();
+    g_usart.release();
   }
+  dumpStatsMore();
+  g_recorder.dumpMore();
+}
+/** keep track of observed temperatures, sample the analog inputs for the next time */
+static void runSensors()
+{
+  PROF_SCOPE(profSensors);
+  g_lm35.read();
+  g_adc.sample();
+}
+/** opmode specific work, e.g. spinning the fans according to the temperature, all channels */
+static void runControl()
+{
+  PROF_SCOPE(profControl);
+  channelsControl();
+}
+/** stream telemetry records, runs only when the host asked for it */
+static void runTelemetry()
+{
+  g_telemetry.send();
+}
+/** background fans test, runs only while it is in progress */
+static void runFanTest()
+{
+  g_fanTest.run();
+}
+/** fans characterization, runs only while it is in progress */
+static void runFanChar()
+{
+  g_fanChar.run();
+}
+/** watch the fans for stalls */
+static void runStall()
+{
+  g_stallMonitor.run();
+}
+/** write the config back to EEPROM, runs only when it was changed */
+static void runConfig()
+{
+  g_configStore.run();
+}
+/** sample for the black box */
+static void runRecorder()
+{
+  g_recorder.run();
 }
+/** periodically dump stats */
+static void runStats()
+{
+  // binary host polls for what it needs
+  if(!g_bc.isActive())
+    dumpStats(g_txTelemetry);
+}
+
+/** task names, in flash */
+static const char g_taskNames[taskCount][10] PROGMEM = {
+  "serial", "sensors", "control", "stats", "telemetry",
+  "fantest", "config", "fanchar", "stall", "recorder"
+};
+/**
+ * The task table, indexed by taskXXX.
+ * name, function, period ms, deadline ms, priority.
+ * Control period is set by the channels opmodes, see Channel::setOpMode(),
+ * telemetry one by the host, see Telemetry::setPeriod(), fantest one by
+ * FanTest::begin(), fanchar one by FanChar::begin(), config one by
+ * ConfigStore::changed()
+ */
+Task g_tasks[taskCount] = {
+  {g_taskNames[taskSerial],    runSerial,    10,        20,   2},
+  {g_taskNames[taskSensors],   runSensors,   250,       250,  3},
+  {g_taskNames[taskControl],   runControl,   1000,      100,  4},
+  {g_taskNames[taskStats],     runStats,     3000,      1000, 1},
+  {g_taskNames[taskTelemetry], runTelemetry, 0,         20,   1},
+  {g_taskNames[taskFanTest],   runFanTest,   0,         100,  2},
+  {g_taskNames[taskConfig],    runConfig,    0,         100,  1},
+  {g_taskNames[taskFanChar],   runFanChar,   0,         100,  2},
+  {g_taskNames[taskStall],     runStall,     100,       100,  3},
+  {g_taskNames[taskRecorder],  runRecorder,  recPeriod, 1000, 1},
+};
+Scheduler g_scheduler(g_tasks, taskCount);
 
 /**
- * gettable vars:
- *   OPMODE - current opmode
- *   FAN - fan speed in pwm
- *   TEMP - C reading of the internal temp sensor
+ * Attribute accessors
+ */
+static long getOpMode()
+{
+  return g_channels[0].getOpModeId();
+}
+static bool setOpMode(long value)
+{
+  return channelsSetOpMode(value);
+}
+static long getCharacterize()
+{
+  return g_fanChar.getResult();
+}
+/** the fans can't be characterized and tested at the same time */
+static bool setCharacterize(long value)
+{
+  if(value == 0)
+    g_fanChar.abort();
+  else if(g_fanTest.getResult() == testRunning)
+    return false;
+  else
+    g_fanChar.begin();
+  return true;
+}
+static long getConfig()
+{
+  return g_configStore.getSeq();
+}
+static bool setConfig(long value)
+{
+  if(value == 0)
+  {
+    g_configStore.reset();
+    curveUpdateRamp();
+  }
+  else
+  {
+    g_configStore.save();
+  }
+  return true;
+}
+static long getFan()
+{
+  return g_fan[0].getPWM();
+}
+/** the channels not in a mode which takes it refuse it */
+static bool setFan(long value)
+{
+  bool bRes = false;
+  for(short int i = 0; i < channelsCount(); i++)
+    bRes = g_channels[i].setFan(value) || bRes;
+  return bRes;
+}
+template<short int i> static long getFanCurve()
+{
+  return g_config.curve[i];
+}
+template<short int i> static bool setFanCurve(long value)
+{
+  if(i >= fansCount())
+    return false;
+  g_config.curve[i] = value;
+  g_configStore.changed();
+  return true;
+}
+template<short int i> static long getFanOpMode()
+{
+  return (i < channelsCount()) ? g_channels[i].getOpModeId() : 0;
+}
+template<short int i> static bool setFanOpMode(long value)
+{
+  return (i < channelsCount()) && g_channels[i].setOpMode(value);
+}
+template<short int i> static long getFanPwm()
+{
+  return (i < channelsCount()) ? g_fan[i].getPWM() : 0;
+}
+template<short int i> static bool setFanPwm(long value)
+{
+  return (i < channelsCount()) && g_channels[i].setFan(value);
+}
+/**
+ * min <= start <= max, globally and for every fan, whose own min and start
+ * are the global ones if 0
+ */
+static bool pwmLimitsValid()
+{
+  if(g_config.pwmMin > g_config.pwmStart || g_config.pwmStart > g_config.pwmMax)
+    return false;
+  for(short int i = 0; i < fansCount(); i++)
+  {
+    Channel &ch = g_channels[i];
+    if(ch.getPwmMin() > ch.getPwmStart() || ch.getPwmStart() > g_config.pwmMax)
+      return false;
+  }
+  return true;
+}
+/** set one of the PWM limits above unless that makes them invalid */
+static bool setPwmLimit(unsigned short &pwm, long value)
+{
+  unsigned short prev = pwm;
+  pwm = value;
+  if(!pwmLimitsValid())
+  {
+    pwm = prev;
+    return false;
+  }
+  g_configStore.changed();
+  return true;
+}
+template<short int i> static long getFanPwmMin()
+{
+  return g_config.fanPwmMin[i];
+}
+template<short int i> static bool setFanPwmMin(long value)
+{
+  return (i < fansCount()) && setPwmLimit(g_config.fanPwmMin[i], value);
+}
+template<short int i> static long getFanPwmStart()
+{
+  return g_config.fanPwmStart[i];
+}
+template<short int i> static bool setFanPwmStart(long value)
+{
+  return (i < fansCount()) && setPwmLimit(g_config.fanPwmStart[i], value);
+}
+template<short int i> static long getFanTemp()
+{
+  return (i < channelsCount()) ? g_channels[i].getTemp() : 0;
+}
+template<short int i> static bool setFanTemp(long value)
+{
+  return (i < channelsCount()) && g_channels[i].setTemp(value);
+}
+template<short int i> static long getFanRPM()
+{
+  return (i < fansCount()) ? g_fan[i].getRPM() : 0;
+}
+static long getOpModeBoot()
+{
+  return g_config.opMode;
+}
+static bool setOpModeBoot(long value)
+{
+  g_config.opMode = value;
+  g_configStore.changed();
+  return true;
+}
+static long getFusion()
+{
+  return g_tempInputs.getMode();
+}
+static bool setFusion(long value)
+{
+  g_tempInputs.setMode(value);
+  return true;
+}
+static long getCmdLatency()
+{
+  return g_usart.getLatencyMax();
+}
+static long getBlackBox()
+{
+  return g_recorder.getState();
+}
+static bool setBlackBox(long value)
+{
+  g_recorder.rearm();
+  return true;
+}
+static long getLogMask()
+{
+  return g_logMask;
+}
+static bool setLogMask(long value)
+{
+  g_logMask = value;
+  return true;
+}
+static long getFrameErrors()
+{
+  return g_bc.getErrors();
+}
+static long getPidKp()
+{
+  return g_thePidTemperatureMode.getPid().kp;
+}
+static bool setPidKp(long value)
+{
+  g_thePidTemperatureMode.getPid().kp = value;
+  return true;
+}
+static long getPidKi()
+{
+  return g_thePidTemperatureMode.getPid().ki;
+}
+static bool setPidKi(long value)
+{
+  g_thePidTemperatureMode.getPid().ki = value;
+  return true;
+}
+static long getPidKd()
+{
+  return g_thePidTemperatureMode.getPid().kd;
+}
+static bool setPidKd(long value)
+{
+  g_thePidTemperatureMode.getPid().kd = value;
+  return true;
+}
+static long getPidSetpoint()
+{
+  return g_thePidTemperatureMode.getSetpoint();
+}
+static bool setPidSetpoint(long value)
+{
+  g_thePidTemperatureMode.setSetpoint(value);
+  return true;
+}
+static long getPwmMax()
+{
+  return g_config.pwmMax;
+}
+static bool setPwmMax(long value)
+{
+  if(!setPwmLimit(g_config.pwmMax, value))
+    return false;
+  curveUpdateRamp();
+  return true;
+}
+static long getPwmMin()
+{
+  return g_config.pwmMin;
+}
+static bool setPwmMin(long value)
+{
+  if(!setPwmLimit(g_config.pwmMin, value))
+    return false;
+  curveUpdateRamp();
+  return true;
+}
+static long getPwmStart()
+{
+  return g_config.pwmStart;
+}
+static bool setPwmStart(long value)
+{
+  return setPwmLimit(g_config.pwmStart, value);
+}
+static long getProtocol()
+{
+  return g_bc.isActive() ? 1 : 0;
+}
+static bool setProtocol(long value)
+{
+  if(value == 1)
+    g_bc.begin();
+  else
+    g_bc.end();
+  return true;
+}
+static long getSelfTest()
+{
+  return g_fanTest.getResult();
+}
+static bool setSelfTest(long value)
+{
+  if(value == 0)
+    g_fanTest.abort();
+  else if(g_fanChar.isRunning())
+    return false;
+  else
+    g_fanTest.begin();
+  return true;
+}
+static long getSelfTestFailed()
+{
+  return g_fanTest.getFailed();
+}
+static long getStallAlarms()
+{
+  return g_stallMonitor.getAlarms();
+}
+static long getStallLatency()
+{
+  return g_stallMonitor.getLatencyMax();
+}
+static long getStalls()
+{
+  return g_stallMonitor.getStalls();
+}
+static long getTelemetryChannels()
+{
+  return g_telemetry.getChannels();
+}
+static bool setTelemetryChannels(long value)
+{
+  g_telemetry.setChannels(value);
+  return true;
+}
+static long getTelemetryDrops()
+{
+  return g_telemetry.getDrops();
+}
+static long getTelemetryPeriod()
+{
+  return g_telemetry.getPeriod();
+}
+static bool setTelemetryPeriod(long value)
+{
+  return g_telemetry.setPeriod(value);
+}
+static long getTemp()
+{
+  return g_channels[0].getTemp();
+}
+/** the channels not in a mode which takes it refuse it */
+static bool setTemp(long value)
+{
+  bool bRes = false;
+  for(short int i = 0; i < channelsCount(); i++)
+    bRes = g_channels[i].setTemp(value) || bRes;
+  return bRes;
+}
+static long getTempInputs()
+{
+  return g_tempInputs.getFresh();
+}
+static long getTempStale()
+{
+  return g_tempInputs.getStaleMs();
+}
+static bool setTempStale(long value)
+{
+  g_tempInputs.setStaleMs(value);
+  return true;
+}
+static long getTempLM35()
+{
+  return g_lm35.readDeci();
+}
+static long getTempSetpointMax()
+{
+  return g_config.tempMax;
+}
+static bool setTempSetpointMax(long value)
+{
+  if(value <= g_config.tempMin)
+    return false;
+  g_config.tempMax = value;
+  g_configStore.changed();
+  curveUpdateRamp();
+  return true;
+}
+static long getTempSetpointMin()
+{
+  return g_config.tempMin;
+}
+static bool setTempSetpointMin(long value)
+{
+  if(value >= g_config.tempMax)
+    return false;
+  g_config.tempMin = value;
+  g_configStore.changed();
+  curveUpdateRamp();
+  return true;
+}
+static long getTxDropsDebug()
+{
+  return g_txDebug.getDroppedBytes();
+}
+static long getTxDropsResponse()
+{
+  return g_txResponse.getDroppedBytes();
+}
+static long getTxDropsTelemetry()
+{
+  return g_txTelemetry.getDroppedBytes();
+}
+static long getUptime()
+{
+  return nowMillis();
+}
+
+/**
+ * GET/SET attributes, sorted by name.
+ * name, ID, SET min, SET max, getter, setter or 0 if read only.
+ * Setters of what is in g_config have it saved, see Config.h, those of the
+ * ramp - TEMP_SETPOINT_XXX, PWM_MIN, PWM_MAX - reload it into the RAM curve.
+ *   BLACKBOX - black box state, see Recorder.h, 0 to re-arm it
+ *   CHARACTERIZE - fans characterization result, see FanChar.h, 1 to run it,
+ *                  0 to abort it
+ *   CMD_LATENCY - max us from a serial request received to it done
+ *   CONFIG - sequence # of the config saved in EEPROM, 1 to save it now,
+ *            0 to go back to the defaults
+ *   FAN - fan speed in pwm, SET goes to all the channels, see Channel.h
+ *   FANn_CURVE - fan n curve, see Curve.h
+ *   FANn_OPMODE, FANn_PWM, FANn_TEMP - same as OPMODE, FAN, TEMP for channel n only
+ *   FANn_PWM_MIN, FANn_PWM_START - fan n own PWM_MIN, PWM_START, 0 to use those,
+ *                                  set by CHARACTERIZE
+ *   FANn_RPM - fan n RPM
+ *   FRAME_ERRORS - frames dropped by the binary protocol
+ *   FUSION - how the temperature inputs are combined, see TempInput.h
+ *   LOG_MASK - bit mask of the modules logging, see Trace.h
+ *   OPMODE - current opmode, SET switches all the channels
+ *   OPMODE_BOOT - opmode to boot into
+ *   PID_KP, PID_KI, PID_KD - PID gains, Q8.8
+ *   PID_SETPOINT - temperature PID opmode keeps
+ *   PROTOCOL - 1 to switch to the binary protocol, see BinaryCommand.h
+ *   PWM_MIN, PWM_START, PWM_MAX - fan PWMs to use: to keep spinning, to start, max
+ *   SELFTEST - fans test result, testXXX in FanTest.h, 1 to run it again, 0 to abort it
+ *   SELFTEST_FAILED - bit mask of the fans which failed it
+ *   STALLS - # of fan stalls detected, see StallMonitor.h
+ *   STALL_ALARMS - bit mask of the fans stalled
+ *   STALL_LATENCY - max stall detection latency, ms
+ *   TELEMETRY_CHANNELS - what to stream, see Telemetry.h
+ *   TELEMETRY_DROPS - records dropped because the link was busy
+ *   TELEMETRY_PERIOD - ms between the records, 0 to stop streaming
+ *   TEMP - C temperature the opmode works with, settable in the external one,
+ *          SET goes to all the channels
+ *   TEMP_INPUTS - # of fresh temperature inputs
+ *   TEMP_LM35 - LM35 reading in tenths of C
  *   TEMP_SETPOINT_MIN - when to start fan
  *   TEMP_SETPOINT_MAX - when to blow fan at full speed
+ *   TEMP_STALE - ms after which temperature input readings are ignored
+ *   TX_DROPS_RESPONSE, TX_DROPS_TELEMETRY, TX_DROPS_DEBUG - output bytes dropped
+ *   UPTIME - ms since boot
+ */
+constexpr Attribute g_attributes[] PROGMEM = {
+  {"BLACKBOX",           attrBlackBox,          0,           0,              getBlackBox,          setBlackBox},
+  {"CHARACTERIZE",       attrCharacterize,      0,           1,              getCharacterize,      setCharacterize},
+  {"CMD_LATENCY",        attrCmdLatency,        0,           0,              getCmdLatency,        0},
+  {"CONFIG",             attrConfig,            0,           1,              getConfig,            setConfig},
+  {"FAN",                attrFan,               0,           Fan::pwmLimit,  getFan,               setFan},
+  {"FAN1_CURVE",         attrFanCurve,          0,           curveCount - 1, getFanCurve<0>,       setFanCurve<0>},
+  {"FAN1_OPMODE",        attrFanOpMode,         opModeFirst, opModeLast,     getFanOpMode<0>,      setFanOpMode<0>},
+  {"FAN1_PWM",           attrFanPwm,            0,           Fan::pwmLimit,  getFanPwm<0>,         setFanPwm<0>},
+  {"FAN1_PWM_MIN",       attrFanPwmMin,         0,           Fan::pwmLimit,  getFanPwmMin<0>,      setFanPwmMin<0>},
+  {"FAN1_PWM_START",     attrFanPwmStart,       0,           Fan::pwmLimit,  getFanPwmStart<0>,    setFanPwmStart<0>},
+  {"FAN1_RPM",           attrFanRPM,            0,           0,              getFanRPM<0>,         0},
+  {"FAN1_TEMP",          attrFanTemp,           0,           150,            getFanTemp<0>,        setFanTemp<0>},
+  {"FAN2_CURVE",         attrFanCurve + 1,      0,           curveCount - 1, getFanCurve<1>,       setFanCurve<1>},
+  {"FAN2_OPMODE",        attrFanOpMode + 1,     opModeFirst, opModeLast,     getFanOpMode<1>,      setFanOpMode<1>},
+  {"FAN2_PWM",           attrFanPwm + 1,        0,           Fan::pwmLimit,  getFanPwm<1>,         setFanPwm<1>},
+  {"FAN2_PWM_MIN",       attrFanPwmMin + 1,     0,           Fan::pwmLimit,  getFanPwmMin<1>,      setFanPwmMin<1>},
+  {"FAN2_PWM_START",     attrFanPwmStart + 1,   0,           Fan::pwmLimit,  getFanPwmStart<1>,    setFanPwmStart<1>},
+  {"FAN2_RPM",           attrFanRPM + 1,        0,           0,              getFanRPM<1>,         0},
+  {"FAN2_TEMP",          attrFanTemp + 1,       0,           150,            getFanTemp<1>,        setFanTemp<1>},
+  {"FAN3_CURVE",         attrFanCurve + 2,      0,           curveCount - 1, getFanCurve<2>,       setFanCurve<2>},
+  {"FAN3_OPMODE",        attrFanOpMode + 2,     opModeFirst, opModeLast,     getFanOpMode<2>,      setFanOpMode<2>},
+  {"FAN3_PWM",           attrFanPwm + 2,        0,           Fan::pwmLimit,  getFanPwm<2>,         setFanPwm<2>},
+  {"FAN3_PWM_MIN",       attrFanPwmMin + 2,     0,           Fan::pwmLimit,  getFanPwmMin<2>,      setFanPwmMin<2>},
+  {"FAN3_PWM_START",     attrFanPwmStart + 2,   0,           Fan::pwmLimit,  getFanPwmStart<2>,    setFanPwmStart<2>},
+  {"FAN3_RPM",           attrFanRPM + 2,        0,           0,              getFanRPM<2>,         0},
+  {"FAN3_TEMP",          attrFanTemp + 2,       0,           150,            getFanTemp<2>,        setFanTemp<2>},
+  {"FRAME_ERRORS",       attrFrameErrors,       0,           0,              getFrameErrors,       0},
+  {"FUSION",             attrFusion,            fuseMax,     fuseChannel,    getFusion,            setFusion},
+  {"LOG_MASK",           attrLogMask,           0,           logModulesAll,  getLogMask,           setLogMask},
+  {"OPMODE",             attrOpMode,            opModeFirst, opModeLast,     getOpMode,            setOpMode},
+  {"OPMODE_BOOT",        attrOpModeBoot,        opModeFirst, opModeLast,     getOpModeBoot,        setOpModeBoot},
+  {"PID_KD",             attrPidKd,             0,           32767,          getPidKd,             setPidKd},
+  {"PID_KI",             attrPidKi,             0,           32767,          getPidKi,             setPidKi},
+  {"PID_KP",             attrPidKp,             0,           32767,          getPidKp,             setPidKp},
+  {"PID_SETPOINT",       attrPidSetpoint,       0,           100,            getPidSetpoint,       setPidSetpoint},
+  {"PROTOCOL",           attrProtocol,          0,           1,              getProtocol,          setProtocol},
+  {"PWM_MAX",            attrPwmMax,            1,           Fan::pwmLimit,  getPwmMax,            setPwmMax},
+  {"PWM_MIN",            attrPwmMin,            1,           Fan::pwmLimit,  getPwmMin,            setPwmMin},
+  {"PWM_START",          attrPwmStart,          1,           Fan::pwmLimit,  getPwmStart,          setPwmStart},
+  {"SELFTEST",           attrSelfTest,          0,           1,              getSelfTest,          setSelfTest},
+  {"SELFTEST_FAILED",    attrSelfTestFailed,    0,           0,              getSelfTestFailed,    0},
+  {"STALLS",             attrStalls,            0,           0,              getStalls,            0},
+  {"STALL_ALARMS",       attrStallAlarms,       0,           0,              getStallAlarms,       0},
+  {"STALL_LATENCY",      attrStallLatency,      0,           0,              getStallLatency,      0},
+  {"TELEMETRY_CHANNELS", attrTelemetryChannels, 0,           telAll,         getTelemetryChannels, setTelemetryChannels},
+  {"TELEMETRY_DROPS",    attrTelemetryDrops,    0,           0,              getTelemetryDrops,    0},
+  {"TELEMETRY_PERIOD",   attrTelemetryPeriod,   0,           telPeriodMax,   getTelemetryPeriod,   setTelemetryPeriod},
+  {"TEMP",               attrTemp,              0,           150,            getTemp,              setTemp},
+  {"TEMP_INPUTS",        attrTempInputs,        0,           0,              getTempInputs,        0},
+  {"TEMP_LM35",          attrTempLM35,          0,           0,              getTempLM35,          0},
+  {"TEMP_SETPOINT_MAX",  attrTempSetpointMax,   0,           curveTemps - 1, getTempSetpointMax,   setTempSetpointMax},
+  {"TEMP_SETPOINT_MIN",  attrTempSetpointMin,   0,           curveTemps - 1, getTempSetpointMin,   setTempSetpointMin},
+  {"TEMP_STALE",         attrTempStale,         100,         3600000L,       getTempStale,         setTempStale},
+  {"TX_DROPS_DEBUG",     attrTxDropsDebug,      0,           0,              getTxDropsDebug,      0},
+  {"TX_DROPS_RESPONSE",  attrTxDropsResponse,   0,           0,              getTxDropsResponse,   0},
+  {"TX_DROPS_TELEMETRY", attrTxDropsTelemetry,  0,           0,              getTxDropsTelemetry,  0},
+  {"UPTIME",             attrUptime,            0,           0,              getUptime,            0},
+};
+const byte g_attributeCount = sizeof(g_attributes) / sizeof(g_attributes[0]);
+static_assert(attributesSorted(g_attributes, sizeof(g_attributes) / sizeof(g_attributes[0])), "g_attributes must be sorted by name");
+static_assert(attributeIdsUnique(g_attributes, sizeof(g_attributes) / sizeof(g_attributes[0])), "g_attributes IDs must be unique");
+const byte g_attributeById[attrIdCount] PROGMEM = ATTRIBUTE_ID_INDEX(g_attributes);
+
+/**
+ * GET attribute, prints its value
  */
 void onCommandGet() 
 {
   char *arg = g_sc.next();
   if(arg == 0)
     return;
-  DEBUG_PRINT("onCommandGet "); DEBUG_PRNTLN(arg);
-  if(arg[0] == 'F')
+  LOG_DEBUG(logSketch, "onCommandGet %s", arg);
+  if(strcmp_P(arg, PSTR("STATS")) == 0)
   {
-    // GET FAN handler
-    unsigned short pwmNow = fansGetPWM();
-    Serial.println(pwmNow);
-  } 
-  else if(arg[0] == 'O')
-  {
-    // GET OPMODE handler
-    unsigned short int opmode = g_pOpMode->getOpMode();  
-    Serial.println(opmode);
+    dumpStats(g_txResponse);
+    return;
   }
-  else if(arg[0] == 'T')
+#ifdef PROFILER
+  if(strcmp_P(arg, PSTR("PROF")) == 0)
   {
-    // GET TEMP handler
-    if(g_pOpMode != 0)
-      g_pOpMode->onCommandGetTemp();
+    dumpStats(g_txResponse, statsSectionProf());
+    return;
   }
-  else if(arg[0] == 'S')
+#endif
+  const Attribute *p = attributeFind(arg);
+  if(p == 0)
   {
-    // GET STATS handler
-    dumpStats();
-  }
-  else
-  {
-    onCommandUnrecognized(0);
+    onCommandUnrecognized(arg);
+    return;
   }
+  g_txResponse.println(attributeGet(p));
 }
 
 /**
- * settable vars:
- *   FAN - fan speed in pwm
- *   TEMP - C reading of the internal temp sensor
- *   TEMP_SETPOINT_MIN - when to start fan
- *   TEMP_SETPOINT_MAX - when to blow fan at full speed
- *   OPMODE
+ * SET attribute value
  * Argument is always numeric
  */
 void onCommandSet() 
@@ -202,76 +863,153 @@ void onCommandSet()
   char *arg1 = g_sc.next();
   if(arg1 == 0)
     return;
-  int iArg = atoi(arg1);
-  DEBUG_PRINT("onCommandSet "); DEBUG_PRNT(arg); DEBUG_PRINT(" "); DEBUG_PRNTLN(iArg);
-  if(arg[0] == 'F')
+  long lArg = atol(arg1);
+  LOG_DEBUG(logSketch, "onCommandSet %s %ld", arg, lArg);
+#ifdef PROFILER
+  if(strcmp_P(arg, PSTR("PROF")) == 0)
   {
-    // SET FAN handler
-    if(g_pOpMode != 0)
-      g_pOpMode->onCommandSetFan(iArg);
-  } 
-  else if(arg[0] == 'O')
+    g_profiler.reset();
+    return;
+  }
+#endif
+  const Attribute *p = attributeFind(arg);
+  if(p == 0)
   {
-    // SET OpMode handler
-    if(g_pOpMode != 0)
-      g_pOpMode->onCommandSetOpMode(iArg);
+    onCommandUnrecognized(arg);
+    return;
   }
-  else if(arg[0] == 'T')
+  byte res = attributeSet(p, lArg);
+  if(res != attrOk)
   {
-    // SET TEMP handler
-    if(g_pOpMode != 0)
-      g_pOpMode->onCommandSetTemp(iArg);
+    if(res == attrErrReadOnly)
+      LOG_WARN(logSketch, "Can't set %s - read only", arg);
+    else
+      LOG_WARN(logSketch, "Can't set %s - bad value", arg);
   }
-  else if(arg[0] == 'S')
+}
+/**
+ * CURVE temp pwm temp pwm ... loads the RAM fan curve, see Curve.h.
+ * With no points it goes back to the g_config ramp.
+ */
+void onCommandCurve()
+{
+  CurvePoint points[curvePointsMax];
+  byte n = 0;
+  char *arg;
+  while((arg = g_sc.next()) != 0)
   {
-    // GET STATS handler
-    dumpStats();
+    char *arg1 = g_sc.next();
+    if(arg1 == 0 || n >= curvePointsMax)
+    {
+      LOG_WARN(logSketch, "Can't load curve - bad points");
+      return;
+    }
+    // range checked before they are narrowed
+    long lTemp = atol(arg);
+    long lPwm = atol(arg1);
+    if(lTemp < 0 || lTemp >= curveTemps || lPwm < 0 || lPwm > fanPwmTop)
+    {
+      LOG_WARN(logSketch, "Can't load curve - bad points");
+      return;
+    }
+    points[n].temp = lTemp;
+    points[n].pwm = lPwm;
+    n++;
   }
-  else
+  if(n == 0)
+    curveLoadRamp();
+  else if(!curveLoad(points, n))
+    LOG_WARN(logSketch, "Can't load curve - bad points");
+}
+/**
+ * TEMPIN name temp [age] - reading of the named temperature input, taken
+ * age ms ago, see TempInput.h.  With no temp the input is dropped.
+ */
+void onCommandTempIn()
+{
+  char *name = g_sc.next();
+  if(name == 0)
+    return;
+  char *arg = g_sc.next();
+  if(arg == 0)
   {
-    onCommandUnrecognized(0);
+    g_tempInputs.remove(name);
+    return;
   }
+  char *arg1 = g_sc.next();
+  unsigned long ulAge = (arg1 == 0) ? 0 : atol(arg1);
+  if(!g_tempInputs.put(name, atoi(arg), ulAge))
+    LOG_WARN(logSketch, "Can't add temp input - name too long or no room");
+}
+/**
+ * TEMPCFG name weight channels - named temperature input weight in the
+ * mean and bit mask of the channels it drives, see TempInput.h
+ */
+void onCommandTempCfg()
+{
+  char *name = g_sc.next();
+  char *arg = g_sc.next();
+  char *arg1 = g_sc.next();
+  if(arg1 == 0)
+    return;
+  if(!g_tempInputs.configure(name, atoi(arg), atoi(arg1)))
+    LOG_WARN(logSketch, "No such temp input");
 }
 void onCommandStats()
 {
-  dumpStats();  
+  dumpStats(g_txResponse);  
+}
+/** BLACKBOX streams the black box ring, see Recorder.h */
+void onCommandBlackBox()
+{
+  g_recorder.dump(g_txResponse);
 }
+
 void onCommandUnrecognized(const char *command)
 {
-  //
-  DEBUG_PRINT("Unrecognized command: ");
-  if(command != 0)
-  {
-    DEBUG_PRNTLN(command);
-  }
-  else
-  {
-    DEBUG_PRINTLN("");
-  }
+  // a null command goes as an empty string
+  LOG_WARN(logSketch, "Unrecognized command: %s", command);
 }
 
 void setup() 
 {
-  Serial.begin(115200);
+  g_configStore.load();
+  curveLoadRamp();
+  g_usart.begin(115200, parseSerial);
   g_lm35.setup();
-  g_lm35.read();
+  g_pot.setup();
+  // from now on analog inputs are sampled in the background
+  g_adc.begin();
+  g_lm35.resetStats();
   g_led.setup();
   
   fansSetup();
 
   // Setup callbacks for SerialCommand commands
-  g_sc.addCommand("GET", onCommandGet);
-  g_sc.addCommand("SET", onCommandSet);
-  g_sc.addCommand("STATS", onCommandStats);
+  g_sc.addCommand(PSTR("GET"), onCommandGet);
+  g_sc.addCommand(PSTR("SET"), onCommandSet);
+  g_sc.addCommand(PSTR("STATS"), onCommandStats);
+  g_sc.addCommand(PSTR("BLACKBOX"), onCommandBlackBox);
+  g_sc.addCommand(PSTR("CURVE"), onCommandCurve);
+  g_sc.addCommand(PSTR("TEMPIN"), onCommandTempIn);
+  g_sc.addCommand(PSTR("TEMPCFG"), onCommandTempCfg);
   g_sc.addDefaultHandler(onCommandUnrecognized); 
+
+  g_scheduler.setup();
+  if(!channelsSetOpMode(g_config.opMode))
+    channelsSetOpMode(opModeInternallyMeasuredTemperature);
+  // the opmode is in control already, fans which are being tested just wait
+  g_fanTest.begin();
 }
 
 void loop() 
 {
-  if(g_pOpMode != 0)
-    g_pOpMode->loop();
-  dumpStatsMaybe(nowMillis());  
-  delay(1000);
+  g_scheduler.run();
+  {
+    PROF_SCOPE(profTx);
+    g_tx.pump();
+  }
+  g_idleSleep.run();
 }
 
 
@@ -0,0 +1,180 @@
+/**
+ * Background fan self-test, see FanTest.h
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Config.h"
+#include "Channel.h"
+#include "Scheduler.h"
+#include "FanTest.h"
+
+FanTest g_fanTest;
+
+short int FanTest::fans()
+{
+  short int n = fansCount();
+  return (n > testMaxFans) ? testMaxFans : n;
+}
+
+void FanTest::begin()
+{
+  LOG_INFO(logTest, "Fans test started");
+  m_ulStart = nowMillis();
+  m_result = testRunning;
+  for(short int i = 0; i < fans(); i++)
+  {
+    FanTestResult &r = m_fans[i];
+    r.result = g_fan[i].hasSensor() ? testRunning : testNoTach;
+    r.failedPhase = testPhaseIdle;
+    r.rpm[0] = r.rpm[1] = r.rpm[2] = 0;
+  }
+  startPhase(testPhaseStop);
+  g_scheduler.setPeriod(taskFanTest, testPeriod);
+}
+
+void FanTest::abort()
+{
+  if(m_phase == testPhaseIdle)
+    return;
+  LOG_INFO(logTest, "Fans test aborted");
+  m_result = testNone;
+  end();
+}
+
+void FanTest::end()
+{
+  m_phase = testPhaseIdle;
+  m_ulDuration = nowMillis() - m_ulStart;
+  for(short int i = 0; i < fans(); i++)
+    g_fan[i].release();
+  g_scheduler.setPeriod(taskFanTest, 0);
+}
+
+void FanTest::startPhase(byte phase)
+{
+  m_phase = phase;
+  m_ulPhaseStart = nowMillis();
+  m_samples = 0;
+  for(short int i = 0; i < fans(); i++)
+  {
+    if(m_fans[i].result != testRunning)
+      continue;
+    // fans may have their own min and start PWMs
+    Channel &ch = g_channels[i];
+    const unsigned short pwms[] = { 0, 0, ch.getPwmStart(), g_config.pwmMax, ch.getPwmMin() };
+    g_fan[i].override(pwms[phase]);
+  }
+}
+
+bool FanTest::isPhaseDone(short int i, unsigned int rpm)
+{
+  if(m_phase == testPhaseStop)
+    return (rpm == 0);
+  if(m_phase == testPhaseStart)
+  {
+    // spin-up is confirmed by two RPM readings in a row
+    byte prev = (m_head == 0) ? (testSettlePeriods - 1) : (m_head - 1);
+    return (rpm != 0 && m_samples > 0 && m_rpm[i][prev] != 0);
+  }
+  // stable?  compare with testSettlePeriods samples ago
+  if(m_samples < testSettlePeriods)
+    return false;
+  unsigned int then = m_rpm[i][m_head];
+  unsigned int delta = (rpm > then) ? (rpm - then) : (then - rpm);
+  return (delta <= (then >> 5));
+}
+
+void FanTest::run()
+{
+  if(m_phase == testPhaseIdle)
+    return;
+  bool bDone = true;
+  for(short int i = 0; i < fans(); i++)
+  {
+    if(m_fans[i].result != testRunning)
+      continue;
+    unsigned long rpm = g_fan[i].getRPM();
+    unsigned int uRpm = (rpm > 0xFFFF) ? 0xFFFF : (unsigned int)rpm;
+    if(!isPhaseDone(i, uRpm))
+      bDone = false;
+    // m_head is the oldest sample, it is replaced now
+    m_rpm[i][m_head] = uRpm;
+  }
+  if(++m_head >= testSettlePeriods)
+    m_head = 0;
+  if(m_samples < testSettlePeriods)
+    m_samples++;
+  if(bDone || (nowMillis() - m_ulPhaseStart) >= testPhaseMaxMs)
+    endPhase();
+}
+
+void FanTest::endPhase()
+{
+  for(short int i = 0; i < fans(); i++)
+  {
+    FanTestResult &r = m_fans[i];
+    if(r.result != testRunning)
+      continue;
+    unsigned long rpm = g_fan[i].getRPM();
+    // a fan has to stop when told to and keep spinning otherwise
+    bool bFailed = (m_phase == testPhaseStop) ? (rpm != 0) : (rpm == 0);
+    if(m_phase != testPhaseStop)
+      r.rpm[m_phase - testPhaseStart] = (rpm > 0xFFFF) ? 0xFFFF : (unsigned int)rpm;
+    if(bFailed)
+    {
+      LOG_WARN(logTest, "Fan %d failed test phase %d", i, m_phase);
+      r.result = testFailed;
+      r.failedPhase = m_phase;
+      // leave it to the opmode
+      g_fan[i].release();
+    }
+  }
+  if(m_phase < testPhaseMin)
+  {
+    startPhase(m_phase + 1);
+    return;
+  }
+  // nothing tested unless a fan has a tach
+  m_result = testNoTach;
+  for(short int i = 0; i < fans(); i++)
+  {
+    if(m_fans[i].result == testRunning)
+      m_fans[i].result = testPassed;
+    if(m_fans[i].result == testFailed)
+      m_result = testFailed;
+    else if(m_fans[i].result == testPassed && m_result == testNoTach)
+      m_result = testPassed;
+  }
+  end();
+  LOG_INFO(logTest, "Fans test done in %lums", m_ulDuration);
+}
+
+byte FanTest::getFailed()
+{
+  byte res = 0;
+  for(short int i = 0; i < fans(); i++)
+    if(m_fans[i].result == testFailed)
+      res |= (1 << i);
+  return res;
+}
+
+const char g_testResults[testNoTach + 1][8] PROGMEM = {
+  "none", "running", "passed", "failed", "no tach"
+};
+
+void FanTest::dumpStats(Print &out, char buf[], short int i)
+{
+  if(i >= fans())
+    return;
+  const FanTestResult &r = m_fans[i];
+  sprintf_P(buf, PSTR("Fan%d test: %S"), (int)i, g_testResults[r.result]);
+  out.print(buf);
+  if(r.result == testFailed)
+  {
+    sprintf_P(buf, PSTR(" in phase %d"), (int)r.failedPhase);
+    out.print(buf);
+  }
+  sprintf_P(buf, PSTR(", RPM start=%u max=%u min=%u"), r.rpm[0], r.rpm[1], r.rpm[2]);
+  out.println(buf);
+}
@@ -0,0 +1,101 @@
+/**
+ * Fan self-test which runs in the background, alongside normal operation.
+ *
+ * The fans with a tach are taken over, see Fan::override(), and taken
+ * through the phases: stop, start PWM, max PWM, min PWM.  A phase ends as
+ * soon as the tach confirms what is expected for every fan - spin-down,
+ * spin-up, a stable RPM at max and min - or after testPhaseMaxMs.  Then the
+ * fans are given back to the opmode, which controls them from the boot on.
+ * Fans without a tach can't be tested and are not touched.
+ */
+#pragma once
+
+/** phases */
+const byte testPhaseIdle = 0;
+const byte testPhaseStop = 1;
+const byte testPhaseStart = 2;
+const byte testPhaseMax = 3;
+const byte testPhaseMin = 4;
+
+/** overall and per fan result, overall it is testNoTach if no fan has one */
+const byte testNone = 0;
+const byte testRunning = 1;
+const byte testPassed = 2;
+const byte testFailed = 3;
+const byte testNoTach = 4;
+/** testXXX names, in flash */
+extern const char g_testResults[testNoTach + 1][8] PROGMEM;
+
+/** how often the tachs are looked at, ms */
+const unsigned long testPeriod = 100;
+/** give up on a phase after this long, ms */
+const unsigned long testPhaseMaxMs = 4000;
+/** RPM is stable when it changed by less than 1/32 over this many periods */
+const byte testSettlePeriods = 5;
+/** max # of fans tested */
+const byte testMaxFans = 3;
+
+struct FanTestResult
+{
+  /** testXXX */
+  byte result;
+  /** phase it failed in */
+  byte failedPhase;
+  /** RPM at the end of the start, max and min phases */
+  unsigned int rpm[3];
+};
+
+class FanTest
+{
+public:
+  /** start testing, the fans are taken over */
+  void begin();
+  /** stop testing, the fans are given back */
+  void abort();
+  /** the test task body, once per testPeriod */
+  void run();
+  /** testXXX for all the fans */
+  byte getResult()
+  {
+    return m_result;
+  }
+  /** bit mask of the fans which failed */
+  byte getFailed();
+  /** per fan results */
+  const FanTestResult &getResult(short int fan)
+  {
+    return m_fans[fan];
+  }
+  /** how long the last test took, ms */
+  unsigned long getDuration()
+  {
+    return m_ulDuration;
+  }
+  /** print results of fan i */
+  void dumpStats(Print &out, char buf[], short int i);
+
+private:
+  byte m_phase = testPhaseIdle;
+  byte m_result = testNone;
+  /** nowMillis() at the start of the test and the phase */
+  unsigned long m_ulStart = 0;
+  unsigned long m_ulPhaseStart = 0;
+  unsigned long m_ulDuration = 0;
+  FanTestResult m_fans[testMaxFans];
+  /** last RPMs of every fan, ring buffer */
+  unsigned int m_rpm[testMaxFans][testSettlePeriods];
+  byte m_head = 0;
+  /** # of samples taken in this phase */
+  byte m_samples = 0;
+
+  /** # of fans under test */
+  short int fans();
+  void startPhase(byte phase);
+  /** has fan i done what is expected in this phase? */
+  bool isPhaseDone(short int i, unsigned int rpm);
+  /** phase is over, check the fans and move on */
+  void endPhase();
+  void end();
+};
+
+extern FanTest g_fanTest;
@@ -0,0 +1,57 @@
+/**
+ * Sleeping between the scheduler ticks, see IdleSleep.h
+ */
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include "Fan.h"
+#include "Scheduler.h"
+#include "TxQueue.h"
+#include "IdleSleep.h"
+
+IdleSleep g_idleSleep;
+
+void IdleSleep::run()
+{
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  for(;;)
+  {
+    // an ISR signaling a task between the check and the sleep would not
+    // wake us up, hence with the interrupts off
+    cli();
+    // output still queued is moved on by loop() as the port drains
+    if(g_scheduler.getIdleTime() == 0 || !g_tx.isEmpty())
+    {
+      sei();
+      return;
+    }
+    unsigned long ulStart = nowMicros();
+    sleep_enable();
+    // the instruction following sei is executed before any pending interrupt
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    m_ulWakeups++;
+    unsigned long ulUs = m_uSleepUs + (nowMicros() - ulStart);
+    m_ulSleepMs += ulUs / 1000;
+    m_uSleepUs = ulUs % 1000;
+  }
+}
+
+void IdleSleep::dumpStats(Print &out, char buf[])
+{
+  // in tenths of %, scaled down so that * 1000 does not overflow
+  unsigned long ulTotal = nowMillis();
+  unsigned long ulAsleep = m_ulSleepMs;
+  while(ulTotal > 4000000UL)
+  {
+    ulTotal >>= 1;
+    ulAsleep >>= 1;
+  }
+  unsigned int uResidency = (ulTotal == 0) ? 0 : (unsigned int)(ulAsleep * 1000 / ulTotal);
+  if(uResidency > 1000)
+    uResidency = 1000;
+  unsigned int uDuty = 1000 - uResidency;
+  sprintf_P(buf, PSTR("Sleep: wakeups=%lu, asleep=%lums, residency=%u.%u%%, duty=%u.%u%%"),
+    m_ulWakeups, m_ulSleepMs, uResidency / 10, uResidency % 10, uDuty / 10, uDuty % 10);
+  out.println(buf);
+}
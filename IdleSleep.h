@@ -0,0 +1,34 @@
+/**
+ * Sleeping between the scheduler ticks.
+ *
+ * When no task is due loop() puts the MCU in idle sleep until the next
+ * interrupt: Timer0 overflow - every 1024us, millis() relies on it - a tach
+ * edge, an ADC conversion or a USART byte in or out.  Whatever woke it up is
+ * taken care of by the ISR, then loop() checks the tasks again.
+ * ADC noise reduction sleep would stop the timers and, with them, the fans
+ * PWM, so it is not used.
+ *
+ * The stats tell the # of wake-ups, the time spent asleep - residency - and
+ * the time awake - duty cycle.
+ */
+#pragma once
+
+class IdleSleep
+{
+public:
+  IdleSleep()
+  {
+  }
+  /** sleep till the next interrupt unless a task is due, called from loop() */
+  void run();
+  void dumpStats(Print &out, char buf[]);
+
+private:
+  /** # of sleeps, each ended by an interrupt */
+  unsigned long m_ulWakeups = 0;
+  /** time asleep, whole ms and the us short of the next ms */
+  unsigned long m_ulSleepMs = 0;
+  unsigned int m_uSleepUs = 0;
+};
+
+extern IdleSleep g_idleSleep;
@@ -1,5 +1,4 @@
-
-unsigned int myAnalogRead(short int pin);
+#include "AdcSampler.h"
 
 /**
  * Arduino wrapper for TI LM35 sensor
@@ -19,12 +18,22 @@ public:
 
   }
 
+  /** 
+   * register with the ADC sampler. 
+   * g_adc.begin() has to be called before read() is meaningful.
+   */
   void setup()
   {
     // LM35 is not going to provide more than 1V output and that @100C
     // switch to internal 1.1V reference
-    analogReference(INTERNAL);  
+    g_adc.setReference(INTERNAL);
     pinMode(m_pin, INPUT);
+    m_channel = g_adc.addChannel(m_pin);
+  }
+
+  /** forget observed min/max, start from the current reading */
+  void resetStats()
+  {
     g_tempMin = g_tempMax = read();
   }
 
@@ -32,13 +41,11 @@ public:
   * get the temperature and convert it to Celsius 
   * read analog LM35 sensor, 
   * presumes you did analogReference(INTERNAL); - more precise but smaller range
+  * Returns the latest filtered value from the ADC sampler, never blocks.
   */
   unsigned short int read()
   {
-    unsigned int reading = myAnalogRead(m_pin);
-    // 110 mV is mapped into 1024 steps.  analogReference(INTERNAL) needed
-    float tempC = (float)reading * 110 / 1024;
-    unsigned short int temp = (unsigned short)tempC;
+    unsigned short int temp = rawToC(g_adc.read12(m_channel));
     if(temp < g_tempMin)
       g_tempMin = temp;
     else if(temp > g_tempMax)
@@ -46,9 +53,32 @@ public:
     return temp;  
   }
 
+  /** same as read() but in tenths of C, does not update observed min/max */
+  unsigned short int readDeci()
+  {
+    return rawToDeciC(g_adc.read12(m_channel));
+  }
+
+  /**
+   * 12 bit oversampled reading into C.  LM35 is 10mV/C and 1100mV is mapped
+   * into 4096 steps, analogReference(INTERNAL) needed.
+   * Integer multiply and shift - no soft-float.  Truncates.
+   */
+  static unsigned short int rawToC(unsigned int raw12)
+  {
+    return ((unsigned long)raw12 * 110) >> 12;
+  }
+  /** same in tenths of C, rounded */
+  static unsigned short int rawToDeciC(unsigned int raw12)
+  {
+    return ((unsigned long)raw12 * 1100 + 2048) >> 12;
+  }
+
 private:
   /** sensor is connected to this pin */
   short int m_pin;
+  /** g_adc channel of this sensor */
+  byte m_channel = 0;
 };
 extern LM35 g_lm35;
 
@@ -61,18 +91,23 @@ public:
 
   }
 
+  /** register with the ADC sampler */
   void setup()
   {
     pinMode(m_pin, INPUT);
+    m_channel = g_adc.addChannel(m_pin);
   }
 
+  /** latest filtered reading 0..1023, never blocks */
   unsigned int read()
   {
-    return myAnalogRead(m_pin);
+    return g_adc.read(m_channel);
   }
 
 private:
   /** potentiometer is connected to this analog input pin */
   short int m_pin;
+  /** g_adc channel of this potentiometer */
+  byte m_channel = 0;
 };
 extern Potentiometer g_pot;
@@ -8,105 +8,116 @@
 #include "Led.h"
 #include "LM35.h"
 #include "OperationalMode.h"
+#include "Scheduler.h"
+#include "TxQueue.h"
+#include "Config.h"
+#include "Curve.h"
+#include "TempInput.h"
+#include "Profiler.h"
 
 ManualTemperatureSettingMode g_theManualTemperatureSettingMode;
 InternallyMeasuredTemperatureMode g_theInternallyMeasuredTemperatureMode;
 ExternalyMeasuredTemperatureMode g_theExternalyMeasuredTemperatureMode;
 DirectInternalFanControlMode g_theDirectInternalFanControlMode;
 DirectExternalFanControlMode g_theDirectExternalFanControlMode;
-/** default op mode */
-OpMode *g_pOpMode = &g_theInternallyMeasuredTemperatureMode;
+PidTemperatureMode g_thePidTemperatureMode;
 
 /**
- * most basic behaviour is response to serial commands
+ * Opmodes by their numbers
  */
-bool OpMode::loop()
+OpMode *OpMode::find(unsigned short int mode)
 {
-  if(g_sc.available())
+  switch(mode)
   {
-    g_sc.readAndDispatch();
-    return true;
+    case opModeManualTemperatureSetting:
+      return &g_theManualTemperatureSettingMode;
+    case opModeInternallyMeasuredTemperature:
+      return &g_theInternallyMeasuredTemperatureMode;
+    case opModeExternalyMeasuredTemperature:
+      return &g_theExternalyMeasuredTemperatureMode;
+    case opModeDirectInternalFanControl:
+      return &g_theDirectInternalFanControlMode;
+    case opModeDirectExternalFanControl:
+      return &g_theDirectExternalFanControlMode;
+    case opModePidTemperature:
+      return &g_thePidTemperatureMode;
   }
-  return false;
+  return 0;
 }
 
-bool OpMode::onCommandGetTemp()
+unsigned short int OpMode::getTemp(Channel &ch)
 {
-  unsigned short int temp = g_lm35.read();
-  Serial.println(temp);  
+  return g_lm35.read();
 }
-bool OpMode::onCommandSetTemp(unsigned short int temp)
+bool OpMode::onCommandSetTemp(Channel &ch, unsigned short int temp)
 {
-  DEBUG_PRINTLN("Can't set temp in this mode");
+  LOG_WARN(logOpMode, "Can't set temp in this mode");
   return false; 
 }
 
-bool OpMode::onCommandSetFan(unsigned short int pwm)
+bool OpMode::onCommandSetFan(Channel &ch, unsigned short int pwm)
 {
-  DEBUG_PRINTLN("Can't set fan pwm in this mode");
+  LOG_WARN(logOpMode, "Can't set fan pwm in this mode");
   return false; 
 }
-bool OpMode::onCommandSetOpMode(unsigned short int mode)
-{
-  switch(mode)
-  {
-    case opModeManualTemperatureSetting:
-      g_pOpMode = &g_theManualTemperatureSettingMode;
-      break;
-    case opModeInternallyMeasuredTemperature:
-      g_pOpMode = &g_theInternallyMeasuredTemperatureMode;
-      break;
-    case opModeExternalyMeasuredTemperature:
-      g_pOpMode = &g_theExternalyMeasuredTemperatureMode;
-      break;
-    case opModeDirectInternalFanControl:
-      g_pOpMode = &g_theDirectInternalFanControlMode;
-      break;
-    case opModeDirectExternalFanControl:
-      g_pOpMode = &g_theDirectExternalFanControlMode;
-      break;
-    default:
-      DEBUG_PRINT("Can't set mode to "); DEBUG_PRNTLN(mode);
-      return false;
-  }
-  return true; 
-}
 
 /**
  * Given this temperature in C (internally or externally measured),
- * set fans PWMs
+ * set the channel fan PWM according to the channel curve
  */
-void OpMode::onTemperature(unsigned short int temp)
+void OpMode::onTemperature(Channel &ch, unsigned short int temp)
 {
-  DEBUG_PRINT("onTemperature "); DEBUG_PRINTDEC(temp); DEBUG_PRINT(" ");
+  PROF_SCOPE(profTemp);
+  LOG_DEBUG(logOpMode, "onTemperature %u", temp);
   
-  if(temp < tempMin) 
+  bool bHot = (temp >= g_config.tempMax);
+  Fan &f = ch.getFan();
+  unsigned short pwmFan = curveRead(ch.getCurve(), temp);
+  unsigned short pwmNow = f.getPWM();
+  if(pwmFan == 0)
   {
-    fansStop();
-    g_led.off();
-  }  
-  else if(temp < tempMax)
+    f.stop();
+    ch.setHot(bHot);
+    return;
+  }
+  // no lower than this very fan can take
+  if(pwmFan < ch.getPwmMin())
+    pwmFan = ch.getPwmMin();
+  if(pwmNow == 0) 
   {
-    unsigned int pwmFan = map(temp, tempMin, tempMax, Fan::pwmMin, Fan::pwmMax);
-    unsigned short pwmNow = fansGetPWM();
-    if(pwmNow == 0) 
-    {
-      if(pwmFan < Fan::pwmStart) 
-        pwmFan = Fan::pwmStart;
-    }
-    else
-    {
-      // instead of just spinning at target pwm, lets get there gradually.
-      pwmFan = (pwmFan + pwmNow)/2;
-    }
-    fansSpin(pwmFan);
-    g_led.off();
+    if(pwmFan < ch.getPwmStart()) 
+      pwmFan = ch.getPwmStart();
+    f.spin(pwmFan);
+  }
+  else if(bHot)
+  {
+    f.spin(pwmFan);
   }
   else
   {
-    fansSpin(Fan::pwmMax);
-    g_led.on();
-  }    
+    // instead of just spinning at target pwm, lets get there gradually.
+    f.spin((pwmFan + pwmNow)/2);
+  }
+  ch.setHot(bHot);
+}
+
+/**
+ * Spin the fan at this pwm.  Stop it if it is below what it can spin at,
+ * make sure it can start if it is stopped, don't go over the max.
+ */
+void OpMode::spinFan(Channel &ch, unsigned short int pwm)
+{
+  Fan &f = ch.getFan();
+  if(pwm < ch.getPwmMin())
+  {
+    f.stop();
+    return;
+  }
+  if(pwm > g_config.pwmMax)
+    pwm = g_config.pwmMax;
+  if(f.getPWM() == 0 && pwm < ch.getPwmStart())
+    pwm = ch.getPwmStart();
+  f.spin(pwm);
 }
 
 /**
@@ -114,14 +125,11 @@ void OpMode::onTemperature(unsigned short int temp)
 - Firmware logic derives target fan PWM based on this temperature;
 - Controller PWM fan driver deliveres desired PWM to the fan.
 */
-bool ManualTemperatureSettingMode::loop()
+void ManualTemperatureSettingMode::control(Channel &ch)
 {
-  if(OpMode::loop())
-    return true;
   unsigned int reading = g_pot.read();
   unsigned int temp = map(reading, 0, 1024, 0, 100);
-  onTemperature(temp);
-  return false;
+  onTemperature(ch, temp);
 }
 
 /**
@@ -129,52 +137,50 @@ bool ManualTemperatureSettingMode::loop()
 - Firmware logic derives target fan PWM based on this temperature;
 - Controller PWM fan driver deliveres desired PWM to the fan.
 */
-bool InternallyMeasuredTemperatureMode::loop()
+void InternallyMeasuredTemperatureMode::control(Channel &ch)
 {
-  if(OpMode::loop())
-    return true;
-  onTemperature(g_lm35.read());
-  return false;
+  onTemperature(ch, g_lm35.read());
 }
 
 /**
 - External software measures temperature, e.g. that of a CPU or hard drive;
-- The temperature is supplied to the controller via serial port;
+- The temperatures are supplied to the controller via serial port, as named
+  inputs fused together, see TempInput.h, or per channel;
 - Firmware logic derives target fan PWM based on this temperature;
 - Controller PWM fan driver deliveres desired PWM to the fan.
 */
-bool ExternalyMeasuredTemperatureMode::loop()
+void ExternalyMeasuredTemperatureMode::control(Channel &ch)
 {
-  if(OpMode::loop())
-    return true;
-  onTemperature(m_uTemp);
-  return false;
+  onTemperature(ch, getTemp(ch));
 }
-bool ExternalyMeasuredTemperatureMode::onCommandGetTemp()
+unsigned short int ExternalyMeasuredTemperatureMode::getTemp(Channel &ch)
 {
-  Serial.println(m_uTemp);  
+  short int temp;
+  if(!g_tempInputs.fuse(ch.getIndex(), temp))
+    return ch.getExternalTemp();
+  return (temp < 0) ? 0 : temp;
 }
-bool ExternalyMeasuredTemperatureMode::onCommandSetTemp(unsigned short int temp)
+bool ExternalyMeasuredTemperatureMode::onCommandSetTemp(Channel &ch, unsigned short int temp)
 {
-  m_uTemp = temp;
+  // acted on by the control task, so that the fans step towards it at
+  // the same rate however often it comes
+  ch.setExternalTemp(temp);
+  return true;
 }
 
 /**
 - Potentiometer is used to define fan PWM;
 - Controller PWM fan driver deliveres desired PWM to the fan.
 */
-bool DirectInternalFanControlMode::loop()
+void DirectInternalFanControlMode::control(Channel &ch)
 {
-  // respond to serial commands
-  if(OpMode::loop())
-    return true;
   // read potentiometer
   unsigned int uReading = g_pot.read();
   // map it into pwm
-  unsigned int pwm = map(uReading, 0, 1024, 0, Fan::pwmMax);
+  unsigned int pwm = map(uReading, 0, 1024, 0, g_config.pwmMax);
   // and set the fan pwm
-  fansSpin(pwm);  
-  return true;
+  ch.getFan().spin(pwm);  
+  ch.setHot(false);
 }
 
 /**
@@ -182,15 +188,37 @@ bool DirectInternalFanControlMode::loop()
 - desired pwm is supplied to the controller via serial port;
 - Controller PWM fan driver deliveres desired PWM to the fan.
 */
-/*bool DirectExternalFanControlMode::loop()
+bool DirectExternalFanControlMode::onCommandSetFan(Channel &ch, unsigned short int pwm)
 {
-  if(OpMode::loop())
-    return true;
-  return false;
-}*/
+  ch.getFan().spin(pwm);  
+  return true;
+}
 
-bool DirectExternalFanControlMode::onCommandSetFan(unsigned short int pwm)
+/**
+- LM35 temperature sensor measures ambient temperature;
+- PID loop derives target fan PWM from the deviation from the setpoint;
+- Controller PWM fan driver deliveres desired PWM to the fan.
+*/
+void PidTemperatureMode::control(Channel &ch)
+{
+  // run the loop on tenths of C, whole degrees are too coarse for the D term
+  unsigned short int temp = g_lm35.readDeci();
+  Pid &pid = ch.getPid();
+  // gains may have been tuned and max PWM changed since the last time
+  pid.kp = m_pid.kp;
+  pid.ki = m_pid.ki;
+  pid.kd = m_pid.kd;
+  pid.setLimits(0, g_config.pwmMax);
+  int pwm = pid.update(m_uSetpoint * 10, temp);
+  LOG_DEBUG(logOpMode, "PID temp=%d pwm=%d I=%d", temp, pwm, pid.getIntegral());
+  spinFan(ch, pwm);
+  ch.setHot(temp >= g_config.tempMax * 10);
+}
+
+/**
+ * Pick up from whatever the fan is doing now
+ */
+void PidTemperatureMode::onActivate(Channel &ch)
 {
-  fansSpin(pwm);  
+  ch.getPid().reset(ch.getFan().getPWM());
 }
-
@@ -1,3 +1,5 @@
+#include "Pid.h"
+#include "Channel.h"
 
 const short int opModeInvalid = 0;
 
@@ -6,34 +8,49 @@ const short int opModeInternallyMeasuredTemperature = 2;
 const short int opModeExternalyMeasuredTemperature = 3;
 const short int opModeDirectInternalFanControl = 4;
 const short int opModeDirectExternalFanControl = 5;
+const short int opModePidTemperature = 6;
 
 const short int opModeFirst = opModeManualTemperatureSetting;
-const short int opModeLast = opModeDirectExternalFanControl;
+const short int opModeLast = opModePidTemperature;
 
 /**
- * Abstract class with basic functionality
+ * Abstract class with basic functionality.
+ * An opmode drives a channel, see Channel.h, every channel has its own.
+ * The opmodes are singletons, whatever state they keep per channel is in
+ * the Channel.
  */
 class OpMode
 {
 public:
-    /** the temperature in C to start the fan */
-    static const unsigned short int tempMin = 30;
-    /** the maximum temperature in C when fan is at 100% */
-    static const unsigned short int tempMax = 45;
-
-
     OpMode() : m_opMode(opModeInvalid)
     {
     }
+    /** the opmode with this number, 0 if none */
+    static OpMode *find(unsigned short int mode);
+
     /** 
-     * Basic functionality includes responding to serial commands.
-     * Specifically this means setting/getting attributes, but not something like fan spinning 
+     * Mode specific work, e.g. spinning the fan according to the temperature.
+     * Run by the scheduler as taskControl every getControlPeriod() ms, for
+     * every channel in this opmode.
+     * Responding to serial commands is done by taskSerial in any mode.
      */
-    virtual bool loop();
-    virtual bool onCommandGetTemp();
-    virtual bool onCommandSetFan(unsigned short int pwm);
-    virtual bool onCommandSetOpMode(unsigned short int mode);
-    virtual bool onCommandSetTemp(unsigned short int temp);
+    virtual void control(Channel &ch)
+    {
+    }
+    /** how often control() is to be run, in ms, 0 if never */
+    virtual unsigned long getControlPeriod()
+    {
+      return 1000;
+    }
+    /** called when the channel is switched to this opmode */
+    virtual void onActivate(Channel &ch)
+    {
+    }
+
+    /** temperature in C the opmode works with */
+    virtual unsigned short int getTemp(Channel &ch);
+    virtual bool onCommandSetFan(Channel &ch, unsigned short int pwm);
+    virtual bool onCommandSetTemp(Channel &ch, unsigned short int temp);
 
     /** accessor */
     short int getOpMode()
@@ -41,14 +58,14 @@ public:
       return m_opMode;
     }
 protected:
-    /** spins the fans according to this temperature */
-    void onTemperature(unsigned short int temp);
+    /** spins the fan according to this temperature */
+    void onTemperature(Channel &ch, unsigned short int temp);
+    /** spin the fan at pwm, respecting min, start and max PWMs in g_config */
+    void spinFan(Channel &ch, unsigned short int pwm);
     /** just to keep track of where we are. */
     short int m_opMode;    
 };
 
-extern OpMode *g_pOpMode;
-
 /**
  *
  */
@@ -60,7 +77,7 @@ public:
       m_opMode = opModeManualTemperatureSetting;
     }
     /** respond to potentiometer position as if it is temperature */
-    bool loop();
+    void control(Channel &ch);
 };
 
 extern ManualTemperatureSettingMode g_theManualTemperatureSettingMode;
@@ -76,7 +93,7 @@ public:
       m_opMode = opModeInternallyMeasuredTemperature;
     }
     /** respond to LM35 temp measurement */
-    bool loop();
+    void control(Channel &ch);
 };
 extern InternallyMeasuredTemperatureMode g_theInternallyMeasuredTemperatureMode;
 
@@ -91,11 +108,10 @@ public:
     m_opMode = opModeExternalyMeasuredTemperature;
   }
   /** respond to externally measured temp */
-  bool loop();
-  bool onCommandGetTemp();
-  bool onCommandSetTemp(unsigned short int temp);
-protected:
-  unsigned short m_uTemp = 0;
+  void control(Channel &ch);
+  /** fused named inputs, what was set for the channel if none is fresh */
+  unsigned short int getTemp(Channel &ch);
+  bool onCommandSetTemp(Channel &ch, unsigned short int temp);
 };
 extern ExternalyMeasuredTemperatureMode g_theExternalyMeasuredTemperatureMode;
 
@@ -110,7 +126,7 @@ public:
       m_opMode = opModeDirectInternalFanControl;
     }
     /** respond to potentiomer setting PWM */
-    bool loop();
+    void control(Channel &ch);
 };
 extern DirectInternalFanControlMode g_theDirectInternalFanControlMode;
 
@@ -124,10 +140,59 @@ public:
     {
       m_opMode = opModeDirectExternalFanControl;
     }
-    //bool loop();
-    /** respond to potentiomer setting PWM */
-    bool onCommandSetFan(unsigned short int pwm);
+    /** nothing to do periodically, fans are spun by serial commands */
+    unsigned long getControlPeriod()
+    {
+      return 0;
+    }
+    /** respond to serial command setting PWM */
+    bool onCommandSetFan(Channel &ch, unsigned short int pwm);
 
 };
 extern DirectExternalFanControlMode g_theDirectExternalFanControlMode;
+
+/**
+ * PID loop keeps LM35 temperature at the setpoint.
+ * Gains and setpoint are common, the loop state is per channel.
+ */ 
+class PidTemperatureMode : public OpMode
+{
+public:
+    /** fixed sample period the gains are tuned for, in ms */
+    static const unsigned long period = 1000;
+
+    /** gains are in PWM per tenth of C, Q8.8 */
+    PidTemperatureMode() : 
+      m_pid(514, 33, 1028, 0, Fan::pwmLimit)
+    {
+      m_opMode = opModePidTemperature;
+    }
+    void control(Channel &ch);
+    unsigned long getControlPeriod()
+    {
+      return period;
+    }
+    void onActivate(Channel &ch);
+
+    /** accessors, the gains are those of getPid() */
+    Pid &getPid()
+    {
+      return m_pid;
+    }
+    unsigned short int getSetpoint()
+    {
+      return m_uSetpoint;
+    }
+    void setSetpoint(unsigned short int setpoint)
+    {
+      m_uSetpoint = setpoint;
+    }
+
+protected:
+    /** the gains */
+    Pid m_pid;
+    /** temperature in C to keep */
+    unsigned short int m_uSetpoint = 35;
+};
+extern PidTemperatureMode g_thePidTemperatureMode;
 
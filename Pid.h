@@ -0,0 +1,91 @@
+#pragma once
+
+/**
+ * Fixed point PID controller, integer arithmetic only - there is no FPU.
+ * Gains are Q8.8, i.e. 256 stands for 1.0, in output units per input unit
+ * (per sample for ki and kd).  Meant for cooling, i.e. the output goes up
+ * when the input is above the setpoint.
+ * Derivative is taken on the measurement, not on the error, so that setpoint
+ * changes don't kick the output.  The integrator is clamped to the output
+ * range and is not updated while the output is saturated in the direction
+ * the error pushes it (anti-windup).
+ */
+class Pid
+{
+public:
+  /** proportional gain, Q8.8 */
+  int kp;
+  /** integral gain, Q8.8 per sample */
+  int ki;
+  /** derivative gain, Q8.8 per sample */
+  int kd;
+
+  Pid(int kp, int ki, int kd, int outMin, int outMax) :
+    kp(kp), ki(ki), kd(kd), m_outMin(outMin), m_outMax(outMax)
+  {
+  }
+
+  /** bumpless (re)start from this output */
+  void reset(int output)
+  {
+    m_integral = (long)output << 8;
+    clampIntegral(m_integral);
+    m_bPrimed = false;
+  }
+
+  /** to be called once per sample period, returns the new output */
+  int update(int setpoint, int input)
+  {
+    int error = input - setpoint;
+    int dInput = m_bPrimed ? (input - m_lastInput) : 0;
+    m_lastInput = input;
+    m_bPrimed = true;
+
+    long integral = m_integral + (long)ki * error;
+    clampIntegral(integral);
+    long out = (long)kp * error + integral + (long)kd * dInput;
+    long outMax = (long)m_outMax << 8;
+    long outMin = (long)m_outMin << 8;
+    // don't let the integrator wind up while saturated
+    if(!((out > outMax && error > 0) || (out < outMin && error < 0)))
+      m_integral = integral;
+    if(out > outMax)
+      out = outMax;
+    else if(out < outMin)
+      out = outMin;
+    // round Q8.8 to integer
+    return (int)((out + 128) >> 8);
+  }
+
+  /** output range, the integrator is clamped to the new one */
+  void setLimits(int outMin, int outMax)
+  {
+    m_outMin = outMin;
+    m_outMax = outMax;
+    clampIntegral(m_integral);
+  }
+
+  /** integrator state in output units, for diagnostics */
+  int getIntegral()
+  {
+    return (int)(m_integral >> 8);
+  }
+
+private:
+  int m_outMin;
+  int m_outMax;
+  /** integrator, Q8.8 output units */
+  long m_integral = 0;
+  /** previous input for the derivative term */
+  int m_lastInput = 0;
+  /** m_lastInput is valid */
+  bool m_bPrimed = false;
+
+  void clampIntegral(long &integral)
+  {
+    if(integral > ((long)m_outMax << 8))
+      integral = (long)m_outMax << 8;
+    else if(integral < ((long)m_outMin << 8))
+      integral = (long)m_outMin << 8;
+  }
+};
@@ -0,0 +1,79 @@
+/**
+ * Loop phase profiler, see Profiler.h
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Profiler.h"
+
+#ifdef PROFILER
+
+Profiler g_profiler;
+
+/** for stats, indexed by profXXX, in flash */
+static const char g_profNames[profCount][8] PROGMEM = {
+  "serial", "sensors", "control", "ontemp", "stats", "tx"
+};
+
+void Profiler::add(byte phase, unsigned long us)
+{
+  ProfPhase &p = m_phases[phase];
+  unsigned int uUs = (us > 0xFFFF) ? 0xFFFF : us;
+  if(uUs < p.minUs)
+    p.minUs = uUs;
+  if(uUs > p.maxUs)
+    p.maxUs = uUs;
+  if(p.sumUs + us < p.sumUs)
+  {
+    p.sumUs /= 2;
+    p.runs /= 2;
+  }
+  p.sumUs += us;
+  p.runs++;
+
+  byte bucket = 0;
+  while(uUs > 1 && bucket < profBuckets - 1)
+  {
+    uUs >>= 1;
+    bucket++;
+  }
+  if(p.hist[bucket] == 0xFFFF)
+    for(byte i = 0; i < profBuckets; i++)
+      p.hist[i] /= 2;
+  p.hist[bucket]++;
+}
+
+void Profiler::reset()
+{
+  memset(m_phases, 0, sizeof(m_phases));
+  for(byte i = 0; i < profCount; i++)
+    m_phases[i].minUs = 0xFFFF;
+}
+
+void Profiler::dumpStats(Print &out, char buf[], byte section)
+{
+  byte phase = section / 2;
+  if(phase >= profCount)
+    return;
+  ProfPhase &p = m_phases[phase];
+  if((section & 1) == 0)
+  {
+    unsigned int uMin = (p.runs == 0) ? 0 : p.minUs;
+    unsigned long ulMean = (p.runs == 0) ? 0 : (p.sumUs / p.runs);
+    sprintf_P(buf, PSTR("Prof %S: runs=%lu, "), g_profNames[phase], p.runs);
+    out.print(buf);
+    sprintf_P(buf, PSTR("min=%uus, mean=%luus, max=%uus"), uMin, ulMean, p.maxUs);
+    out.println(buf);
+    return;
+  }
+  sprintf_P(buf, PSTR("Prof %S hist:"), g_profNames[phase]);
+  out.print(buf);
+  for(byte i = 0; i < profBuckets; i++)
+  {
+    sprintf_P(buf, PSTR(" %u"), p.hist[i]);
+    out.print(buf);
+  }
+  out.println();
+}
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * Loop phase profiler.
+ *
+ * PROF_SCOPE(phase) at the top of a block times it from there to the end of
+ * the block off the Timer0 hardware counter, see nowMicros(), and adds the
+ * time to the phase stats: # of runs, min, mean and max, and a log2
+ * histogram - bucket n counts the runs of 2^n to 2^(n+1)-1 us, bucket 0
+ * those under 2us too and the last bucket all the longer ones.
+ * Time spent in ISRs while in the phase is counted in.  Phases may nest.
+ *
+ * RAM taken is fixed, profCount * sizeof(ProfPhase).  A histogram
+ * bucket about to wrap halves all of them, the sum of the times about to
+ * wrap is halved together with the # of runs it is the sum of.
+ *
+ * `GET PROF` prints the stats, also at the end of `STATS`, `SET PROF 0`
+ * starts over.  It is opt-in, the RAM is tight: build with PROFILER
+ * defined, e.g. by uncommenting the line below, to compile it in.
+ */
+#pragma once
+
+//#define PROFILER 1
+
+/** phases profiled, index into the phase table */
+const byte profSerial = 0;
+const byte profSensors = 1;
+const byte profControl = 2;
+const byte profTemp = 3;
+const byte profStats = 4;
+const byte profTx = 5;
+/** # of phases */
+const byte profCount = 6;
+/** # of histogram buckets, the last one is for 2^(profBuckets-1) us and up */
+const byte profBuckets = 12;
+
+#ifdef PROFILER
+
+struct ProfPhase
+{
+  /** # of runs the sum is of */
+  unsigned long runs;
+  /** of the run times, us */
+  unsigned long sumUs;
+  /** run times, us */
+  unsigned int minUs;
+  unsigned int maxUs;
+  /** log2 histogram of the run times */
+  unsigned int hist[profBuckets];
+};
+
+class Profiler
+{
+public:
+  Profiler()
+  {
+    reset();
+  }
+  /** the phase took this long */
+  void add(byte phase, unsigned long us);
+  /** forget all the stats */
+  void reset();
+  /** print the stats, two sections per phase: the summary and the histogram */
+  void dumpStats(Print &out, char buf[], byte section);
+
+private:
+  ProfPhase m_phases[profCount];
+};
+
+/** the one and only profiler */
+extern Profiler g_profiler;
+
+/** times the rest of the block it is declared in */
+class ProfScope
+{
+public:
+  ProfScope(byte phase) :
+    m_phase(phase), m_ulStart(nowMicros())
+  {
+  }
+  ~ProfScope()
+  {
+    g_profiler.add(m_phase, nowMicros() - m_ulStart);
+  }
+
+private:
+  byte m_phase;
+  unsigned long m_ulStart;
+};
+
+#define PROF_SCOPE(phase) ProfScope profScope(phase)
+
+#else
+
+#define PROF_SCOPE(phase)
+
+#endif
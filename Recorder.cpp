@@ -0,0 +1,306 @@
+/**
+ * Black box recorder, see Recorder.h for the record format
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Config.h"
+#include "TxQueue.h"
+#include "OperationalMode.h"
+#include "Channel.h"
+#include "Recorder.h"
+
+Recorder g_recorder;
+
+#ifdef __AVR__
+static_assert(sizeof(Recorder) <= recRamBudget, "Recorder takes more RAM than recRamBudget");
+#endif
+
+/** record header bits */
+const byte recRepeat = 0x80;
+const byte recKey = 0x40;
+const byte recEvent = 0x20;
+const byte recTemp = 0x01;
+const byte recPwm = 0x02;
+const byte recRpm = 0x04;
+const byte recOpMode = 0x08;
+
+/** longest record: key frame of 3 fans */
+const byte recRecordMax = 1 + 5 + 3 + 1 + configFans * (2 + 3);
+/** longest dump line, incl. the queue overhead */
+const byte recDumpLineMax = 80;
+/** bytes per dump line */
+const byte recDumpBytes = 32;
+
+static bool isKey(byte h)
+{
+  return (h & (recRepeat | recKey)) == recKey;
+}
+
+/** fans recorded */
+static short int recFans()
+{
+  short int n = fansCount();
+  return (n > configFans) ? configFans : n;
+}
+
+/** LEB128, returns # of bytes */
+static byte putVarint(byte *p, unsigned long value)
+{
+  byte n = 0;
+  while(value >= 0x80)
+  {
+    p[n++] = (byte)value | 0x80;
+    value >>= 7;
+  }
+  p[n++] = (byte)value;
+  return n;
+}
+
+/** a value within band of the one recorded is taken for it */
+static void deadband(unsigned short &value, unsigned short recorded, byte band)
+{
+  if(value <= recorded + band && value + band >= recorded)
+    value = recorded;
+}
+
+/** small deltas either way make small varints */
+static byte putDelta(byte *p, long delta)
+{
+  return putVarint(p, (delta < 0) ? ((unsigned long)(-delta) * 2 - 1) : ((unsigned long)delta * 2));
+}
+
+void Recorder::read(RecSample &s)
+{
+  s.temp = g_channels[0].getTemp();
+  s.opMode = (byte)g_channels[0].getOpModeId();
+  for(short int i = 0; i < configFans; i++)
+  {
+    s.pwm[i] = 0;
+    s.rpm[i] = 0;
+  }
+  for(short int i = 0; i < recFans(); i++)
+  {
+    s.pwm[i] = g_fan[i].getPWM();
+    unsigned long rpm = (g_fan[i].getRPM() + recRpmUnit / 2) / recRpmUnit;
+    s.rpm[i] = (rpm > 0xFFFF) ? 0xFFFF : (unsigned short)rpm;
+  }
+}
+
+byte Recorder::encodeKey(byte rec[], RecSample &s)
+{
+  byte n = 0;
+  rec[n++] = recKey;
+  n += putVarint(rec + n, nowMillis() / 1000);
+  n += putVarint(rec + n, s.temp);
+  rec[n++] = s.opMode;
+  for(short int i = 0; i < recFans(); i++)
+    n += putVarint(rec + n, s.pwm[i]);
+  for(short int i = 0; i < recFans(); i++)
+    n += putVarint(rec + n, s.rpm[i]);
+  return n;
+}
+
+byte Recorder::encodeDelta(byte rec[], RecSample &s)
+{
+  byte h = 0;
+  byte n = 1;
+  if(s.temp != m_prev.temp)
+  {
+    h |= recTemp;
+    n += putDelta(rec + n, (long)s.temp - m_prev.temp);
+  }
+  if(memcmp(s.pwm, m_prev.pwm, sizeof(s.pwm)) != 0)
+  {
+    h |= recPwm;
+    for(short int i = 0; i < recFans(); i++)
+      n += putDelta(rec + n, (long)s.pwm[i] - m_prev.pwm[i]);
+  }
+  if(memcmp(s.rpm, m_prev.rpm, sizeof(s.rpm)) != 0)
+  {
+    h |= recRpm;
+    for(short int i = 0; i < recFans(); i++)
+      n += putDelta(rec + n, (long)s.rpm[i] - m_prev.rpm[i]);
+  }
+  if(s.opMode != m_prev.opMode)
+  {
+    h |= recOpMode;
+    rec[n++] = s.opMode;
+  }
+  rec[0] = h;
+  return (h == 0) ? 0 : n;
+}
+
+unsigned short Recorder::oldestLength()
+{
+  byte h = m_buf[at(0)];
+  if(h & recRepeat)
+    return 1;
+  if(h == recEvent)
+    return 3;
+  // # of varints, then # of bytes of opmode at the end of it
+  byte varints = 0;
+  byte bytes = 0;
+  if(h == recKey)
+  {
+    varints = 2 + 2 * recFans();
+    bytes = 1;
+  }
+  else
+  {
+    if(h & recTemp)
+      varints++;
+    if(h & recPwm)
+      varints += recFans();
+    if(h & recRpm)
+      varints += recFans();
+    if(h & recOpMode)
+      bytes = 1;
+  }
+  // the opmode byte of a key frame is in between the varints, it is < 0x80 anyway
+  unsigned short n = 1;
+  for(byte i = 0; i < varints + bytes; i++)
+    while(m_buf[at(n++)] & 0x80)
+      ;
+  return n;
+}
+
+void Recorder::drop()
+{
+  unsigned short len = oldestLength();
+  m_tail = at(len);
+  m_used -= len;
+}
+
+bool Recorder::append(const byte rec[], byte len)
+{
+  while(recSize - m_used < len)
+    drop();
+  // the deltas w/o the key frame they are from are of no use
+  while(m_used != 0 && !isKey(m_buf[m_tail]))
+    drop();
+  if(m_used == 0 && !isKey(rec[0]))
+    return false;
+  m_last = at(m_used);
+  for(byte i = 0; i < len; i++)
+    m_buf[at(m_used++)] = rec[i];
+  m_records = isKey(rec[0]) ? 0 : (m_records + 1);
+  return true;
+}
+
+void Recorder::sample()
+{
+  RecSample s;
+  read(s);
+  if(m_used != 0)
+  {
+    deadband(s.temp, m_prev.temp, recTempDeadband);
+    for(short int i = 0; i < recFans(); i++)
+    {
+      deadband(s.pwm[i], m_prev.pwm[i], recPwmDeadband);
+      deadband(s.rpm[i], m_prev.rpm[i], recRpmDeadband);
+    }
+  }
+  unsigned long ulNow = nowMillis();
+  long lOff = (long)(ulNow - m_ulNext);
+  bool bKey = (m_used == 0 || m_records >= recKeyEvery || lOff > (long)recSlack || lOff < -(long)recSlack);
+  m_ulNext += recPeriod;
+  byte rec[recRecordMax];
+  byte len;
+  if(bKey)
+  {
+    len = encodeKey(rec, s);
+    m_ulNext = ulNow + recPeriod;
+  }
+  else
+  {
+    len = encodeDelta(rec, s);
+    if(len == 0)
+    {
+      // nothing changed, count it in the repeat record if the last one is
+      if((m_buf[m_last] & recRepeat) && m_buf[m_last] != 0xFF)
+      {
+        m_buf[m_last]++;
+        return;
+      }
+      rec[0] = recRepeat;
+      len = 1;
+    }
+  }
+  if(!append(rec, len))
+  {
+    append(rec, encodeKey(rec, s));
+    m_ulNext = ulNow + recPeriod;
+  }
+  m_prev = s;
+}
+
+void Recorder::run()
+{
+  // the sample after a skipped one is a key frame
+  if(m_state == recFrozen || m_pDumpOut != 0)
+    return;
+  sample();
+  if(m_state == recTriggered && --m_postLeft == 0)
+    m_state = recFrozen;
+}
+
+void Recorder::event(byte code, byte arg)
+{
+  if(m_state == recFrozen)
+    return;
+  // the dump in progress is left alone, the event still counts
+  if(m_pDumpOut == 0)
+  {
+    byte rec[] = { recEvent, code, arg };
+    if(!append(rec, sizeof(rec)))
+    {
+      // the key frame it can follow
+      sample();
+      append(rec, sizeof(rec));
+    }
+  }
+  if(m_state == recRecording)
+  {
+    m_state = recTriggered;
+    m_postLeft = recPostSamples;
+  }
+}
+
+void Recorder::rearm()
+{
+  m_state = recRecording;
+}
+
+void Recorder::dump(TxChannel &out)
+{
+  m_pDumpOut = &out;
+  m_dumped = 0xFFFF;
+}
+
+void Recorder::dumpMore()
+{
+  char buf[recDumpLineMax];
+  while(m_pDumpOut != 0 && m_pDumpOut->availableForWrite() >= recDumpLineMax)
+  {
+    if(m_dumped == 0xFFFF)
+    {
+      sprintf_P(buf, PSTR("BLACKBOX fans=%d, period=%lums, rpmUnit=%d, state=%d, bytes=%u"),
+        (int)recFans(), recPeriod, (int)recRpmUnit, (int)m_state, m_used);
+      m_pDumpOut->println(buf);
+      m_dumped = 0;
+    }
+    else if(m_dumped < m_used)
+    {
+      char *p = buf + sprintf_P(buf, PSTR("BB "));
+      for(byte i = 0; i < recDumpBytes && m_dumped < m_used; i++)
+        p += sprintf_P(p, PSTR("%02X"), m_buf[at(m_dumped++)]);
+      m_pDumpOut->println(buf);
+    }
+    else
+    {
+      m_pDumpOut->println(F("BLACKBOX END"));
+      m_pDumpOut = 0;
+    }
+  }
+}
@@ -0,0 +1,151 @@
+/**
+ * Black box: a flight recorder of what the controller saw and did, kept in
+ * a RAM ring so that the minutes before a box overheated can be looked at
+ * after the fact.
+ *
+ * Every recPeriod the temperature the first channel works with, its opmode
+ * and every fan's PWM and RPM are sampled.  Records in the ring, a header
+ * byte each:
+ *   1nnnnnnn  the last sample repeated n+1 times, no more bytes
+ *   01000000  key frame: seconds since boot, temp, opmode (1 byte), PWM and
+ *             RPM of every fan, all absolute
+ *   00100000  event: recEvXXX (1 byte), its argument (1 byte)
+ *   0000mrpt  sample, deltas from the previous one of what changed:
+ *             t - temp, p - PWM of every fan, r - RPM of every fan,
+ *             m - opmode (1 byte, absolute)
+ * Numbers are LEB128 varints, deltas zigzag encoded, RPM is in recRpmUnit.
+ * Steady state costs a byte per 128 samples, about 10 minutes, changes within
+ * the recXXXDeadband are not recorded.  Measured in the simulator, the ring
+ * holds about a day of a steady load, over 2 hours of a load going on and off
+ * every hour and 25 minutes of one going on and off every 5 minutes.
+ *
+ * The oldest records are dropped to make room, a key frame at least every
+ * recKeyEvery records keeps the rest decodable.  The deltas are taken for
+ * recPeriod apart, a sample which is not - the first one after a freeze or
+ * a dump, a late task - is a key frame so that its time is known.  An event - a channel got
+ * hot, a stall alarm, an opmode change - keeps the recording going for
+ * recPostSamples more samples and then freezes it until re-armed, so that
+ * what led to the event and what followed it is kept.
+ *
+ * `BLACKBOX` streams the ring as hex lines, host/blackbox decodes them.
+ * `GET BLACKBOX` tells the recXXX state, `SET BLACKBOX 0` re-arms.
+ */
+#pragma once
+
+/** RAM the black box may take, bytes: an eighth of the 2048 of the ATmega328P */
+const unsigned short recRamBudget = 256;
+/** Recorder members but the ring, bytes on the AVR */
+const unsigned short recStateSize = 32;
+/** ring size, bytes: what the rest of Recorder leaves of the budget */
+const unsigned short recSize = recRamBudget - recStateSize;
+/** sample period, ms */
+const unsigned long recPeriod = 5000;
+/** a sample more than this, ms, off recPeriod after the one before is a key frame */
+const unsigned short recSlack = 500;
+/** RPM resolution */
+const byte recRpmUnit = 25;
+/**
+ * Changes of up to these are not recorded, lest the sensor noise and the
+ * opmodes chasing it break the repeats: temperature in C, PWM - 5% -, RPM in
+ * recRpmUnit
+ */
+const byte recTempDeadband = 1;
+const byte recPwmDeadband = fanPwmTop / 20;
+const byte recRpmDeadband = 1;
+/** max # of records between the key frames */
+const byte recKeyEvery = 16;
+/** # of samples recorded after an event before freezing, leaves most of the ring to what led to it */
+const byte recPostSamples = 12;
+
+/** states */
+const byte recRecording = 0;
+/** an event was recorded, freezing soon */
+const byte recTriggered = 1;
+const byte recFrozen = 2;
+
+/** events, the argument is in the comment */
+/** a channel got hot: channel */
+const byte recEvHot = 1;
+/** stall alarm: fan << 4 | stallXXX */
+const byte recEvStall = 2;
+/** opmode change: channel << 4 | opmode */
+const byte recEvOpMode = 3;
+
+/** one sample */
+struct RecSample
+{
+  unsigned short temp;
+  byte opMode;
+  unsigned short pwm[configFans];
+  unsigned short rpm[configFans];
+};
+
+class Recorder
+{
+public:
+  /** take a sample unless frozen or dumping, the recorder task body */
+  void run();
+  /** record this event, see recEvXXX */
+  void event(byte code, byte arg);
+
+  /** recXXX */
+  byte getState()
+  {
+    return m_state;
+  }
+  /** start recording again, the history is kept */
+  void rearm();
+
+  /** start streaming the ring to out, dumpMore() prints it */
+  void dump(TxChannel &out);
+  /** print as much of the dump as out takes */
+  void dumpMore();
+
+private:
+  byte m_buf[recSize];
+  /** oldest byte */
+  unsigned short m_tail = 0;
+  /** # of bytes in the ring */
+  unsigned short m_used = 0;
+  /** start of the newest record */
+  unsigned short m_last = 0;
+  /** # of records since the last key frame */
+  byte m_records = 0;
+  /** the values the newest sample record is the delta from */
+  RecSample m_prev;
+  byte m_state = recRecording;
+  /** samples to go before freezing */
+  byte m_postLeft = 0;
+
+  /** where the dump in progress goes, 0 if none */
+  TxChannel *m_pDumpOut = 0;
+  /** # of bytes dumped so far, 0xFFFF for the header line */
+  unsigned short m_dumped = 0;
+  /** when the next sample is due for it to be a delta, nowMillis() */
+  unsigned long m_ulNext = 0;
+
+  /** ring index of the nth byte from the oldest */
+  unsigned short at(unsigned short n)
+  {
+    n += m_tail;
+    return (n >= recSize) ? (n - recSize) : n;
+  }
+  /** the current values */
+  void read(RecSample &s);
+  /** record encoding of s, returns the length, 0 if nothing changed */
+  byte encodeKey(byte rec[], RecSample &s);
+  byte encodeDelta(byte rec[], RecSample &s);
+  /** length of the oldest record */
+  unsigned short oldestLength();
+  /** drop the oldest record */
+  void drop();
+  /**
+   * add a record, dropping the oldest ones to make room.  Fails if this
+   * drops all the key frames and the record is not one.
+   */
+  bool append(const byte rec[], byte len);
+  void sample();
+};
+
+/** the one and only black box */
+extern Recorder g_recorder;
@@ -0,0 +1,128 @@
+/**
+ *  Cooperative deadline based task scheduler
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Scheduler.h"
+
+/** true if time a is at or past time b, handles rollover */
+static inline bool isDue(unsigned long a, unsigned long b)
+{
+  return (long)(a - b) >= 0;
+}
+
+void Scheduler::setup()
+{
+  unsigned long now = nowMillis();
+  for(byte i = 0; i < m_numTasks; i++)
+    m_tasks[i].release = now;
+}
+
+void Scheduler::setPeriod(byte task, unsigned long period)
+{
+  if(task >= m_numTasks)
+    return;
+  m_tasks[task].period = period;
+  m_tasks[task].release = nowMillis();
+}
+
+byte Scheduler::pickDue(unsigned long now)
+{
+  byte res = m_numTasks;
+  for(byte i = 0; i < m_numTasks; i++)
+  {
+    Task &t = m_tasks[i];
+    if(!t.signaled && (t.period == 0 || !isDue(now, t.release)))
+      continue;
+    if(res == m_numTasks || t.priority > m_tasks[res].priority)
+      res = i;
+  }
+  return res;
+}
+
+void Scheduler::dispatch(Task &t)
+{
+  // a signal coming while the task runs gets it run again
+  t.signaled = false;
+  bool bReleased = (t.period != 0) && isDue(nowMillis(), t.release);
+  unsigned long ulStart = nowMicros();
+  (*t.run)();
+  unsigned long ulExec = nowMicros() - ulStart;
+  if(ulExec > t.maxExecUs)
+    t.maxExecUs = (ulExec > 0xFFFF) ? 0xFFFF : (unsigned int)ulExec;
+  t.runs++;
+  // a signaled run does not count against the schedule
+  if(!bReleased)
+    return;
+
+  unsigned long now = nowMillis();
+  unsigned long ulLateness = now - t.release;
+  if(ulLateness > t.maxLateness)
+    t.maxLateness = (ulLateness > 0xFFFF) ? 0xFFFF : (unsigned int)ulLateness;
+  if(ulLateness > t.deadline)
+    t.overruns++;
+  // the task could have changed its own period
+  if(t.period == 0)
+    return;
+  t.release += t.period;
+  if(isDue(now, t.release))
+  {
+    // we missed one or more releases - do not try to catch up
+    t.overruns++;
+    t.release = now + t.period;
+  }
+}
+
+byte Scheduler::run()
+{
+  byte res = 0;
+  for(;;)
+  {
+    byte i = pickDue(nowMillis());
+    if(i >= m_numTasks)
+      break;
+    dispatch(m_tasks[i]);
+    res++;
+  }
+  return res;
+}
+
+unsigned long Scheduler::getIdleTime()
+{
+  unsigned long now = nowMillis();
+  unsigned long res = 0xFFFFFFFF;
+  for(byte i = 0; i < m_numTasks; i++)
+  {
+    Task &t = m_tasks[i];
+    if(t.signaled)
+      return 0;
+    if(t.period == 0)
+      continue;
+    if(isDue(now, t.release))
+      return 0;
+    unsigned long ulWait = t.release - now;
+    if(ulWait < res)
+      res = ulWait;
+  }
+  return res;
+}
+
+unsigned int Scheduler::getOverruns()
+{
+  unsigned int res = 0;
+  for(byte i = 0; i < m_numTasks; i++)
+    res += m_tasks[i].overruns;
+  return res;
+}
+
+void Scheduler::dumpStats(Print &out, char buf[], byte task)
+{
+  if(task >= m_numTasks)
+    return;
+  Task &t = m_tasks[task];
+  sprintf_P(buf, PSTR("Task %S: period=%lums, runs=%lu, "), t.name, t.period, t.runs);
+  out.print(buf);
+  sprintf_P(buf, PSTR("overruns=%u, maxLate=%ums, maxExec=%uus"), t.overruns, t.maxLateness, t.maxExecUs);
+  out.println(buf);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+/**
+ * Our tasks.  Index into the task table, see g_tasks[]
+ */
+const byte taskSerial = 0;
+const byte taskSensors = 1;
+const byte taskControl = 2;
+const byte taskStats = 3;
+const byte taskTelemetry = 4;
+const byte taskFanTest = 5;
+const byte taskConfig = 6;
+const byte taskFanChar = 7;
+const byte taskStall = 8;
+const byte taskRecorder = 9;
+/** # of tasks in the table */
+const byte taskCount = 10;
+
+/**
+ * Periodic task descriptor.
+ * First five fields are static config, the rest is the scheduler state
+ * and should be left zero-initialized.
+ */
+struct Task
+{
+  /** for stats, in flash */
+  PGM_P name;
+  /** task body */
+  void (*run)();
+  /** in ms, 0 means the task is disabled */
+  unsigned long period;
+  /** in ms from the release, completing later than this is an overrun */
+  unsigned int deadline;
+  /** the higher the more important */
+  byte priority;
+
+  /** when the task is to be run next */
+  unsigned long release;
+  /** # of times the task was run */
+  unsigned long runs;
+  /** # of times the task completed past its deadline or missed a release */
+  unsigned int overruns;
+  /** max observed time from release to completion, in ms, saturates */
+  unsigned int maxLateness;
+  /** max observed execution time, in us, saturates */
+  unsigned int maxExecUs;
+  /** to be run as soon as possible, see Scheduler::signal() */
+  volatile bool signaled;
+};
+
+/**
+ * Cooperative deadline based scheduler over a fixed table of tasks.
+ * Time base is the monotonic nowMillis().  Of the tasks which are due
+ * the highest priority one runs first.  Tasks are never preempted.
+ * A task can also be signaled, e.g. from an ISR, to run at the next slot
+ * on top of its periodic runs.
+ */
+class Scheduler
+{
+public:
+  Scheduler(Task *tasks, byte numTasks) :
+    m_tasks(tasks), m_numTasks(numTasks)
+  {
+  }
+
+  /** release all the enabled tasks now */
+  void setup();
+  /**
+   * Run the tasks which are due, in priority order.
+   * Returns # of tasks run.  To be called from loop().
+   */
+  byte run();
+  /** run the task at the next slot, whatever its period.  Safe to call from an ISR. */
+  void signal(byte task)
+  {
+    m_tasks[task].signaled = true;
+  }
+  /** change task period, 0 disables it.  The task is released right away. */
+  void setPeriod(byte task, unsigned long period);
+  /** ms until the next release of any enabled task, 0 if something is due */
+  unsigned long getIdleTime();
+  /** total overruns of all the tasks */
+  unsigned int getOverruns();
+  /** print the stats of this task */
+  void dumpStats(Print &out, char buf[], byte task);
+
+private:
+  /** the task table */
+  Task *m_tasks;
+  /** # of tasks in the table */
+  byte m_numTasks;
+
+  /** index of the due task with the highest priority or m_numTasks */
+  byte pickDue(unsigned long now);
+  /** run the task and update its stats */
+  void dispatch(Task &t);
+};
+
+/** the task table */
+extern Task g_tasks[];
+/** the one and only scheduler */
+extern Scheduler g_scheduler;
@@ -22,27 +22,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ***********************************************************************************/
 #include <Arduino.h>
 #include <string.h>
-#define NODEBUG 1
+#define LOG_LEVEL logWarn
 #include "Trace.h"
 #include "SerialCommand.h"
 
-const static char *SerialCommand::delim = " ";     // null-terminated list of delimeter chars for tokenizing (default " ")
+const char *SerialCommand::delim = " ";     // null-terminated list of delimeter chars for tokenizing (default " ")
 /** serial command handler */
 SerialCommand g_sc;
 
 
-#ifdef SERIALCOMMAND_HARDWAREONLY
 SerialCommand::SerialCommand() 
 {
   clearBuffer(); 
 }
-#else
-SerialCommand::SerialCommand(SoftwareSerial *softSer) : 
-  softSerial(softSer)
-{		
-  clearBuffer(); 
-}
-#endif
 
 /**
  * Retrieve the next token ("word" or "argument") from the Command buffer.  
@@ -53,67 +45,53 @@ char *SerialCommand::next()
   return strtok_r(NULL, delim, &last); 
 }
 
-bool SerialCommand::available()
+/** 
+ * Assemble the characters into a buffer.  True once the terminator character
+ * (default '\r') is seen.
+ */
+bool SerialCommand::parse(char inChar) 
 {
-#ifdef SERIALCOMMAND_HARDWAREONLY
-  return (Serial.available() > 0);
-#else
-  return (((softSerial != 0) ? softSerial->available() : Serial.available()) > 0) 
-#endif
+  if(isprint(inChar))   // Only printable characters into the buffer
+  {
+    buffer[bufPos++] = toupper(inChar);   // Put character into buffer
+    buffer[bufPos]='\0';  // Null terminate
+    if(bufPos >= (sizeof(buffer)-1))
+      bufPos = 0; // wrap buffer around if full  
+    return false;
+  }
+  if(inChar != term) // Check for the terminator (default '\r') meaning end of command
+    return false;
+  bufPos = 0;           // Reset to start of buffer
+  return true;
 }
 
 /** 
- * Check the Serial stream for characters, and assemble them into a buffer.  
- * When the terminator character (default '\r') is seen, 
- * pars the buffer for a prefix command, and calls handlers setup in addCommand()
+ * Parse the buffer for a prefix command, and call the handler setup in addCommand()
  */
-void SerialCommand::readAndDispatch() 
+void SerialCommand::dispatch() 
 {
-  // If we're using the Hardware port, check it.   Otherwise check the user-created SoftwareSerial Port
-  while(available()) 
+  LOG_DEBUG(logSerial, "Received: %s", buffer);
+  char *token = strtok_r(buffer, delim, &last);   // Search for command at start of buffer
+  if(token != NULL)
   {
-    char inChar = 
-#ifdef SERIALCOMMAND_HARDWAREONLY
-      Serial.read();
-#else
-      (softSerial != 0) ? softSerial->read() : Serial.read();
-#endif
-    DEBUG_PRNT(inChar);   // Echo back to serial stream
-		if(isprint(inChar))   // Only printable characters into the buffer
-		{
-      buffer[bufPos++] = toupper(inChar);   // Put character into buffer
-      buffer[bufPos]='\0';  // Null terminate
-      if(bufPos >= (sizeof(buffer)-1))
-        bufPos = 0; // wrap buffer around if full  
-		}
-		else if (inChar == term) // Check for the terminator (default '\r') meaning end of command
-    {     
-      //process the command                  
-			DEBUG_PRINT("Received: "); DEBUG_PRNTLN(buffer);
-			bufPos = 0;           // Reset to start of buffer
-			char *token = strtok_r(buffer, delim, &last);   // Search for command at start of buffer
-			if (token == NULL) return; 
-      boolean matched = false;			
-			for(int i = 0; i < numCommand; i++) 
-      {
-				DEBUG_PRINT("Comparing ["); DEBUG_PRNT(token); DEBUG_PRINT("] to ["); DEBUG_PRNT(commandList[i].command); DEBUG_PRINTLN("]");
-				// Compare the found command against the list of known commands for a match
-				if(strncmp(token, commandList[i].command, sizeof(buffer) - 1) == 0) 
-				{
-					DEBUG_PRINT("Matched Command: "); DEBUG_PRNTLN(token);
-					// Execute the stored handler function for the command
-					(*commandList[i].function)(); 
-					matched = true; 
-					break; 
-				}
-			}
-			if(!matched) 
+    boolean matched = false;			
+    for(int i = 0; i < numCommand; i++) 
+    {
+      LOG_DEBUG(logSerial, "Comparing [%s] to command %d", token, i);
+      // Compare the found command against the list of known commands for a match
+      if(strncmp_P(token, commandList[i].command, sizeof(buffer) - 1) == 0) 
       {
-				(*defaultHandler)(); 
-			}
-			clearBuffer(); 
-		}
-	}
+        LOG_DEBUG(logSerial, "Matched Command: %s", token);
+        // Execute the stored handler function for the command
+        (*commandList[i].function)(); 
+        matched = true; 
+        break; 
+      }
+    }
+    if(!matched) 
+      (*defaultHandler)(token); 
+  }
+  clearBuffer(); 
 }
 
 /**
@@ -121,16 +99,16 @@ void SerialCommand::readAndDispatch()
  * This is used for matching a found token in the buffer, and gives the pointer
  * to the handler function to deal with it. 
  */
-bool SerialCommand::addCommand(const char *command, void (*function)())
+bool SerialCommand::addCommand(PGM_P command, void (*function)())
 {
   if(numCommand >= MAXSERIALCOMMANDS) 
   {
-    DEBUG_PRINTLN("Too many handlers - recompile changing MAXSERIALCOMMANDS"); 
+    LOG_ERROR(logSerial, "Too many handlers - recompile changing MAXSERIALCOMMANDS");
     return false;
   }
-  DEBUG_PRNT(numCommand); DEBUG_PRINT("-Adding command for "); DEBUG_PRNTLN(command);	
+  LOG_DEBUG(logSerial, "Adding command %d", numCommand);
   commandList[numCommand].command = command;
   commandList[numCommand].function = function; 
   numCommand++; 
   return true;
-}
+}
@@ -19,6 +19,8 @@ Oct 2013 - Conditional compilation for the SoftwareSerial support, in case you r
            hate it and want it removed.  
 May 2015 - Alex Sokolsky - improvements for readability and (my) style
            Make commands processing case-insensitive
+           Fed by the caller a character at a time, parsing and dispatch split,
+           SoftwareSerial support dropped
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -43,47 +45,27 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "WProgram.h"
 #endif
 
-// If you want to use SerialCommand with the hardware serial port only, and want to disable
-// SoftwareSerial support, and thus don't have to use "#include <SoftwareSerial.h>" in your
-// sketches, then uncomment this define for SERIALCOMMAND_HARDWAREONLY, and comment out the 
-// corresponding #undef line.  
-//
-// You don't have to use SoftwareSerial features if this is not defined, you can still only use 
-// the Hardware serial port, just that this way lets you get out of having to include 
-// the SoftwareSerial.h header. 
-#define SERIALCOMMAND_HARDWAREONLY 1
-//#undef SERIALCOMMAND_HARDWAREONLY
-
-#ifdef SERIALCOMMAND_HARDWAREONLY
-#warning "Warning: Building SerialCommand without SoftwareSerial Support"
-#endif
-
-#ifndef SERIALCOMMAND_HARDWAREONLY 
-#include <SoftwareSerial.h>  
-#endif
-
 #define MAXSERIALCOMMANDS	10
 
 class SerialCommand
 {
 public:
-#ifdef SERIALCOMMAND_HARDWAREONLY
   SerialCommand();
-#else
-  SerialCommand(SoftwareSerial *softSer=0);
-#endif
-
 
-  /** is there any input available? */
-  bool available();
-  /** Main entry point */
-  void readAndDispatch();
+  /**
+   * Main entry point, feed it a character at a time, e.g. from the RX ISR.
+   * True once a command is complete, it is to be dispatch()ed before any
+   * more characters are fed.
+   */
+  bool parse(char inChar);
+  /** call the handler of the complete command */
+  void dispatch();
   /** get the next token found in command buffer (for getting arguments to commands) */
   char *next();                                  
-  /**  Add commands to processing dictionary */
-  bool addCommand(const char *, void(*)());
-  /** A handler to call when no valid command received. */
-  void addDefaultHandler(void (*function)()) 
+  /**  Add commands to processing dictionary, the command is in flash, e.g. PSTR() */
+  bool addCommand(PGM_P, void(*)());
+  /** A handler to call when no valid command received, gets the command. */
+  void addDefaultHandler(void (*function)(const char *)) 
   {
     defaultHandler = function;
   }
@@ -96,15 +78,12 @@ private:
   char term = '\r';                   // Character that signals end of command (default '\r')
   char *last;                         // State variable used between calls to next()
   typedef struct _callback {
-    const char *command;
+    PGM_P command;
     void (*function)();
   } SerialCommandCallback;            // Data structure to hold Command/Handler function key-value pairs
   byte numCommand = 0;                // counter of meaningful elements in commandList
   SerialCommandCallback commandList[MAXSERIALCOMMANDS];   // Actual definition for command/handler array
-  void (*defaultHandler)();           // Pointer to the default handler function 
-#ifndef SERIALCOMMAND_HARDWAREONLY 
-  SoftwareSerial *softSerial;       // Pointer to a user-created SoftwareSerial object
-#endif
+  void (*defaultHandler)(const char *); // Pointer to the default handler function 
   /**
   * Initialize the command buffer
   */
@@ -0,0 +1,215 @@
+/**
+ * Fan stall detection and recovery, see StallMonitor.h
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "FanTest.h"
+#include "Config.h"
+#include "FanChar.h"
+#include "Channel.h"
+#include "TxQueue.h"
+#include "BinaryCommand.h"
+#include "StallMonitor.h"
+#include "Recorder.h"
+
+StallMonitor g_stallMonitor;
+
+/** stallXXX names, for the alarms and the stats */
+static const char g_stallStates[stallFailed + 1][11] PROGMEM = {
+  "ok", "suspect", "stalled", "recovering", "failed"
+};
+
+short int StallMonitor::fans()
+{
+  short int n = fansCount();
+  return (n > configFans) ? configFans : n;
+}
+
+void StallMonitor::run()
+{
+  // the fans are someone else's for now
+  if(g_fanTest.getResult() == testRunning || g_fanChar.isRunning())
+    return;
+  for(short int i = 0; i < fans(); i++)
+    if(g_fan[i].hasSensor())
+      run(i);
+}
+
+void StallMonitor::run(short int i)
+{
+  FanStall &s = m_fans[i];
+  Fan &f = g_fan[i];
+  unsigned long now = nowMillis();
+  if(s.state == stallKick)
+  {
+    if(now - s.ulSince < stallKickMs)
+      return;
+    // back to what the opmode wants
+    f.release();
+    s.ulGrace = now;
+    setState(i, stallRecovering);
+    return;
+  }
+  unsigned short pwm = f.getPWM();
+  bool bExpected = (pwm != 0 && pwm >= g_channels[i].getPwmMin());
+  if(!bExpected)
+  {
+    // it is not supposed to spin, nothing to worry about
+    s.bExpected = false;
+    s.bad = 0;
+    s.kicks = 0;
+    if(s.state != stallOk)
+      setState(i, stallOk);
+    return;
+  }
+  if(!s.bExpected)
+  {
+    // just started
+    s.bExpected = true;
+    s.ulGrace = now;
+  }
+  if(now - s.ulGrace < stallGraceMs)
+    return;
+  unsigned long rpm = f.getRPM();
+  bool bBad = (rpm == 0 || rpm < charRpm(i, pwm) / stallRpmDiv);
+  switch(s.state)
+  {
+    case stallOk:
+    case stallSuspect:
+      if(!bBad)
+      {
+        s.bad = 0;
+        if(s.state != stallOk)
+          setState(i, stallOk);
+        break;
+      }
+      if(s.bad++ == 0)
+      {
+        s.ulOnset = now;
+        if(rpm == 0)
+        {
+          // it stopped at the last tach edge, but not before we started looking
+          unsigned long ulWatch = s.ulGrace + stallGraceMs;
+          s.ulOnset = now - (nowMicros() - f.getLastEdgeUs()) / 1000;
+          if((long)(s.ulOnset - ulWatch) < 0)
+            s.ulOnset = ulWatch;
+        }
+        setState(i, stallSuspect);
+      }
+      if(s.bad < stallConfirm)
+        break;
+      s.ulStalls++;
+      s.uLatency = now - s.ulOnset;
+      if(s.uLatency > s.uLatencyMax)
+        s.uLatencyMax = s.uLatency;
+      LOG_WARN(logStall, "Fan %d stalled, latency %ums", i, s.uLatency);
+      kick(i);
+      break;
+    case stallRecovering:
+      if(!bBad)
+      {
+        s.kicks = 0;
+        s.bad = 0;
+        setState(i, stallOk);
+      }
+      else if(s.kicks < stallKicks)
+        kick(i);
+      else
+        setState(i, stallFailed);
+      break;
+    case stallFailed:
+      if(!bBad)
+      {
+        s.kicks = 0;
+        s.bad = 0;
+        setState(i, stallOk);
+      }
+      else if(now - s.ulSince >= stallRetryMs)
+        kick(i);
+      break;
+  }
+}
+
+void StallMonitor::kick(short int i)
+{
+  FanStall &s = m_fans[i];
+  if(s.kicks < stallKicks)
+    s.kicks++;
+  g_fan[i].override(Fan::pwmLimit);
+  setState(i, stallKick);
+}
+
+void StallMonitor::setState(short int i, byte state)
+{
+  FanStall &s = m_fans[i];
+  byte prev = s.state;
+  s.state = state;
+  s.ulSince = nowMillis();
+  // the host hears of the stall, the failure and the recovery, the kicks
+  // and the retries of a failed fan are not news
+  bool bWasOk = (prev == stallOk || prev == stallSuspect);
+  bool bIsOk = (state == stallOk || state == stallSuspect);
+  bool bFailed = (state == stallFailed && !s.bFailed);
+  if(bIsOk)
+    s.bFailed = false;
+  else if(bFailed)
+    s.bFailed = true;
+  if(bWasOk != bIsOk || bFailed)
+  {
+    alarm(i);
+    g_recorder.event(recEvStall, (i << 4) | state);
+  }
+  channelsUpdateLed();
+}
+
+void StallMonitor::alarm(short int i)
+{
+  FanStall &s = m_fans[i];
+  if(g_bc.isActive())
+  {
+    byte payload[] = { bcAlarm, (byte)i, s.state, (byte)s.uLatency, (byte)(s.uLatency >> 8) };
+    BinaryCommand::sendFrame(g_txResponse, payload, sizeof(payload));
+    return;
+  }
+  char buf[48];
+  sprintf_P(buf, PSTR("ALARM Fan%d %S, latency=%ums"), (int)i, g_stallStates[s.state], s.uLatency);
+  g_txResponse.println(buf);
+}
+
+byte StallMonitor::getAlarms()
+{
+  byte res = 0;
+  for(short int i = 0; i < fans(); i++)
+    if(m_fans[i].state != stallOk && m_fans[i].state != stallSuspect)
+      res |= (1 << i);
+  return res;
+}
+
+unsigned long StallMonitor::getStalls()
+{
+  unsigned long res = 0;
+  for(short int i = 0; i < fans(); i++)
+    res += m_fans[i].ulStalls;
+  return res;
+}
+
+unsigned int StallMonitor::getLatencyMax()
+{
+  unsigned int res = 0;
+  for(short int i = 0; i < fans(); i++)
+    if(m_fans[i].uLatencyMax > res)
+      res = m_fans[i].uLatencyMax;
+  return res;
+}
+
+void StallMonitor::dumpStats(Print &out, char buf[], short int i)
+{
+  if(i >= fans())
+    return;
+  const FanStall &s = m_fans[i];
+  sprintf_P(buf, PSTR("Fan%d stall: %S, stalls=%lu, kicks=%d"), (int)i, g_stallStates[s.state], s.ulStalls, (int)s.kicks);
+  out.print(buf);
+  sprintf_P(buf, PSTR(", latency=%u max=%u of %lums"), s.uLatency, s.uLatencyMax, stallLatencyMaxMs);
+  out.println(buf);
+}
@@ -0,0 +1,101 @@
+/**
+ * Continuous stall monitoring of the fans with a tach.
+ *
+ * A fan driven at or above its min PWM, see Channel::getPwmMin(), which
+ * reads 0 RPM, or under 1/stallRpmDiv of what its characterization says it
+ * does at this PWM, see FanChar.h, for stallConfirm samples in a row is
+ * stalled.  It is then kicked - driven at the max PWM for stallKickMs - and
+ * given back to its opmode.  Up to stallKicks kicks in a row, then the fan
+ * is failed and is kicked every stallRetryMs only.  A stall, a failure and
+ * a recovery are reported by an alarm: a text line or, with the binary
+ * protocol, a bcAlarm frame, see BinaryCommand.h.  The retries of a failed
+ * fan are not.  The LED is on while any fan is not OK.
+ *
+ * A fan is not looked at for stallGraceMs after it is started or kicked,
+ * nor while it is overridden by the self-test or the characterization.
+ *
+ * Detection latency is from the last tach edge - or the first implausibly
+ * low RPM - to the detection.  It is at most stallLatencyMaxMs, plus the
+ * task lateness, see Scheduler.h.
+ */
+#pragma once
+
+/** per fan states, also the alarm codes */
+const byte stallOk = 0;
+/** bad RPM seen, not confirmed yet */
+const byte stallSuspect = 1;
+/** being kicked */
+const byte stallKick = 2;
+/** kicked, will it spin? */
+const byte stallRecovering = 3;
+/** kicks did not help */
+const byte stallFailed = 4;
+
+/** how often the tachs are looked at, ms */
+const unsigned long stallPeriod = 100;
+/** # of bad samples in a row to call it a stall */
+const byte stallConfirm = 3;
+/** RPM under 1/stallRpmDiv of the expected one is implausible */
+const byte stallRpmDiv = 4;
+/** a fan which was just started or kicked is left alone for this long, ms */
+const unsigned long stallGraceMs = 3000;
+/** max PWM kick duration, ms */
+const unsigned long stallKickMs = 1000;
+/** # of kicks in a row before the fan is failed */
+const byte stallKicks = 3;
+/** failed fan is kicked this often, ms */
+const unsigned long stallRetryMs = 30000;
+/** 0 RPM takes the tach timeout, then stallConfirm samples */
+const unsigned long stallLatencyMaxMs = fanTachTimeoutUs / 1000 + stallConfirm * stallPeriod;
+
+struct FanStall
+{
+  /** stallXXX */
+  byte state;
+  /** # of bad samples in a row */
+  byte bad;
+  /** # of kicks in a row */
+  byte kicks;
+  /** was the fan expected to spin at the last sample? */
+  bool bExpected;
+  /** failed and alarmed, until it is OK again */
+  bool bFailed;
+  /** nowMillis() the state or the grace period started at */
+  unsigned long ulSince;
+  unsigned long ulGrace;
+  /** nowMillis() the stall started at */
+  unsigned long ulOnset;
+  /** # of stalls detected */
+  unsigned long ulStalls;
+  /** detection latency, last and max, ms */
+  unsigned int uLatency;
+  unsigned int uLatencyMax;
+};
+
+class StallMonitor
+{
+public:
+  /** the stall task body, once per stallPeriod */
+  void run();
+  /** bit mask of the fans which are not OK */
+  byte getAlarms();
+  /** # of stalls detected, all the fans */
+  unsigned long getStalls();
+  /** max detection latency, all the fans, ms */
+  unsigned int getLatencyMax();
+  /** print stats of fan i */
+  void dumpStats(Print &out, char buf[], short int i);
+
+private:
+  FanStall m_fans[configFans];
+
+  /** # of fans monitored */
+  short int fans();
+  void run(short int i);
+  void kick(short int i);
+  void setState(short int i, byte state);
+  /** report fan i state */
+  void alarm(short int i);
+};
+
+extern StallMonitor g_stallMonitor;
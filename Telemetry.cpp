@@ -0,0 +1,67 @@
+/**
+ * Push mode telemetry, see Telemetry.h for the record format
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "LM35.h"
+#include "OperationalMode.h"
+#include "Scheduler.h"
+#include "BinaryCommand.h"
+#include "Telemetry.h"
+
+Telemetry g_telemetry;
+
+/** little-endian 16 bit value */
+static byte *put16(byte *p, unsigned int value)
+{
+  p[0] = (byte)value;
+  p[1] = (byte)(value >> 8);
+  return p + 2;
+}
+
+bool Telemetry::setPeriod(unsigned long period)
+{
+  if(period != 0 && (period < telPeriodMin || period > telPeriodMax))
+    return false;
+  m_ulPeriod = period;
+  g_scheduler.setPeriod(taskTelemetry, period);
+  return true;
+}
+
+void Telemetry::send()
+{
+  // header, 2 temperatures, PWM and RPM for up to 3 fans, opmode, loop
+  byte buf[5 + 4 + 3 * 4 + 1 + 4];
+  byte *p = buf;
+  *p++ = bcTelemetry;
+  *p++ = m_seq++;
+  *p++ = m_channels;
+  p = put16(p, (unsigned int)nowMillis());
+  if(m_channels & telTempLM35)
+    p = put16(p, g_lm35.readDeci());
+  if(m_channels & telTemp)
+    p = put16(p, g_channels[0].getTemp());
+  short int iFans = fansCount();
+  if(iFans > 3)
+    iFans = 3;
+  if(m_channels & telPWM)
+    for(short int i = 0; i < iFans; i++)
+      p = put16(p, g_fan[i].getPWM());
+  if(m_channels & telRPM)
+    for(short int i = 0; i < iFans; i++)
+    {
+      unsigned long rpm = g_fan[i].getRPM();
+      p = put16(p, (rpm > 0xFFFF) ? 0xFFFF : (unsigned int)rpm);
+    }
+  if(m_channels & telOpMode)
+    *p++ = (byte)g_channels[0].getOpModeId();
+  if(m_channels & telLoop)
+  {
+    p = put16(p, g_tasks[taskControl].maxExecUs);
+    p = put16(p, g_scheduler.getOverruns());
+  }
+  // never block on the serial port, the host sees the gap in seq
+  if(!BinaryCommand::sendFrame(g_txTelemetry, buf, p - buf))
+    m_ulDrops++;
+}
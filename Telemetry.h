@@ -0,0 +1,73 @@
+/**
+ * Push mode telemetry: the host picks the channels and the period, then the
+ * controller streams fixed size records without being polled.
+ *
+ * A record goes out in a binary frame, see BinaryCommand.h, whatever the
+ * protocol, with the payload:
+ *   bcTelemetry, seq, channels, ms (2 bytes), channel values
+ * seq counts the records so that the host can tell the dropped ones, ms is
+ * the low 16 bits of nowMillis().  Channel values are little-endian in the
+ * order of the telXXX bits below, those with a value per fan have
+ * fansCount() of them.
+ *
+ * Only the values already measured are sent - nothing here is allowed to
+ * disturb a measurement.  Records are queued as telemetry class output, see
+ * TxQueue.h, one which does not fit is dropped rather than block the control
+ * path.
+ */
+#pragma once
+
+/** LM35 reading in tenths of C, 2 bytes */
+const byte telTempLM35 = 0x01;
+/** C the first channel opmode works with, 2 bytes */
+const byte telTemp = 0x02;
+/** PWM, 2 bytes per fan */
+const byte telPWM = 0x04;
+/** RPM, 2 bytes per fan */
+const byte telRPM = 0x08;
+/** first channel opmode, 1 byte */
+const byte telOpMode = 0x10;
+/** control task max execution time in us and all the tasks overruns, 2 bytes each */
+const byte telLoop = 0x20;
+const byte telAll = 0x3F;
+
+/** fastest record period, ms */
+const unsigned long telPeriodMin = 20;
+/** slowest record period, ms */
+const unsigned long telPeriodMax = 30000;
+
+class Telemetry
+{
+public:
+  /** telXXX bits */
+  byte getChannels()
+  {
+    return m_channels;
+  }
+  void setChannels(byte channels)
+  {
+    m_channels = channels & telAll;
+  }
+  /** ms between the records, 0 if off */
+  unsigned long getPeriod()
+  {
+    return m_ulPeriod;
+  }
+  /** 0 or telPeriodMin..telPeriodMax, returns false for anything else */
+  bool setPeriod(unsigned long period);
+  /** send a record, the telemetry task body */
+  void send();
+  /** # of records dropped because the link was busy */
+  unsigned long getDrops()
+  {
+    return m_ulDrops;
+  }
+
+private:
+  byte m_channels = telAll;
+  unsigned long m_ulPeriod = 0;
+  byte m_seq = 0;
+  unsigned long m_ulDrops = 0;
+};
+
+extern Telemetry g_telemetry;
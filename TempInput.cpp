@@ -0,0 +1,161 @@
+/**
+ * Temperature inputs fusion, see TempInput.h
+ */
+#include <Arduino.h>
+#define LOG_LEVEL logWarn
+#include "Trace.h"
+#include "Fan.h"
+#include "TempInput.h"
+
+TempInputs g_tempInputs;
+
+TempInput *TempInputs::find(const char *name)
+{
+  for(byte i = 0; i < tempInputsMax; i++)
+    if(m_inputs[i].name[0] != 0 && strcmp(m_inputs[i].name, name) == 0)
+      return &m_inputs[i];
+  return 0;
+}
+
+bool TempInputs::put(const char *name, short int temp, unsigned long ulAge)
+{
+  // a truncated name would merge inputs, e.g. cpu_pkg0 and cpu_pkg1
+  if(name[0] == 0 || strlen(name) >= tempNameMax)
+    return false;
+  TempInput *p = find(name);
+  for(byte i = 0; p == 0 && i < tempInputsMax; i++)
+  {
+    if(m_inputs[i].name[0] != 0)
+      continue;
+    // new one, drives all the channels
+    p = &m_inputs[i];
+    memset(p, 0, sizeof(*p));
+    strcpy(p->name, name);
+    p->weight = 1;
+    p->channels = 0xFF;
+    LOG_INFO(logTemp, "New temp input %s", p->name);
+  }
+  if(p == 0)
+    return false;
+  TempReading &r = p->readings[p->head];
+  r.ulTime = nowMillis() - ulAge;
+  r.temp = temp;
+  if(++p->head >= tempHistory)
+    p->head = 0;
+  if(p->count < tempHistory)
+    p->count++;
+  return true;
+}
+
+bool TempInputs::remove(const char *name)
+{
+  TempInput *p = find(name);
+  if(p == 0)
+    return false;
+  p->name[0] = 0;
+  return true;
+}
+
+bool TempInputs::configure(const char *name, byte weight, byte channels)
+{
+  TempInput *p = find(name);
+  if(p == 0)
+    return false;
+  p->weight = weight;
+  p->channels = channels;
+  return true;
+}
+
+bool TempInputs::median(const TempInput &in, unsigned long now, short int &temp)
+{
+  // insertion sort of the fresh ones, there are only a handful
+  short int temps[tempHistory];
+  byte n = 0;
+  for(byte i = 0; i < in.count; i++)
+  {
+    const TempReading &r = in.readings[i];
+    if(now - r.ulTime > m_ulStaleMs)
+      continue;
+    byte j = n++;
+    for(; j > 0 && temps[j - 1] > r.temp; j--)
+      temps[j] = temps[j - 1];
+    temps[j] = r.temp;
+  }
+  if(n == 0)
+    return false;
+  // the lower one of the two in the middle if n is even
+  temp = temps[(n - 1) / 2];
+  return true;
+}
+
+bool TempInputs::fuse(byte channel, short int &temp)
+{
+  unsigned long now = nowMillis();
+  bool bFound = false;
+  long sum = 0;
+  unsigned int weights = 0;
+  for(byte i = 0; i < tempInputsMax; i++)
+  {
+    const TempInput &in = m_inputs[i];
+    short int t;
+    if(in.name[0] == 0 || !median(in, now, t))
+      continue;
+    if(m_mode == fuseMean)
+    {
+      sum += (long)in.weight * t;
+      weights += in.weight;
+      continue;
+    }
+    if(m_mode == fuseChannel && (in.channels & (1 << channel)) == 0)
+      continue;
+    if(!bFound || t > temp)
+      temp = t;
+    bFound = true;
+  }
+  if(m_mode != fuseMean)
+    return bFound;
+  if(weights == 0)
+    return false;
+  // rounded, also for the negative ones
+  temp = (sum >= 0) ? (sum + weights / 2) / weights : (sum - weights / 2) / (long)weights;
+  return true;
+}
+
+byte TempInputs::getFresh()
+{
+  unsigned long now = nowMillis();
+  byte res = 0;
+  for(byte i = 0; i < tempInputsMax; i++)
+  {
+    short int t;
+    if(m_inputs[i].name[0] != 0 && median(m_inputs[i], now, t))
+      res++;
+  }
+  return res;
+}
+
+void TempInputs::dumpStats(Print &out, char buf[])
+{
+  static const char modes[][8] PROGMEM = { "max", "mean", "channel" };
+  sprintf_P(buf, PSTR("Temp inputs: fusion=%S, stale=%lums, fresh=%d"), modes[m_mode], m_ulStaleMs, (int)getFresh());
+  out.println(buf);
+}
+
+void TempInputs::dumpStats(Print &out, char buf[], byte i)
+{
+  const TempInput &in = m_inputs[i];
+  if(in.name[0] == 0)
+    return;
+  unsigned long now = nowMillis();
+  byte last = (in.head == 0) ? (tempHistory - 1) : (in.head - 1);
+  const TempReading &r = in.readings[last];
+  short int t;
+  bool bFresh = median(in, now, t);
+  sprintf_P(buf, PSTR("Temp %s: last=%d age=%lums median="), in.name, (int)r.temp, now - r.ulTime);
+  out.print(buf);
+  if(bFresh)
+    sprintf_P(buf, PSTR("%d, weight=%d, channels=0x%x"), (int)t, (int)in.weight, (int)in.channels);
+  else
+    sprintf_P(buf, PSTR("stale, weight=%d, channels=0x%x"), (int)in.weight, (int)in.channels);
+  out.println(buf);
+}
@@ -0,0 +1,106 @@
+/**
+ * Named temperature inputs supplied over serial, e.g. by a host reading its
+ * drives and CPU packages, fused into the temperature the channels in the
+ * externally measured temperature opmode work with.
+ *
+ * An input is created by its first reading and keeps the last tempHistory
+ * readings with their timestamps in a ring, nothing is allocated.  Readings
+ * older than the staleness limit are ignored, an input with none left is
+ * stale.  The value of an input is the median of its fresh readings, so
+ * that a single spike is rejected.  The fresh inputs are then combined:
+ *   fuseMax     - the hottest one,
+ *   fuseMean    - weighted mean, by the input weight,
+ *   fuseChannel - the hottest of those with the channel bit in the input
+ *                 channels mask, per channel.
+ * With no fresh inputs for a channel it falls back to what was SET TEMP.
+ */
+#pragma once
+
+/** max # of inputs */
+const byte tempInputsMax = 8;
+/** max input name length, incl. the terminating 0 */
+const byte tempNameMax = 8;
+/** readings kept per input, i.e. k of the median-of-k, 3 is enough to reject a spike */
+const byte tempHistory = 3;
+/** readings older than this are stale by default, ms */
+const unsigned long tempStaleMsDefault = 10000;
+
+/** how the inputs are combined */
+const byte fuseMax = 0;
+const byte fuseMean = 1;
+const byte fuseChannel = 2;
+
+struct TempReading
+{
+  /** nowMillis() the reading was taken at */
+  unsigned long ulTime;
+  /** in C */
+  short int temp;
+};
+
+struct TempInput
+{
+  /** empty if the slot is free */
+  char name[tempNameMax];
+  /** in fuseMean, 0 to leave it out */
+  byte weight;
+  /** bit mask of the channels it drives in fuseChannel */
+  byte channels;
+  /** # of readings in the ring */
+  byte count;
+  /** where the next reading goes */
+  byte head;
+  TempReading readings[tempHistory];
+};
+
+class TempInputs
+{
+public:
+  /**
+   * Reading of the named input taken ulAge ms ago, the input is created if
+   * there is no such.  False if the name is longer than tempNameMax - 1 or
+   * there is no room for it.
+   */
+  bool put(const char *name, short int temp, unsigned long ulAge);
+  /** forget the input, false if there is no such */
+  bool remove(const char *name);
+  /** fuseMean weight and fuseChannel channels mask, false if there is no such */
+  bool configure(const char *name, byte weight, byte channels);
+  /** the fused temperature for this channel, false if no input is fresh */
+  bool fuse(byte channel, short int &temp);
+  /** fuseXXX */
+  byte getMode()
+  {
+    return m_mode;
+  }
+  void setMode(byte mode)
+  {
+    m_mode = mode;
+  }
+  unsigned long getStaleMs()
+  {
+    return m_ulStaleMs;
+  }
+  void setStaleMs(unsigned long ms)
+  {
+    m_ulStaleMs = ms;
+  }
+  /** # of fresh inputs */
+  byte getFresh();
+  /** print the fusion settings */
+  void dumpStats(Print &out, char buf[]);
+  /** print input i, nothing if the slot is free */
+  void dumpStats(Print &out, char buf[], byte i);
+
+private:
+  byte m_mode = fuseMax;
+  unsigned long m_ulStaleMs = tempStaleMsDefault;
+  TempInput m_inputs[tempInputsMax];
+
+  /** input by its name, 0 if none */
+  TempInput *find(const char *name);
+  /** median of the fresh readings, false if there are none */
+  bool median(const TempInput &in, unsigned long now, short int &temp);
+};
+
+extern TempInputs g_tempInputs;
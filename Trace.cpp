@@ -0,0 +1,72 @@
+/**
+ * Structured logging, see Trace.h for the record format
+ */
+#include <Arduino.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "TxQueue.h"
+#include "BinaryCommand.h"
+
+unsigned int g_logMask = logModulesAll;
+
+/** record counter */
+static byte g_logSeq = 0;
+
+LogRecord::LogRecord(unsigned int id)
+{
+  unsigned int ms = (unsigned int)nowMillis();
+  m_buf[0] = bcLog;
+  m_buf[1] = g_logSeq++;
+  m_buf[2] = (byte)id;
+  m_buf[3] = (byte)(id >> 8);
+  m_buf[4] = (byte)ms;
+  m_buf[5] = (byte)(ms >> 8);
+  m_len = 6;
+  m_bFull = false;
+}
+
+void LogRecord::send()
+{
+  // lowest priority output, dropped first
+  BinaryCommand::sendFrame(g_txDebug, m_buf, m_len);
+}
+
+void LogRecord::addUnsigned(unsigned long value)
+{
+  // all of it or none
+  byte n = 1;
+  for(unsigned long v = value; v >= 0x80; v >>= 7)
+    n++;
+  if(m_bFull || m_len + n > logRecordMax)
+  {
+    m_bFull = true;
+    return;
+  }
+  while(value >= 0x80)
+  {
+    m_buf[m_len++] = (byte)value | 0x80;
+    value >>= 7;
+  }
+  m_buf[m_len++] = (byte)value;
+}
+
+void LogRecord::addSigned(long value)
+{
+  addUnsigned((value < 0) ? ((unsigned long)(-(value + 1)) * 2 + 1) : ((unsigned long)value * 2));
+}
+
+void LogRecord::add(const char *s)
+{
+  if(s == 0)
+    s = "";
+  if(m_bFull || m_len + 1 > logRecordMax)
+  {
+    m_bFull = true;
+    return;
+  }
+  byte len = 0;
+  byte *pLen = &m_buf[m_len++];
+  while(s[len] != 0 && m_len < logRecordMax)
+    m_buf[m_len++] = s[len++];
+  *pLen = len;
+}
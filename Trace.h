@@ -1,29 +1,149 @@
 /**
- * DEBUG utils
+ * Structured logging.
+ *
+ * LOG_ERROR(module, "format", args...), LOG_WARN, LOG_INFO and LOG_DEBUG
+ * send a log record rather than the text: the message ID - a 16 bit hash of
+ * the format string, computed at compile time, the string itself does not
+ * make it into the firmware - and the arguments as varints, see LogRecord.
+ * A record is a bcLog frame, see BinaryCommand.h, queued as debug class
+ * output, see TxQueue.h, whatever the protocol.  It takes 10 bytes or so on
+ * the line.  host/log/fclog renders the records, it is generated from the
+ * format strings in the sources, see host/log/loggen.cpp.
+ *
+ * Formats take %d, %i, %u, %x, %X, each optionally with l, %c and %s.
+ * Whatever the C type of an argument, its value is sent, so the format
+ * only has to tell signed from unsigned.
+ *
+ * Messages of levels above LOG_LEVEL and of modules not in the LOG_MODULES
+ * bit mask are compiled out, at run time g_logMask - `SET LOG_MASK` - turns
+ * the modules off and on.  Not to be used from ISRs.
  */
 #ifndef TRACE_h
 #define TRACE_h
 
-#ifndef NODEBUG
-#define DEBUG 1
-#endif
+/** levels */
+const byte logError = 0;
+const byte logWarn = 1;
+const byte logInfo = 2;
+const byte logDebug = 3;
+
+/** modules, bit numbers in the masks */
+const byte logSketch = 0;
+const byte logSerial = 1;
+const byte logFan = 2;
+const byte logOpMode = 3;
+const byte logConfig = 4;
+const byte logTest = 5;
+const byte logStall = 6;
+const byte logTemp = 7;
+const byte logAdc = 8;
+const unsigned int logModulesAll = 0x01FF;
 
-#ifdef DEBUG
-  #define DEBUG_PRINT(x)    Serial.print(F(x))
-  #define DEBUG_PRNT(x)     Serial.print(x)
-  #define DEBUG_PRINTDEC(x) Serial.print(x, DEC)
-  #define DEBUG_PRINTHEX(x) Serial.print(x, HEX)
-  #define DEBUG_PRNTLN(x)   Serial.println(x)
-  #define DEBUG_PRINTLN(x)  Serial.println(F(x))
+#ifndef LOG_LEVEL
+#ifdef NODEBUG
+#define LOG_LEVEL logWarn
 #else
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRNT(x)
-  #define DEBUG_PRINTDEC(x)
-  #define DEBUG_PRINTHEX(x)
-  #define DEBUG_PRNTLN(x)
-  #define DEBUG_PRINTLN(x)
-#endif 
+#define LOG_LEVEL logDebug
+#endif
+#endif
+#ifndef LOG_MODULES
+#define LOG_MODULES logModulesAll
+#endif
 
-#endif //TRACE_h
+/** modules logging at run time */
+extern unsigned int g_logMask;
+
+/** max record payload, same as bcMaxPayload */
+const byte logRecordMax = 40;
+
+/** FNV-1a of the format string folded to 16 bits, loggen does the same */
+constexpr unsigned long logFnv(const char *s, unsigned long h)
+{
+  return (*s == 0) ? h : logFnv(s + 1, ((h ^ (byte)*s) * 16777619UL) & 0xFFFFFFFFUL);
+}
+constexpr unsigned int logHash(const char *s)
+{
+  return (unsigned int)((logFnv(s, 2166136261UL) ^ (logFnv(s, 2166136261UL) >> 16)) & 0xFFFF);
+}
+/** forces the hash to be computed at compile time */
+template<unsigned int id> struct LogId
+{
+  static const unsigned int value = id;
+};
+
+constexpr bool logCompiled(byte level, byte module)
+{
+  return (level <= LOG_LEVEL) && ((LOG_MODULES >> module) & 1);
+}
 
+/**
+ * Record payload: bcLog, seq, ID (2 bytes), ms (2 bytes), arguments.
+ * seq counts the records so that the dropped ones can be told, ms is the
+ * low 16 bits of nowMillis().  An integer argument is a LEB128 varint,
+ * zigzag encoded if signed, a string is its length and the chars.
+ * A string which does not fit is cut short, an integer which does not fit
+ * is dropped along with all the arguments after it.
+ */
+class LogRecord
+{
+public:
+  LogRecord(unsigned int id);
+  /** queue the record */
+  void send();
+
+  void put()
+  {
+  }
+  template<typename T, typename... Args> void put(T value, Args... args)
+  {
+    add(value);
+    put(args...);
+  }
+
+private:
+  byte m_buf[logRecordMax];
+  byte m_len;
+  /** an argument was dropped, the rest are too lest they are taken for it */
+  bool m_bFull;
+
+  void addSigned(long value);
+  void addUnsigned(unsigned long value);
+  void add(const char *s);
+  void add(char *s)
+  {
+    add((const char *)s);
+  }
+  /** %c, signed or not it is sent as is */
+  void add(char c)
+  {
+    addUnsigned((byte)c);
+  }
+  template<typename T> void add(T value)
+  {
+    if((T)-1 < (T)0)
+      addSigned((long)value);
+    else
+      addUnsigned((unsigned long)value);
+  }
+};
 
+template<typename... Args> void logWrite(unsigned int id, Args... args)
+{
+  LogRecord r(id);
+  r.put(args...);
+  r.send();
+}
+
+#define LOG_AT(level, module, fmt, ...) \
+  do \
+  { \
+    if(logCompiled(level, module) && ((g_logMask >> (module)) & 1)) \
+      logWrite(LogId<logHash(fmt)>::value, ##__VA_ARGS__); \
+  } while(0)
+
+#define LOG_ERROR(module, fmt, ...) LOG_AT(logError, module, fmt, ##__VA_ARGS__)
+#define LOG_WARN(module, fmt, ...)  LOG_AT(logWarn, module, fmt, ##__VA_ARGS__)
+#define LOG_INFO(module, fmt, ...)  LOG_AT(logInfo, module, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(module, fmt, ...) LOG_AT(logDebug, module, fmt, ##__VA_ARGS__)
+
+#endif //TRACE_h
@@ -0,0 +1,134 @@
+/**
+ * Non-blocking serial output, see TxQueue.h
+ */
+#include <Arduino.h>
+#include "TxQueue.h"
+#include "Usart.h"
+
+static byte g_txResponseBuf[txResponseSize];
+static byte g_txTelemetryBuf[txTelemetrySize];
+static byte g_txDebugBuf[txDebugSize];
+TxChannel g_txResponse(g_txResponseBuf, txResponseSize);
+TxChannel g_txTelemetry(g_txTelemetryBuf, txTelemetrySize);
+TxChannel g_txDebug(g_txDebugBuf, txDebugSize);
+
+static TxChannel *g_txChannels[] = { &g_txResponse, &g_txTelemetry, &g_txDebug };
+TxQueue g_tx(g_txChannels, sizeof(g_txChannels) / sizeof(g_txChannels[0]));
+
+size_t TxChannel::write(uint8_t b)
+{
+  if(m_bDropping)
+  {
+    m_ulDroppedBytes++;
+    if(b == '\n')
+      m_bDropping = false;
+    return 1;
+  }
+  if(!m_bOpen)
+  {
+    if(room() < 2)
+    {
+      // no room even for the length and this byte
+      m_ulDroppedMessages++;
+      m_ulDroppedBytes++;
+      m_bDropping = (b != '\n');
+      return 1;
+    }
+    m_msgStart = m_head;
+    put(0);
+    m_msgLen = 0;
+    m_bOpen = true;
+  }
+  if(room() < 1 || m_msgLen == 0xFF)
+  {
+    drop();
+    m_ulDroppedBytes++;
+    m_bDropping = (b != '\n');
+    return 1;
+  }
+  put(b);
+  m_msgLen++;
+  if(b == '\n')
+    commit();
+  return 1;
+}
+
+bool TxChannel::writeMessage(const byte *p, byte len)
+{
+  // a partial text line goes out first, as a message of its own
+  if(m_bOpen)
+    commit();
+  if(len == 0)
+    return true;
+  if(room() < len + 1)
+  {
+    m_ulDroppedMessages++;
+    m_ulDroppedBytes += len;
+    return false;
+  }
+  m_msgStart = m_head;
+  put(len);
+  for(byte i = 0; i < len; i++)
+    put(p[i]);
+  m_committed = m_head;
+  return true;
+}
+
+int TxChannel::availableForWrite()
+{
+  unsigned short n = room();
+  if(!m_bOpen)
+    n = (n > 0) ? (n - 1) : 0;
+  return n;
+}
+
+void TxChannel::commit()
+{
+  m_buf[m_msgStart] = m_msgLen;
+  m_committed = m_head;
+  m_bOpen = false;
+}
+
+void TxChannel::drop()
+{
+  m_ulDroppedMessages++;
+  m_ulDroppedBytes += m_msgLen;
+  m_head = m_msgStart;
+  m_bOpen = false;
+}
+
+void TxQueue::pump()
+{
+  int room = g_usart.availableForWrite();
+  while(room > 0)
+  {
+    if(m_pCur == 0)
+    {
+      // next message, highest priority first
+      for(byte i = 0; i < m_numChannels && m_pCur == 0; i++)
+        if(m_channels[i]->m_tail != m_channels[i]->m_committed)
+          m_pCur = m_channels[i];
+      if(m_pCur == 0)
+        return;
+      m_sendLeft = m_pCur->m_buf[m_pCur->m_tail];
+      m_pCur->m_tail = m_pCur->next(m_pCur->m_tail);
+    }
+    while(room > 0 && m_sendLeft > 0)
+    {
+      g_usart.write(m_pCur->m_buf[m_pCur->m_tail]);
+      m_pCur->m_tail = m_pCur->next(m_pCur->m_tail);
+      m_sendLeft--;
+      room--;
+    }
+    if(m_sendLeft == 0)
+      m_pCur = 0;
+  }
+}
+
+bool TxQueue::isEmpty()
+{
+  for(byte i = 0; i < m_numChannels; i++)
+    if(m_channels[i]->m_tail != m_channels[i]->m_committed)
+      return false;
+  return m_pCur == 0;
+}
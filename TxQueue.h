@@ -0,0 +1,123 @@
+/**
+ * Non-blocking serial output.
+ *
+ * Output is queued in RAM per priority class: responses to the host, then
+ * telemetry, then debug.  pump() moves it to the serial port TX buffer only
+ * as fast as the port takes it, highest class first and a whole message at a
+ * time, so that printing never waits for the wire.  A class which runs out
+ * of room drops its new messages whole and counts them, the other classes
+ * are not affected.
+ *
+ * A text message ends with '\n', a binary one is queued with writeMessage().
+ * Messages are stored length prefixed, up to 255 bytes each.
+ */
+#pragma once
+
+/** queue sizes in bytes, incl. a length byte per message */
+const unsigned short txResponseSize = 128;
+const unsigned short txTelemetrySize = 128;
+const unsigned short txDebugSize = 64;
+
+class TxChannel : public Print
+{
+public:
+  TxChannel(byte *buf, unsigned short size) :
+    m_buf(buf), m_size(size)
+  {
+  }
+  size_t write(uint8_t b);
+  using Print::write;
+  /** queue this as a message of its own, e.g. a binary frame.  False if dropped. */
+  bool writeMessage(const byte *p, byte len);
+  /** room for the message being written */
+  int availableForWrite();
+  /** nothing queued? */
+  bool isEmpty()
+  {
+    return m_tail == m_head;
+  }
+  /** dropped so far */
+  unsigned long getDroppedBytes()
+  {
+    return m_ulDroppedBytes;
+  }
+  unsigned long getDroppedMessages()
+  {
+    return m_ulDroppedMessages;
+  }
+
+private:
+  friend class TxQueue;
+
+  byte *m_buf;
+  unsigned short m_size;
+  /** where the next byte goes */
+  unsigned short m_head = 0;
+  /** next byte to send */
+  unsigned short m_tail = 0;
+  /** end of the complete messages, pump() does not go past it */
+  unsigned short m_committed = 0;
+  /** where the length of the message being written goes */
+  unsigned short m_msgStart = 0;
+  /** length of the message being written */
+  byte m_msgLen = 0;
+  /** a message is being written */
+  bool m_bOpen = false;
+  /** the rest of the message being written is to be dropped */
+  bool m_bDropping = false;
+  unsigned long m_ulDroppedBytes = 0;
+  unsigned long m_ulDroppedMessages = 0;
+
+  unsigned short next(unsigned short i)
+  {
+    return (i + 1 == m_size) ? 0 : (i + 1);
+  }
+  /** free bytes in the ring */
+  unsigned short room()
+  {
+    unsigned short used = (m_head >= m_tail) ? (m_head - m_tail) : (m_size - m_tail + m_head);
+    return m_size - 1 - used;
+  }
+  /** put a byte, there has to be room */
+  void put(byte b)
+  {
+    m_buf[m_head] = b;
+    m_head = next(m_head);
+  }
+  /** the message being written is complete */
+  void commit();
+  /** undo the message being written */
+  void drop();
+};
+
+/**
+ * Moves the queued messages to the serial port
+ */
+class TxQueue
+{
+public:
+  TxQueue(TxChannel **channels, byte numChannels) :
+    m_channels(channels), m_numChannels(numChannels)
+  {
+  }
+  /** send what the serial port TX buffer can take now, never blocks */
+  void pump();
+  /** all sent to the serial port? */
+  bool isEmpty();
+
+private:
+  /** in priority order */
+  TxChannel **m_channels;
+  byte m_numChannels;
+  /** channel whose message is being sent, 0 if none */
+  TxChannel *m_pCur = 0;
+  /** bytes of it left to send */
+  byte m_sendLeft = 0;
+};
+
+/** priority classes, highest first */
+extern TxChannel g_txResponse;
+extern TxChannel g_txTelemetry;
+extern TxChannel g_txDebug;
+/** all of them */
+extern TxQueue g_tx;
@@ -0,0 +1,136 @@
+/**
+ * Interrupt driven USART0, see Usart.h
+ */
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "Trace.h"
+#include "Fan.h"
+#include "Scheduler.h"
+#include "Usart.h"
+
+Usart g_usart;
+
+ISR(USART_RX_vect)
+{
+  g_usart.onRx();
+}
+
+ISR(USART_UDRE_vect)
+{
+  g_usart.onTxEmpty();
+}
+
+void Usart::begin(unsigned long baud, Parser parser)
+{
+  m_parser = parser;
+  // double speed, same as the Arduino core, for less of a baud rate error
+  UCSR0A |= _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+int Usart::availableForWrite()
+{
+  byte head = m_txHead;
+  byte tail = m_txTail;
+  byte used = (head >= tail) ? (head - tail) : (usartTxSize - tail + head);
+  return usartTxSize - 1 - used;
+}
+
+void Usart::write(byte b)
+{
+  byte next = (m_txHead + 1) % usartTxSize;
+  if(next == m_txTail)
+    return;
+  m_tx[m_txHead] = b;
+  m_txHead = next;
+  UCSR0B |= _BV(UDRIE0);
+}
+
+void Usart::onTxEmpty()
+{
+  if(m_txHead == m_txTail)
+  {
+    UCSR0B &= ~_BV(UDRIE0);
+    return;
+  }
+  UDR0 = m_tx[m_txTail];
+  m_txTail = (m_txTail + 1) % usartTxSize;
+}
+
+void Usart::hold()
+{
+  m_ulRequestUs = nowMicros();
+  m_bHeld = true;
+  g_scheduler.signal(taskSerial);
+}
+
+void Usart::onRx()
+{
+  bool bOverrun = (UCSR0A & _BV(DOR0)) != 0;
+  byte b = UDR0;
+  if(bOverrun)
+    m_ulRxDropped++;
+  if(!m_bHeld)
+  {
+    if((*m_parser)(b))
+      hold();
+    return;
+  }
+  byte next = (m_rxHead + 1) % usartRxSize;
+  if(next == m_rxTail)
+  {
+    m_ulRxDropped++;
+    return;
+  }
+  m_rx[m_rxHead] = b;
+  m_rxHead = next;
+}
+
+void Usart::release()
+{
+  unsigned long ulLatency = nowMicros() - m_ulRequestUs;
+  m_ulRequests++;
+  m_ulLatencyLast = ulLatency;
+  m_ulLatencySum += ulLatency;
+  if(ulLatency > m_ulLatencyMax)
+    m_ulLatencyMax = ulLatency;
+  // the ISR keeps adding to the ring for as long as we are held
+  for(;;)
+  {
+    cli();
+    if(m_rxTail == m_rxHead)
+    {
+      m_bHeld = false;
+      sei();
+      return;
+    }
+    byte b = m_rx[m_rxTail];
+    m_rxTail = (m_rxTail + 1) % usartRxSize;
+    sei();
+    if((*m_parser)(b))
+    {
+      // still held, taskSerial is at it anyway
+      m_ulRequestUs = nowMicros();
+      return;
+    }
+  }
+}
+
+unsigned long Usart::getRxDropped()
+{
+  // the RX ISR counts them, 4 bytes are not read atomically
+  noInterrupts();
+  unsigned long res = m_ulRxDropped;
+  interrupts();
+  return res;
+}
+
+void Usart::dumpStats(Print &out, char buf[])
+{
+  sprintf_P(buf, PSTR("Serial: requests=%lu, rxDropped=%lu, "), m_ulRequests, getRxDropped());
+  out.print(buf);
+  sprintf_P(buf, PSTR("latency last=%luus avg=%luus max=%luus"), m_ulLatencyLast, getLatencyAvg(), m_ulLatencyMax);
+  out.println(buf);
+}
@@ -0,0 +1,97 @@
+/**
+ * Interrupt driven USART0, in place of the Arduino core Serial whose RX
+ * interrupt can't be hooked - nothing may use Serial or the two would fight
+ * over the vectors.
+ *
+ * RX: the RX ISR hands every byte to the parser of the protocol in use.
+ * Once the parser has a complete request the ISR signals taskSerial and
+ * holds: the bytes coming in until the task has dispatched the request and
+ * called release() are kept in a ring, for the request may switch the
+ * protocol.  release() feeds them to the parser then.
+ * The time from the request completed to release(), i.e. to whatever the
+ * request does - a fan PWM set included - being done, is the request
+ * latency.
+ *
+ * TX: a ring drained by the data register empty ISR, write() never waits.
+ */
+#pragma once
+
+/** ring sizes */
+const byte usartRxSize = 64;
+const byte usartTxSize = 32;
+
+class Usart
+{
+public:
+  /** takes the next byte, true once it has a complete request */
+  typedef bool (*Parser)(byte b);
+
+  /** 8N1 at this baud rate */
+  void begin(unsigned long baud, Parser parser);
+
+  /** room in the TX ring */
+  int availableForWrite();
+  /** to be called only if there is room */
+  void write(byte b);
+
+  /** a complete request is waiting for dispatch? */
+  bool isHeld()
+  {
+    return m_bHeld;
+  }
+  /** the request was dispatched, go on with the input */
+  void release();
+
+  /** # of requests released */
+  unsigned long getRequests()
+  {
+    return m_ulRequests;
+  }
+  /** request latencies, us */
+  unsigned long getLatencyLast()
+  {
+    return m_ulLatencyLast;
+  }
+  unsigned long getLatencyMax()
+  {
+    return m_ulLatencyMax;
+  }
+  unsigned long getLatencyAvg()
+  {
+    return (m_ulRequests == 0) ? 0 : (m_ulLatencySum / m_ulRequests);
+  }
+  /** bytes lost: no room in the ring or data overrun */
+  unsigned long getRxDropped();
+  void dumpStats(Print &out, char buf[]);
+
+  /** called from the ISRs */
+  void onRx();
+  void onTxEmpty();
+
+private:
+  Parser m_parser = 0;
+  /** a request is waiting for release() */
+  volatile bool m_bHeld = false;
+  /** nowMicros() the request got complete at */
+  unsigned long m_ulRequestUs = 0;
+
+  /** what came in while held */
+  byte m_rx[usartRxSize];
+  volatile byte m_rxHead = 0;
+  volatile byte m_rxTail = 0;
+  byte m_tx[usartTxSize];
+  volatile byte m_txHead = 0;
+  volatile byte m_txTail = 0;
+
+  unsigned long m_ulRequests = 0;
+  unsigned long m_ulLatencyLast = 0;
+  unsigned long m_ulLatencyMax = 0;
+  unsigned long m_ulLatencySum = 0;
+  volatile unsigned long m_ulRxDropped = 0;
+
+  /** the request got complete */
+  void hold();
+};
+
+/** the one and only serial port */
+extern Usart g_usart;
@@ -0,0 +1,167 @@
+/**
+ * Fixed point vs floating point conversions of the sensor and RPM paths.
+ * Checks the integer versions against the float reference over the whole
+ * input range and counts the soft-float operations the integer versions
+ * do away with.
+ *
+ *   bench_fixedpoint
+ *
+ * The AVR has no FPU, each float operation is a call into the libgcc
+ * soft-float routines named below.  The float code is run once more on a
+ * float stand-in counting those calls, literals are constants and cost
+ * nothing.  Host timings say nothing about the AVR and are not taken; cycles
+ * and flash need simavr and avr-size on the firmware itself.
+ */
+#include "Arduino.h"
+#include "../../LM35.h"
+#include "../../Fan.h"
+
+/** soft-float routines a float expression compiles into on the AVR */
+enum SoftOp
+{
+  opFloat,   // __floatunsisf, integer to float
+  opAdd,     // __addsf3
+  opMul,     // __mulsf3
+  opDiv,     // __divsf3
+  opFix,     // __fixunssfsi, float to integer
+  opLast = opFix
+};
+static const char *const g_opNames[] = {
+  "__floatunsisf", "__addsf3", "__mulsf3", "__divsf3", "__fixunssfsi"
+};
+static unsigned long g_ops[opLast + 1];
+
+/** float which counts the operations done on it */
+struct SoftFloat
+{
+  float v;
+
+  SoftFloat(unsigned long i) : v((float)i)
+  {
+    g_ops[opFloat]++;
+  }
+  /** literal, folded by the compiler */
+  static SoftFloat k(float f)
+  {
+    SoftFloat r;
+    r.v = f;
+    return r;
+  }
+  SoftFloat operator+(SoftFloat o) const
+  {
+    g_ops[opAdd]++;
+    return k(v + o.v);
+  }
+  SoftFloat operator*(SoftFloat o) const
+  {
+    g_ops[opMul]++;
+    return k(v * o.v);
+  }
+  SoftFloat operator/(SoftFloat o) const
+  {
+    g_ops[opDiv]++;
+    return k(v / o.v);
+  }
+  operator unsigned long() const
+  {
+    g_ops[opFix]++;
+    return (unsigned long)v;
+  }
+
+private:
+  SoftFloat() : v(0)
+  {
+  }
+};
+
+/** float literal as T */
+template<typename T> struct Lit
+{
+  static T k(float f)
+  {
+    return T::k(f);
+  }
+};
+template<> struct Lit<float>
+{
+  static float k(float f)
+  {
+    return f;
+  }
+};
+
+/** the way LM35::read() used to do it, 10 bit reading */
+template<typename T> static unsigned long floatToC(unsigned int reading)
+{
+  T tempC = T((unsigned long)reading) * Lit<T>::k(110) / Lit<T>::k(1024);
+  return (unsigned long)tempC;
+}
+
+/** tenths of C in float, rounded */
+template<typename T> static unsigned long floatToDeciC(unsigned int raw12)
+{
+  T tempC = T((unsigned long)raw12) * Lit<T>::k(1100) / Lit<T>::k(4096);
+  return (unsigned long)(tempC + Lit<T>::k(0.5f));
+}
+
+/** the way endCalculateRPM() used to do it, ticks over a time span */
+template<typename T> static unsigned long floatToRPM(unsigned long ulRevolutions, unsigned long ulElapsedMs)
+{
+  T elapsedS = T(ulElapsedMs) / Lit<T>::k(1000.0f);
+  T revPerS = T(ulRevolutions) / elapsedS;
+  return (unsigned long)(revPerS * Lit<T>::k(60.0f));
+}
+
+/** print the soft-float calls f makes per conversion */
+template<typename Fn> static void countOps(const char *name, Fn f, const char *fixed)
+{
+  for(byte i = 0; i <= opLast; i++)
+    g_ops[i] = 0;
+  f();
+  unsigned long total = 0;
+  printf("%-20s", name);
+  for(byte i = 0; i <= opLast; i++)
+  {
+    printf(" %14lu", g_ops[i]);
+    total += g_ops[i];
+  }
+  printf(" %6lu   %s\n", total, fixed);
+}
+
+int main()
+{
+  // accuracy over the whole input range
+  int errC = 0, errDeci = 0;
+  for(unsigned int raw12 = 0; raw12 < 4096; raw12++)
+  {
+    // 10 bit reading the float version used to get, truncation makes them equal
+    int d = (int)LM35::rawToC(raw12) - (int)floatToC<float>(raw12 >> 2);
+    if(abs(d) > errC)
+      errC = abs(d);
+    d = (int)LM35::rawToDeciC(raw12) - (int)floatToDeciC<float>(raw12);
+    if(abs(d) > errDeci)
+      errDeci = abs(d);
+  }
+  // over a tach period the old code saw half a revolution in period us
+  long errRPM = 0;
+  for(unsigned long us = fanTachMinPeriodUs; us <= fanTachTimeoutUs; us += 7)
+  {
+    long d = (long)Fan::periodToRPM(us) - (long)(30000000.0 / us);
+    if(labs(d) > errRPM)
+      errRPM = labs(d);
+  }
+  printf("max error: C=%d deciC=%d RPM=%ld\n", errC, errDeci, errRPM);
+
+  // soft-float calls per conversion, the integer versions make none
+  printf("%-20s", "conversion");
+  for(byte i = 0; i <= opLast; i++)
+    printf(" %14s", g_opNames[i]);
+  printf(" %6s   %s\n", "total", "integer version");
+  countOps("ADC to C", [] { floatToC<SoftFloat>(512); },
+    "16x16 mul, shift");
+  countOps("ADC to tenths of C", [] { floatToDeciC<SoftFloat>(2048); },
+    "16x16 mul, add, shift");
+  countOps("tach to RPM", [] { floatToRPM<SoftFloat>(30, 1000); },
+    "32 bit div");
+  return 0;
+}
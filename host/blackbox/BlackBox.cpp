@@ -0,0 +1,170 @@
+/**
+ * Black box dump decoding, see BlackBox.h
+ */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BlackBox.h"
+
+/** what Recorder.cpp calls them */
+static const unsigned char recRepeat = 0x80;
+static const unsigned char recKey = 0x40;
+static const unsigned char recEvent = 0x20;
+static const unsigned char recTemp = 0x01;
+static const unsigned char recPwm = 0x02;
+static const unsigned char recRpm = 0x04;
+static const unsigned char recOpMode = 0x08;
+
+bool bbReadDump(FILE *f, BbDump &d)
+{
+  char line[256];
+  bool bIn = false;
+  while(fgets(line, sizeof(line), f) != 0)
+  {
+    if(strncmp(line, "BLACKBOX END", 12) == 0 && bIn)
+      return true;
+    if(sscanf(line, "BLACKBOX fans=%d, period=%lums, rpmUnit=%u", &d.fans, &d.periodMs, &d.rpmUnit) == 3)
+    {
+      bIn = true;
+      d.bytes.clear();
+      continue;
+    }
+    if(!bIn || strncmp(line, "BB ", 3) != 0)
+      continue;
+    for(const char *p = line + 3; isxdigit(p[0]) && isxdigit(p[1]); p += 2)
+    {
+      char hex[3] = { p[0], p[1], 0 };
+      d.bytes.push_back((unsigned char)strtoul(hex, 0, 16));
+    }
+  }
+  return false;
+}
+
+class Reader
+{
+public:
+  Reader(const std::vector<unsigned char> &bytes) :
+    m_bytes(bytes)
+  {
+  }
+  bool atEnd()
+  {
+    return m_pos >= m_bytes.size();
+  }
+  unsigned byte()
+  {
+    return atEnd() ? 0 : m_bytes[m_pos++];
+  }
+  unsigned long varint()
+  {
+    unsigned long res = 0;
+    for(int shift = 0; !atEnd(); shift += 7)
+    {
+      unsigned b = byte();
+      res |= (unsigned long)(b & 0x7F) << shift;
+      if((b & 0x80) == 0)
+        break;
+    }
+    return res;
+  }
+  long delta()
+  {
+    unsigned long z = varint();
+    return (z & 1) ? -(long)((z + 1) / 2) : (long)(z / 2);
+  }
+
+private:
+  const std::vector<unsigned char> &m_bytes;
+  size_t m_pos = 0;
+};
+
+static std::string eventName(unsigned code, unsigned arg)
+{
+  static const char *stalls[] = { "ok", "suspect", "stalled", "recovering", "failed" };
+  char buf[64];
+  if(code == 1)
+    snprintf(buf, sizeof(buf), "hot channel %u", arg);
+  else if(code == 2)
+    snprintf(buf, sizeof(buf), "Fan%u %s", arg >> 4, ((arg & 0x0F) < 5) ? stalls[arg & 0x0F] : "?");
+  else if(code == 3)
+    snprintf(buf, sizeof(buf), "channel %u opmode %u", arg >> 4, arg & 0x0F);
+  else
+    snprintf(buf, sizeof(buf), "event %u %u", code, arg);
+  return buf;
+}
+
+/** s with the RPM in RPM rather than in rpmUnit */
+static BbSample scaled(const BbDump &d, const BbSample &s)
+{
+  BbSample res = s;
+  for(int i = 0; i < d.fans; i++)
+    res.rpm[i] = s.rpm[i] * d.rpmUnit;
+  return res;
+}
+
+bool bbDecode(const BbDump &d, std::vector<BbSample> &samples, std::string &error)
+{
+  if(d.fans < 0 || d.fans > 8)
+  {
+    error = "Bad # of fans " + std::to_string(d.fans);
+    return false;
+  }
+  double period = d.periodMs / 1000.0;
+  BbSample s;
+  bool bKeyed = false;
+  Reader r(d.bytes);
+  while(!r.atEnd())
+  {
+    unsigned h = r.byte();
+    if(h & recRepeat)
+    {
+      for(unsigned i = 0; i <= (h & 0x7F); i++)
+      {
+        s.seconds += period;
+        samples.push_back(scaled(d, s));
+      }
+      continue;
+    }
+    if(h == recEvent)
+    {
+      unsigned code = r.byte();
+      unsigned arg = r.byte();
+      samples.push_back(scaled(d, s));
+      samples.back().event = eventName(code, arg);
+      continue;
+    }
+    if(h == recKey)
+    {
+      s.seconds = r.varint();
+      s.temp = r.varint();
+      s.opMode = r.byte();
+      for(int i = 0; i < d.fans; i++)
+        s.pwm[i] = r.varint();
+      for(int i = 0; i < d.fans; i++)
+        s.rpm[i] = r.varint();
+      bKeyed = true;
+      samples.push_back(scaled(d, s));
+      continue;
+    }
+    if(!bKeyed || (h & ~(recTemp | recPwm | recRpm | recOpMode)) != 0)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "Bad record header 0x%02X", h);
+      error = buf;
+      return false;
+    }
+    s.seconds += period;
+    if(h & recTemp)
+      s.temp += r.delta();
+    if(h & recPwm)
+      for(int i = 0; i < d.fans; i++)
+        s.pwm[i] += r.delta();
+    if(h & recRpm)
+      for(int i = 0; i < d.fans; i++)
+        s.rpm[i] += r.delta();
+    if(h & recOpMode)
+      s.opMode = r.byte();
+    samples.push_back(scaled(d, s));
+  }
+  return true;
+}
@@ -0,0 +1,41 @@
+/**
+ * Black box dump parsing and decoding, see Recorder.h for the format.
+ * Shared by bbdecode and its test.
+ */
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/** what the controller printed in response to BLACKBOX */
+struct BbDump
+{
+  int fans = 0;
+  unsigned long periodMs = 0;
+  unsigned rpmUnit = 1;
+  std::vector<unsigned char> bytes;
+};
+
+/** a sample, or an event along with the sample before it */
+struct BbSample
+{
+  /** since the controller boot */
+  double seconds = 0;
+  long temp = 0;
+  unsigned opMode = 0;
+  long pwm[8] = {};
+  /** in RPM */
+  long rpm[8] = {};
+  /** empty for a sample */
+  std::string event;
+};
+
+/** the dump in the input, false if there is none */
+bool bbReadDump(FILE *f, BbDump &d);
+
+/**
+ * The samples and the events in the dump, oldest first, a repeated sample
+ * as many times as it was taken.  False if it does not decode, error tells
+ * why.
+ */
+bool bbDecode(const BbDump &d, std::vector<BbSample> &samples, std::string &error);
@@ -0,0 +1,58 @@
+/**
+ * Black box dump decoder, see Recorder.h for the format.  Reads what the
+ * controller printed in response to BLACKBOX - other lines are skipped - and
+ * writes the samples and the events as CSV:
+ *
+ *   bbdecode < dump.txt > history.csv
+ *
+ *   seconds,temp,opmode,pwm1,...,rpm1,...,event
+ *
+ * Seconds are since the controller boot, a repeated sample is printed as
+ * many times as it was taken.  Fans and channels are numbered from 0, as in
+ * the ALARM lines.
+ */
+#include <stdio.h>
+#include <vector>
+#include "BlackBox.h"
+
+static void printSample(const BbDump &d, const BbSample &s)
+{
+  printf("%.0f,%ld,%u", s.seconds, s.temp, s.opMode);
+  for(int i = 0; i < d.fans; i++)
+    printf(",%ld", s.pwm[i]);
+  for(int i = 0; i < d.fans; i++)
+    printf(",%ld", s.rpm[i]);
+  printf(",%s\n", s.event.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+  BbDump d;
+  if(!bbReadDump(stdin, d))
+  {
+    fprintf(stderr, "No complete BLACKBOX dump in the input\n");
+    return 1;
+  }
+  std::vector<BbSample> samples;
+  std::string error;
+  bool bOk = bbDecode(d, samples, error);
+  if(!bOk && samples.empty())
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  printf("seconds,temp,opmode");
+  for(int i = 0; i < d.fans; i++)
+    printf(",pwm%d", i + 1);
+  for(int i = 0; i < d.fans; i++)
+    printf(",rpm%d", i + 1);
+  printf(",event\n");
+  for(const BbSample &s : samples)
+    printSample(d, s);
+  if(!bOk)
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  return 0;
+}
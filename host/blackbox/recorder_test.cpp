@@ -0,0 +1,272 @@
+/**
+ * Black box round trip: the samples are taken by the firmware Recorder.cpp
+ * from stub fans and channels, dumped and decoded the way bbdecode does it.
+ * Covers the key frames, the deltas, the repeats, the deadbands, the events,
+ * the freeze and the re-arm, a sample due during a dump and the ring
+ * dropping the oldest records.
+ *
+ *   recorder_test
+ *
+ * Prints the failed checks, the exit status is the # of them.
+ */
+#include <Arduino.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "Trace.h"
+#include "Fan.h"
+#include "Config.h"
+#include "TxQueue.h"
+#include "OperationalMode.h"
+#include "Channel.h"
+#include "Recorder.h"
+#include "BlackBox.h"
+
+/** what the stubs report */
+static unsigned long g_now = 0;
+static unsigned short g_temp = 25;
+static short int g_opMode = opModeInternallyMeasuredTemperature;
+static unsigned long g_rpm[configFans];
+
+/** the firmware bits Recorder.cpp samples */
+Fan g_fan[] = { Fan(9, 2), Fan(10, 3), Fan(11, 0) };
+Channel g_channels[] = { Channel(0), Channel(1), Channel(2) };
+unsigned long nowMillis()
+{
+  return g_now;
+}
+short int fansCount()
+{
+  return configFans;
+}
+void Fan::spin(unsigned short pwm)
+{
+  m_pwm = pwm;
+}
+unsigned long Fan::getRPM()
+{
+  return g_rpm[this - g_fan];
+}
+unsigned short int Channel::getTemp()
+{
+  return g_temp;
+}
+short int Channel::getOpModeId()
+{
+  return g_opMode;
+}
+
+/** and the dump goes to */
+static std::string g_out;
+static byte g_outBuf[2];
+static TxChannel g_txOut(g_outBuf, sizeof(g_outBuf));
+size_t TxChannel::write(uint8_t b)
+{
+  g_out += (char)b;
+  return 1;
+}
+int TxChannel::availableForWrite()
+{
+  return 255;
+}
+
+static int g_failed = 0;
+/** what the samples taken so far decode to */
+static std::vector<BbSample> g_expected;
+/** the values recorded, these stay the same for a change within the deadbands */
+static BbSample g_recorded;
+/** when the next sample is due */
+static unsigned long g_due = 1000;
+/** a dump is in progress */
+static bool g_bDumping = false;
+
+static void fail(const char *what, const std::string &got, const std::string &expected)
+{
+  printf("recorder_test: %s: got \"%s\", expected \"%s\"\n", what, got.c_str(), expected.c_str());
+  g_failed++;
+}
+
+/** the stubs report these, expected to be recorded */
+static void set(unsigned short temp, unsigned short pwm, unsigned long rpm)
+{
+  g_temp = temp;
+  for(short int i = 0; i < configFans; i++)
+  {
+    g_fan[i].spin(pwm + i);
+    // a multiple of recRpmUnit is recorded as is, no tach on the last fan
+    g_rpm[i] = g_fan[i].hasSensor() ? (rpm + i * recRpmUnit) : 0;
+  }
+  g_recorded.temp = g_temp;
+  g_recorded.opMode = g_opMode;
+  for(short int i = 0; i < configFans; i++)
+  {
+    g_recorded.pwm[i] = g_fan[i].getPWM();
+    g_recorded.rpm[i] = g_rpm[i];
+  }
+}
+
+/** the next sample, lateMs after it is due */
+static void tick(unsigned long lateMs = 0)
+{
+  g_now = g_due + lateMs;
+  g_due += recPeriod;
+  bool bTaken = (g_recorder.getState() != recFrozen && !g_bDumping);
+  g_recorder.run();
+  if(!bTaken)
+    return;
+  g_recorded.seconds = g_now / 1000.0;
+  g_recorded.event.clear();
+  g_expected.push_back(g_recorded);
+}
+
+static void event(byte code, byte arg, const char *name)
+{
+  g_recorder.event(code, arg);
+  BbSample s = g_expected.back();
+  s.event = name;
+  g_expected.push_back(s);
+}
+
+/** dump out what was recorded */
+static void dumpAll()
+{
+  while(g_out.find("BLACKBOX END") == std::string::npos)
+    g_recorder.dumpMore();
+  g_bDumping = false;
+}
+
+static std::string describe(const BbSample &s)
+{
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%.1fs %ldC opmode %u PWM %ld %ld %ld RPM %ld %ld %ld %s", s.seconds, s.temp,
+    s.opMode, s.pwm[0], s.pwm[1], s.pwm[2], s.rpm[0], s.rpm[1], s.rpm[2], s.event.c_str());
+  return buf;
+}
+
+/**
+ * The dump decodes to the newest of the expected samples, the times within
+ * the second the key frames have and the slack the recorder allows.
+ */
+static void check(const char *what)
+{
+  g_out.clear();
+  g_recorder.dump(g_txOut);
+  dumpAll();
+  BbDump d;
+  FILE *f = fmemopen((void *)g_out.data(), g_out.size(), "r");
+  bool bRead = bbReadDump(f, d);
+  fclose(f);
+  std::vector<BbSample> samples;
+  std::string error;
+  if(!bRead || !bbDecode(d, samples, error))
+  {
+    fail(what, bRead ? error : "no dump", "a dump which decodes");
+    return;
+  }
+  if(d.fans != configFans || d.periodMs != recPeriod || d.rpmUnit != recRpmUnit)
+    fail(what, "another header", "fans, period and rpmUnit as in Recorder.h");
+  if(samples.size() < 2 || samples.size() > g_expected.size() || d.bytes.size() > recSize)
+  {
+    fail(what, std::to_string(samples.size()) + " samples in " + std::to_string(d.bytes.size()) + " bytes",
+      "the newest of the " + std::to_string(g_expected.size()) + " in the ring");
+    return;
+  }
+  size_t first = g_expected.size() - samples.size();
+  for(size_t i = 0; i < samples.size(); i++)
+  {
+    const BbSample &got = samples[i];
+    const BbSample &exp = g_expected[first + i];
+    bool bSame = (fabs(got.seconds - exp.seconds) < 1.5 && got.temp == exp.temp && got.opMode == exp.opMode &&
+      got.event == exp.event);
+    for(short int j = 0; j < configFans; j++)
+      bSame = bSame && (got.pwm[j] == exp.pwm[j] && got.rpm[j] == exp.rpm[j]);
+    if(!bSame)
+    {
+      fail((std::string(what) + ", sample " + std::to_string(i)).c_str(), describe(got), describe(exp));
+      return;
+    }
+  }
+}
+
+int main()
+{
+  // every sample changes something, up and down, a little late or not
+  for(int i = 0; i < 40; i++)
+  {
+    int up = (i < 20) ? i : (40 - i);
+    set(25 + up * 2, 40 + up * 20, 500 + up * 50);
+    tick(i % 3);
+  }
+  check("ramp");
+
+  // noise within the deadbands is not recorded
+  g_temp += recTempDeadband;
+  g_fan[0].spin(g_fan[0].getPWM() + recPwmDeadband);
+  g_rpm[1] += recRpmDeadband * recRpmUnit;
+  tick();
+  tick();
+  // steady, more than a repeat record takes
+  for(int i = 0; i < 300; i++)
+    tick();
+  check("steady");
+
+  // an opmode change, a stall, recorded for recPostSamples more samples
+  g_opMode = opModePidTemperature;
+  set(40, 300, 2000);
+  tick();
+  event(recEvOpMode, (0 << 4) | opModePidTemperature, "channel 0 opmode 6");
+  set(43, 330, 100);
+  tick();
+  event(recEvStall, (1 << 4) | 2, "Fan1 stalled");
+  for(int i = 0; i < recPostSamples + 5; i++)
+  {
+    set(41 + (i % 2) * 3, 310, 2000 - i * 100);
+    tick();
+  }
+  if(g_recorder.getState() != recFrozen)
+    fail("stall", std::to_string(g_recorder.getState()), "frozen");
+  check("frozen");
+
+  // re-armed off the sample grid
+  g_due += 60000 + recPeriod / 2;
+  g_recorder.rearm();
+  for(int i = 0; i < 5; i++)
+  {
+    set(35 - i * 2, 200 - i * 20, 1500 - i * 100);
+    tick();
+  }
+  check("rearm");
+
+  // a sample due during a dump is not taken
+  g_out.clear();
+  g_recorder.dump(g_txOut);
+  g_bDumping = true;
+  set(30, 100, 1000);
+  tick();
+  dumpAll();
+  for(int i = 0; i < 5; i++)
+  {
+    set(30 + i * 2, 100 + i * 20, 1000 + i * 100);
+    tick(i * 100);
+  }
+  check("dump");
+
+  // a late task
+  set(40, 220, 1600);
+  tick(3000);
+  set(42, 240, 1700);
+  tick();
+  check("late");
+
+  // the ring wraps over and over
+  for(int i = 0; i < 600; i++)
+  {
+    set(30 + (i % 7) * 2, 100 + (i % 5) * 30, 1000 + (i % 11) * 100);
+    tick(i % 4);
+  }
+  check("wrap");
+
+  if(g_failed == 0)
+    printf("recorder_test: all passed\n");
+  return g_failed;
+}
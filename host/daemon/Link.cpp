@@ -0,0 +1,207 @@
+/**
+ * Host end of the controller binary protocol over a serial device
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Link.h"
+
+namespace fcd
+{
+
+uint64_t nowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** CRC-CCITT, same as avr-libc _crc_xmodem_update */
+static uint16_t crcUpdate(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for(int i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+bool Link::open(const char *path, int resetWaitMs, int opMode)
+{
+  close();
+  m_fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if(m_fd < 0)
+    return false;
+  struct termios tio;
+  if(tcgetattr(m_fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(m_fd, TCSANOW, &tio);
+  }
+  // opening the port resets a real Arduino, the bootloader takes a while
+  drain(resetWaitMs);
+  // the board could still be talking binary from our previous run
+  static const uint8_t toText[] = { bcCmdText, 0 };
+  queue(toText, sizeof(toText));
+  bool bOk = flush() && writeText("");
+  if(bOk && opMode != 0)
+  {
+    char line[32];
+    snprintf(line, sizeof(line), "SET OPMODE %d", opMode);
+    bOk = writeText(line);
+  }
+  if(bOk)
+    bOk = writeText("SET PROTOCOL 1");
+  if(!bOk)
+  {
+    close();
+    return false;
+  }
+  drain(300);
+  m_rx.clear();
+  return isOpen();
+}
+
+void Link::close()
+{
+  if(m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+  m_tx.clear();
+  m_rx.clear();
+}
+
+void Link::queue(const uint8_t *payload, uint8_t len)
+{
+  uint16_t crc = crcUpdate(0xFFFF, len);
+  m_tx.push_back(bcSof);
+  m_tx.push_back(len);
+  for(uint8_t i = 0; i < len; i++)
+  {
+    m_tx.push_back(payload[i]);
+    crc = crcUpdate(crc, payload[i]);
+  }
+  m_tx.push_back((uint8_t)crc);
+  m_tx.push_back((uint8_t)(crc >> 8));
+}
+
+bool Link::flush()
+{
+  size_t off = 0;
+  while(off < m_tx.size())
+  {
+    ssize_t n = write(m_fd, &m_tx[off], m_tx.size() - off);
+    if(n > 0)
+    {
+      off += n;
+      continue;
+    }
+    if(n < 0 && errno == EAGAIN)
+    {
+      struct pollfd pfd = { m_fd, POLLOUT, 0 };
+      if(poll(&pfd, 1, 1000) > 0)
+        continue;
+    }
+    m_tx.clear();
+    return false;
+  }
+  m_tx.clear();
+  return true;
+}
+
+bool Link::writeText(const char *line)
+{
+  m_tx.insert(m_tx.end(), line, line + strlen(line));
+  m_tx.push_back('\r');
+  bool bOk = flush();
+  // let the command take effect and drop its response before the next one
+  drain(50);
+  return bOk;
+}
+
+void Link::drain(int ms)
+{
+  uint64_t until = nowMs() + ms;
+  uint8_t buf[256];
+  for(uint64_t now = nowMs(); now < until && m_fd >= 0; now = nowMs())
+  {
+    struct pollfd pfd = { m_fd, POLLIN, 0 };
+    if(poll(&pfd, 1, (int)(until - now)) <= 0)
+      continue;
+    if(read(m_fd, buf, sizeof(buf)) < 0 && errno != EAGAIN)
+      break;
+  }
+}
+
+int Link::receive(std::vector<uint8_t> &frame, int timeoutMs)
+{
+  uint64_t until = nowMs() + timeoutMs;
+  for(;;)
+  {
+    if(parse(frame))
+      return 1;
+    uint64_t now = nowMs();
+    if(now >= until)
+      return 0;
+    struct pollfd pfd = { m_fd, POLLIN, 0 };
+    int res = poll(&pfd, 1, (int)(until - now));
+    if(res < 0 && errno != EINTR)
+      return -1;
+    if(res <= 0)
+      continue;
+    // the slave end going away shows up as POLLHUP on a pty
+    if(pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+      return -1;
+    uint8_t buf[256];
+    ssize_t n = read(m_fd, buf, sizeof(buf));
+    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+      return -1;
+    if(n > 0)
+      m_rx.insert(m_rx.end(), buf, buf + n);
+  }
+}
+
+bool Link::parse(std::vector<uint8_t> &frame)
+{
+  for(;;)
+  {
+    // debug text gets in between the frames, skip it
+    size_t sof = 0;
+    while(sof < m_rx.size() && m_rx[sof] != bcSof)
+      sof++;
+    m_rx.erase(m_rx.begin(), m_rx.begin() + sof);
+    if(m_rx.size() < 2)
+      return false;
+    uint8_t len = m_rx[1];
+    if(len < 2 || len > bcMaxPayload)
+    {
+      m_ulBadFrames++;
+      m_rx.erase(m_rx.begin());
+      continue;
+    }
+    if(m_rx.size() < 4u + len)
+      return false;
+    uint16_t crc = crcUpdate(0xFFFF, len);
+    for(uint8_t i = 0; i < len; i++)
+      crc = crcUpdate(crc, m_rx[2 + i]);
+    if(m_rx[2 + len] != (uint8_t)crc || m_rx[3 + len] != (uint8_t)(crc >> 8))
+    {
+      // might have been a 0xA5 in the text, hunt for the next one
+      m_ulBadFrames++;
+      m_rx.erase(m_rx.begin());
+      continue;
+    }
+    frame.assign(m_rx.begin() + 2, m_rx.begin() + 2 + len);
+    m_rx.erase(m_rx.begin(), m_rx.begin() + 4 + len);
+    return true;
+  }
+}
+
+}
@@ -0,0 +1,79 @@
+/**
+ * Host end of the controller binary protocol over a serial device,
+ * see BinaryCommand.h for the framing.
+ */
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+namespace fcd
+{
+
+/** the bits of BinaryCommand.h we need, Protocol.cpp checks them */
+const uint8_t bcSof = 0xA5;
+const uint8_t bcMaxPayload = 40;
+const uint8_t bcCmdTemp = 0x04;
+const uint8_t bcCmdText = 0x0F;
+const uint8_t bcResponse = 0x80;
+const uint8_t bcTelemetry = 0x40;
+const uint8_t bcAlarm = 0x41;
+const uint8_t bcOk = 0;
+/** same as TempInput.h tempNameMax - 1 */
+const unsigned nameMax = 7;
+/** what the controller can take, TempInput.h tempInputsMax */
+const unsigned inputsMax = 8;
+
+/** monotonic ms */
+uint64_t nowMs();
+
+class Link
+{
+public:
+  ~Link()
+  {
+    close();
+  }
+
+  /**
+   * Open the serial device, raw at 115200, give the board resetWaitMs to
+   * boot, switch it to opMode if that is not 0, and to the binary protocol.
+   */
+  bool open(const char *path, int resetWaitMs, int opMode);
+  void close();
+  bool isOpen()
+  {
+    return m_fd >= 0;
+  }
+
+  /** append a frame with this payload to the ones to be written */
+  void queue(const uint8_t *payload, uint8_t len);
+  /** write all the queued frames at once, false on I/O error */
+  bool flush();
+
+  /**
+   * Wait up to timeoutMs for a complete frame, put its payload into frame.
+   * 1 if there is one, 0 on timeout, -1 on I/O error.
+   */
+  int receive(std::vector<uint8_t> &frame, int timeoutMs);
+
+  /** frames dropped for a bad CRC or length */
+  unsigned long getBadFrames()
+  {
+    return m_ulBadFrames;
+  }
+
+private:
+  int m_fd = -1;
+  std::vector<uint8_t> m_tx;
+  std::vector<uint8_t> m_rx;
+  unsigned long m_ulBadFrames = 0;
+
+  /** text protocol line, used before we switch to binary */
+  bool writeText(const char *line);
+  /** read and drop whatever the board says for ms */
+  void drain(int ms);
+  /** a frame at the start of m_rx, dropping the garbage before it */
+  bool parse(std::vector<uint8_t> &frame);
+};
+
+}
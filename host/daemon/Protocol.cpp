@@ -0,0 +1,19 @@
+/**
+ * Compile time check of the Link.h copies of the firmware constants against
+ * the firmware headers, built against the host HAL.  Nothing to run.
+ */
+#include <Arduino.h>
+#include "BinaryCommand.h"
+#include "TempInput.h"
+#include "Link.h"
+
+static_assert(fcd::bcSof == bcSof, "bcSof differs from BinaryCommand.h");
+static_assert(fcd::bcMaxPayload == bcMaxPayload, "bcMaxPayload differs from BinaryCommand.h");
+static_assert(fcd::bcCmdTemp == bcCmdTemp, "bcCmdTemp differs from BinaryCommand.h");
+static_assert(fcd::bcCmdText == bcCmdText, "bcCmdText differs from BinaryCommand.h");
+static_assert(fcd::bcResponse == bcResponse, "bcResponse differs from BinaryCommand.h");
+static_assert(fcd::bcTelemetry == bcTelemetry, "bcTelemetry differs from BinaryCommand.h");
+static_assert(fcd::bcAlarm == bcAlarm, "bcAlarm differs from BinaryCommand.h");
+static_assert(fcd::bcOk == bcOk, "bcOk differs from BinaryCommand.h");
+static_assert(fcd::nameMax == tempNameMax - 1, "nameMax differs from TempInput.h");
+static_assert(fcd::inputsMax == tempInputsMax, "inputsMax differs from TempInput.h");
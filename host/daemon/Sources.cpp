@@ -0,0 +1,99 @@
+/**
+ * Where the temperatures fed to the controller come from
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Sources.h"
+
+namespace fcd
+{
+
+/** the first number in the file, false if there is none */
+static bool readNumber(FILE *f, double &value)
+{
+  char buf[128];
+  while(fgets(buf, sizeof(buf), f) != 0)
+  {
+    char *p = buf;
+    while(*p != 0 && strchr("+-.0123456789", *p) == 0)
+      p++;
+    char *end;
+    value = strtod(p, &end);
+    if(end != p)
+      return true;
+  }
+  return false;
+}
+
+bool FileSource::read(double &temp)
+{
+  // sysfs attributes have to be reopened to be read again
+  FILE *f = fopen(m_path.c_str(), "r");
+  if(f == 0)
+    return false;
+  bool bOk = readNumber(f, temp);
+  fclose(f);
+  if(bOk)
+    temp /= m_div;
+  return bOk;
+}
+
+bool CommandSource::read(double &temp)
+{
+  FILE *f = popen(m_command.c_str(), "r");
+  if(f == 0)
+    return false;
+  bool bOk = readNumber(f, temp);
+  return (pclose(f) == 0) && bOk;
+}
+
+/** contents of a one line file, w/o the \n */
+static std::string readLine(const std::string &path)
+{
+  char buf[64] = "";
+  FILE *f = fopen(path.c_str(), "r");
+  if(f == 0)
+    return "";
+  if(fgets(buf, sizeof(buf), f) == 0)
+    buf[0] = 0;
+  fclose(f);
+  buf[strcspn(buf, "\n")] = 0;
+  return buf;
+}
+
+int hwmonScan(const std::string &root, const std::string &chip,
+  const std::string &name, std::vector<Source *> &sources)
+{
+  int count = 0;
+  DIR *dir = opendir(root.c_str());
+  if(dir == 0)
+    return 0;
+  while(struct dirent *hw = readdir(dir))
+  {
+    if(hw->d_name[0] == '.')
+      continue;
+    std::string path = root + "/" + hw->d_name;
+    if(readLine(path + "/name") != chip)
+      continue;
+    DIR *attrs = opendir(path.c_str());
+    if(attrs == 0)
+      continue;
+    while(struct dirent *attr = readdir(attrs))
+    {
+      int n;
+      char tail[16];
+      if(sscanf(attr->d_name, "temp%d%15s", &n, tail) == 2 && strcmp(tail, "_input") == 0)
+      {
+        sources.push_back(new FileSource(name, path + "/" + attr->d_name, 1000));
+        count++;
+      }
+    }
+    closedir(attrs);
+  }
+  closedir(dir);
+  return count;
+}
+
+}
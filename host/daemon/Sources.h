@@ -0,0 +1,90 @@
+/**
+ * Where the temperatures fed to the controller come from.
+ */
+#pragma once
+#include <string>
+#include <vector>
+
+namespace fcd
+{
+
+/**
+ * A temperature reading in C, fed to the controller input called name.
+ * Several sources may share a name, the hottest one is sent.
+ */
+class Source
+{
+public:
+  Source(const std::string &name) :
+    m_name(name)
+  {
+  }
+  virtual ~Source()
+  {
+  }
+  const std::string &getName()
+  {
+    return m_name;
+  }
+  /** what it reads, for the messages */
+  virtual std::string describe() = 0;
+  /** false if the reading failed */
+  virtual bool read(double &temp) = 0;
+
+private:
+  std::string m_name;
+};
+
+/**
+ * A number in a file divided by div, e.g. a hwmon tempN_input in mC or
+ * dev.cpu.0.temperature dumped by a cron job.
+ */
+class FileSource : public Source
+{
+public:
+  FileSource(const std::string &name, const std::string &path, double div) :
+    Source(name), m_path(path), m_div(div)
+  {
+  }
+  std::string describe()
+  {
+    return m_path;
+  }
+  bool read(double &temp);
+
+private:
+  std::string m_path;
+  double m_div;
+};
+
+/**
+ * The first number printed by a shell command, e.g.
+ * "smartctl -A /dev/sda | awk '/Temperature_Celsius/ {print $10}'".
+ * The command is run every period, keep it cheap.
+ */
+class CommandSource : public Source
+{
+public:
+  CommandSource(const std::string &name, const std::string &command) :
+    Source(name), m_command(command)
+  {
+  }
+  std::string describe()
+  {
+    return m_command;
+  }
+  bool read(double &temp);
+
+private:
+  std::string m_command;
+};
+
+/**
+ * Add a FileSource for every tempN_input of the hwmon devices under root,
+ * e.g. /sys/class/hwmon, whose name is chip, e.g. coretemp, drivetemp, nvme.
+ * Returns the number added.
+ */
+int hwmonScan(const std::string &root, const std::string &chip,
+  const std::string &name, std::vector<Source *> &sources);
+
+}
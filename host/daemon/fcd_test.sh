@@ -0,0 +1,25 @@
+#!/bin/sh
+# fancontrollerd against fancontroller_sim over a pty: a few batches of
+# readings, all of them have to be responded to and taken.
+#
+#   fcd_test.sh SIM DAEMON
+sim=$1
+fcd=$2
+dir=$(mktemp -d)
+echo 42000 > "$dir/cpu"
+echo 35 > "$dir/hdd"
+"$sim" --pty --link "$dir/tty" --speed 1 --seconds 60 --quiet &
+pid=$!
+# till the pty is there
+i=0
+while [ ! -e "$dir/tty" ] && [ $i -lt 50 ]; do
+  sleep 0.1
+  i=$((i + 1))
+done
+"$fcd" --reset-wait 0 --opmode 3 --period 200 --count 10 --stats 0 \
+  --file "cpu=$dir/cpu:1000" --file "hdd=$dir/hdd" "$dir/tty"
+res=$?
+kill $pid 2>/dev/null
+wait $pid 2>/dev/null
+rm -rf "$dir"
+exit $res
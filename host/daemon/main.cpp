@@ -0,0 +1,450 @@
+/**
+ * Host companion daemon: reads the temperatures, e.g. of the CPU and the
+ * drives, and feeds them to the controller as named temperature inputs, see
+ * TempInput.h.  Every period all the readings go in one write - as many
+ * bcCmdTemp records as fit in a frame, as many frames as it takes - and the
+ * responses are waited for, so that many sensors do not mean many serial
+ * round trips.  Sources sharing a name are combined on the host, the hottest
+ * one is sent.
+ *
+ *   fancontrollerd [options] DEVICE
+ *     --period MS          how often to feed the readings, default 1000
+ *     --timeout MS         how long to wait for the responses, default 500
+ *     --reset-wait MS      after opening DEVICE, for the board to boot,
+ *                          default 2000
+ *     --opmode N           switch the controller to opmode N, e.g. 3
+ *     --hwmon CHIP[=NAME]  every tempN_input of the hwmon devices called CHIP,
+ *                          e.g. coretemp, drivetemp, nvme, fed as NAME,
+ *                          default CHIP
+ *     --hwmon-root DIR     where to look for them, default /sys/class/hwmon
+ *     --file NAME=PATH[:DIV] the number in PATH divided by DIV, default 1
+ *     --cmd NAME=COMMAND   the number printed by a shell command
+ *     --stats S            print the stats every S seconds, default 60, 0 is
+ *                          on exit and SIGUSR1 only
+ *     --count N            stop after N periods, default: run forever.  The
+ *                          exit status is then 1 unless all of them were
+ *                          responded to and no record was refused
+ *     --verbose            print every batch
+ *
+ * Names are up to 7 characters.  The stats tell the round trip latency of a
+ * batch, from the write to the last response, and the errors: batches not
+ * responded to in time, records the controller refused, frames dropped for a
+ * bad CRC, I/O errors which make us reopen DEVICE, and failed source readings.
+ *
+ * It can be tried against the simulator:
+ *   fancontroller_sim --pty --link /tmp/fancontroller --speed 1 &
+ *   fancontrollerd --reset-wait 0 --opmode 3 --file cpu=/tmp/cpu_temp /tmp/fancontroller
+ * fcd_test.sh does that under ctest.
+ */
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "Link.h"
+#include "Sources.h"
+
+using namespace fcd;
+
+/**
+ * Counters for the stats
+ */
+struct Stats
+{
+  unsigned long batches = 0;
+  unsigned long records = 0;
+  unsigned long frames = 0;
+  unsigned long timeouts = 0;
+  unsigned long refused = 0;
+  unsigned long ioErrors = 0;
+  unsigned long opens = 0;
+  unsigned long sourceErrors = 0;
+  unsigned long alarms = 0;
+  /** round trip latencies of the batches responded to, ms */
+  unsigned long latencyCount = 0;
+  uint64_t latencySum = 0;
+  uint64_t latencyMin = UINT64_MAX;
+  uint64_t latencyMax = 0;
+
+  void addLatency(uint64_t ms)
+  {
+    latencyCount++;
+    latencySum += ms;
+    if(ms < latencyMin)
+      latencyMin = ms;
+    if(ms > latencyMax)
+      latencyMax = ms;
+  }
+  void print(unsigned long badFrames)
+  {
+    fprintf(stderr, "fcd: batches=%lu records=%lu frames=%lu opens=%lu alarms=%lu\n",
+      batches, records, frames, opens, alarms);
+    fprintf(stderr, "fcd: errors: timeouts=%lu refused=%lu bad_frames=%lu io=%lu sources=%lu\n",
+      timeouts, refused, badFrames, ioErrors, sourceErrors);
+    if(latencyCount == 0)
+      fprintf(stderr, "fcd: latency: none yet\n");
+    else
+      fprintf(stderr, "fcd: latency: min=%llums avg=%.1fms max=%llums\n",
+        (unsigned long long)latencyMin, (double)latencySum / latencyCount,
+        (unsigned long long)latencyMax);
+  }
+};
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_dump = 0;
+
+static void onSignal(int sig)
+{
+  if(sig == SIGUSR1)
+    g_dump = 1;
+  else
+    g_stop = 1;
+}
+
+/** hottest reading for each name */
+struct Reading
+{
+  std::string name;
+  double temp;
+  uint64_t time;
+};
+
+static void readSources(std::vector<Source *> &sources, std::vector<Reading> &readings,
+  Stats &stats, bool bVerbose)
+{
+  readings.clear();
+  for(Source *s : sources)
+  {
+    double temp;
+    if(!s->read(temp))
+    {
+      stats.sourceErrors++;
+      if(bVerbose)
+        fprintf(stderr, "fcd: can't read %s\n", s->describe().c_str());
+      continue;
+    }
+    uint64_t now = nowMs();
+    bool bFound = false;
+    for(Reading &r : readings)
+    {
+      if(r.name != s->getName())
+        continue;
+      bFound = true;
+      if(temp > r.temp)
+      {
+        r.temp = temp;
+        r.time = now;
+      }
+    }
+    if(!bFound)
+      readings.push_back(Reading{s->getName(), temp, now});
+  }
+}
+
+/** queue the readings as bcCmdTemp frames, put their seq into pending */
+static void queueReadings(Link &link, const std::vector<Reading> &readings,
+  uint8_t &seq, std::vector<uint8_t> &pending)
+{
+  uint8_t payload[bcMaxPayload];
+  uint8_t len = 0;
+  uint64_t now = nowMs();
+  for(size_t i = 0; i <= readings.size(); i++)
+  {
+    size_t recLen = (i < readings.size()) ? 5 + readings[i].name.size() : 0;
+    // send the frame when the next record does not fit or there is none
+    if(len > 2 && (i == readings.size() || len + recLen > bcMaxPayload))
+    {
+      link.queue(payload, len);
+      pending.push_back(payload[1]);
+      len = 0;
+    }
+    if(i == readings.size())
+      break;
+    if(len == 0)
+    {
+      payload[len++] = bcCmdTemp;
+      payload[len++] = seq++;
+    }
+    const Reading &r = readings[i];
+    int temp = (int)(r.temp + ((r.temp < 0) ? -0.5 : 0.5));
+    uint64_t age = now - r.time;
+    if(age > 0xFFFF)
+      age = 0xFFFF;
+    payload[len++] = (uint8_t)temp;
+    payload[len++] = (uint8_t)(temp >> 8);
+    payload[len++] = (uint8_t)age;
+    payload[len++] = (uint8_t)(age >> 8);
+    payload[len++] = (uint8_t)r.name.size();
+    memcpy(payload + len, r.name.data(), r.name.size());
+    len += r.name.size();
+  }
+}
+
+/**
+ * A frame from the controller: a response to one of the pending ones or an
+ * unsolicited one.  True if that was the last pending response.
+ */
+static bool onFrame(const std::vector<uint8_t> &frame, std::vector<uint8_t> &pending,
+  Stats &stats)
+{
+  uint8_t cmd = frame[0];
+  if(cmd == bcAlarm && frame.size() >= 5)
+  {
+    stats.alarms++;
+    // fans are numbered from 0, as in the controller ALARM line
+    fprintf(stderr, "fcd: alarm Fan%d state=%d latency=%dms\n",
+      frame[1], frame[2], frame[3] | (frame[4] << 8));
+    return false;
+  }
+  if(cmd != (bcCmdTemp | bcResponse) || frame.size() < 3)
+    return false;
+  for(size_t i = 0; i < pending.size(); i++)
+  {
+    if(pending[i] != frame[1])
+      continue;
+    pending.erase(pending.begin() + i);
+    if(frame[2] != bcOk)
+    {
+      stats.refused++;
+      fprintf(stderr, "fcd: controller refused a record, status=%d record=%d\n",
+        frame[2], (frame.size() > 3) ? frame[3] : -1);
+    }
+    return pending.empty();
+  }
+  return false;
+}
+
+/** NAME=VALUE option argument */
+static bool splitOption(const char *arg, std::string &name, std::string &value)
+{
+  const char *eq = strchr(arg, '=');
+  if(eq == 0)
+    return false;
+  name.assign(arg, eq - arg);
+  value = eq + 1;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  int period = 1000;
+  int timeout = 500;
+  int resetWait = 2000;
+  int opMode = 0;
+  int statsS = 60;
+  unsigned long count = 0;
+  bool bVerbose = false;
+  std::string hwmonRoot = "/sys/class/hwmon";
+  std::vector<std::string> hwmons;
+  std::vector<Source *> sources;
+
+  static struct option options[] = {
+    {"period", required_argument, 0, 'p'},
+    {"timeout", required_argument, 0, 't'},
+    {"reset-wait", required_argument, 0, 'w'},
+    {"opmode", required_argument, 0, 'o'},
+    {"hwmon", required_argument, 0, 'h'},
+    {"hwmon-root", required_argument, 0, 'r'},
+    {"file", required_argument, 0, 'f'},
+    {"cmd", required_argument, 0, 'c'},
+    {"stats", required_argument, 0, 's'},
+    {"count", required_argument, 0, 'n'},
+    {"verbose", no_argument, 0, 'v'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  while((c = getopt_long(argc, argv, "", options, 0)) != -1)
+  {
+    std::string name, value;
+    switch(c)
+    {
+      case 'p': period = atoi(optarg); break;
+      case 't': timeout = atoi(optarg); break;
+      case 'w': resetWait = atoi(optarg); break;
+      case 'o': opMode = atoi(optarg); break;
+      case 'h': hwmons.push_back(optarg); break;
+      case 'r': hwmonRoot = optarg; break;
+      case 's': statsS = atoi(optarg); break;
+      case 'n': count = strtoul(optarg, 0, 10); break;
+      case 'v': bVerbose = true; break;
+      case 'f':
+      {
+        if(!splitOption(optarg, name, value))
+        {
+          fprintf(stderr, "fcd: bad --file %s\n", optarg);
+          return 1;
+        }
+        double div = 1;
+        size_t colon = value.rfind(':');
+        if(colon != std::string::npos)
+        {
+          div = atof(value.c_str() + colon + 1);
+          value.resize(colon);
+        }
+        if(div == 0)
+          div = 1;
+        sources.push_back(new FileSource(name, value, div));
+        break;
+      }
+      case 'c':
+        if(!splitOption(optarg, name, value))
+        {
+          fprintf(stderr, "fcd: bad --cmd %s\n", optarg);
+          return 1;
+        }
+        sources.push_back(new CommandSource(name, value));
+        break;
+      default:
+        fprintf(stderr, "see host/daemon/main.cpp for the options\n");
+        return 1;
+    }
+  }
+  if(optind != argc - 1 || period <= 0)
+  {
+    fprintf(stderr, "usage: fancontrollerd [options] DEVICE, see host/daemon/main.cpp\n");
+    return 1;
+  }
+  const char *device = argv[optind];
+  for(const std::string &arg : hwmons)
+  {
+    std::string chip = arg, name = arg;
+    splitOption(arg.c_str(), chip, name);
+    if(hwmonScan(hwmonRoot, chip, name, sources) == 0)
+      fprintf(stderr, "fcd: no %s temperatures in %s\n", chip.c_str(), hwmonRoot.c_str());
+  }
+
+  // the controller keeps a fixed number of short names
+  std::vector<std::string> names;
+  for(Source *s : sources)
+  {
+    if(s->getName().empty() || s->getName().size() > nameMax)
+    {
+      fprintf(stderr, "fcd: input name '%s' is not 1..%u characters\n", s->getName().c_str(), nameMax);
+      return 1;
+    }
+    bool bFound = false;
+    for(const std::string &n : names)
+      bFound = bFound || (n == s->getName());
+    if(!bFound)
+      names.push_back(s->getName());
+    if(bVerbose)
+      fprintf(stderr, "fcd: %s <- %s\n", s->getName().c_str(), s->describe().c_str());
+  }
+  if(names.empty())
+  {
+    fprintf(stderr, "fcd: no temperature sources\n");
+    return 1;
+  }
+  if(names.size() > inputsMax)
+    fprintf(stderr, "fcd: %zu inputs but the controller keeps %u, share the names\n",
+      names.size(), inputsMax);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGUSR1, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  Link link;
+  Stats stats;
+  uint8_t seq = 0;
+  std::vector<Reading> readings;
+  std::vector<uint8_t> pending;
+  std::vector<uint8_t> frame;
+  bool bOpenFailed = false;
+  uint64_t nextStats = nowMs() + statsS * 1000ULL;
+  for(unsigned long n = 0; !g_stop && (count == 0 || n < count); n++)
+  {
+    uint64_t start = nowMs();
+    if(!link.isOpen())
+    {
+      if(!link.open(device, resetWait, opMode))
+      {
+        if(!bOpenFailed)
+          fprintf(stderr, "fcd: can't open %s, will keep trying\n", device);
+        bOpenFailed = true;
+      }
+      else
+      {
+        fprintf(stderr, "fcd: talking to %s\n", device);
+        bOpenFailed = false;
+        stats.opens++;
+      }
+    }
+
+    readSources(sources, readings, stats, bVerbose);
+    if(link.isOpen() && !readings.empty())
+    {
+      pending.clear();
+      queueReadings(link, readings, seq, pending);
+      size_t frames = pending.size();
+      uint64_t sent = nowMs();
+      bool bDone = false;
+      int res = link.flush() ? 0 : -1;
+      stats.batches++;
+      stats.records += readings.size();
+      stats.frames += frames;
+      while(res >= 0 && !bDone)
+      {
+        uint64_t now = nowMs();
+        if(now >= sent + timeout)
+          break;
+        res = link.receive(frame, (int)(sent + timeout - now));
+        if(res > 0)
+          bDone = onFrame(frame, pending, stats);
+      }
+      if(bDone)
+      {
+        stats.addLatency(nowMs() - sent);
+        if(bVerbose)
+          fprintf(stderr, "fcd: %zu readings in %zu frames, %llums\n", readings.size(),
+            frames, (unsigned long long)(nowMs() - sent));
+      }
+      else if(res >= 0)
+      {
+        stats.timeouts++;
+        fprintf(stderr, "fcd: no response in %dms\n", timeout);
+      }
+      if(res < 0)
+      {
+        stats.ioErrors++;
+        fprintf(stderr, "fcd: lost %s\n", device);
+        link.close();
+      }
+    }
+
+    // till the next period, alarms could come in
+    uint64_t next = start + period;
+    for(uint64_t now = nowMs(); !g_stop && now < next; now = nowMs())
+    {
+      if(!link.isOpen())
+      {
+        usleep((next - now) * 1000);
+        break;
+      }
+      int res = link.receive(frame, (int)(next - now));
+      if(res > 0)
+        onFrame(frame, pending, stats);
+      else if(res < 0)
+      {
+        stats.ioErrors++;
+        fprintf(stderr, "fcd: lost %s\n", device);
+        link.close();
+      }
+    }
+    if(g_dump || (statsS > 0 && nowMs() >= nextStats))
+    {
+      g_dump = 0;
+      nextStats = nowMs() + statsS * 1000ULL;
+      stats.print(link.getBadFrames());
+    }
+  }
+  stats.print(link.getBadFrames());
+  for(Source *s : sources)
+    delete s;
+  if(count != 0 && (stats.latencyCount != count || stats.refused != 0))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,20 @@
+/**
+ * Host stand-in for avr-libc <avr/eeprom.h>
+ * The EEPROM is simulated in host/sim/SimEeprom.cpp, a byte write keeps it
+ * busy for 3.4ms of virtual time like on the chip.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "io.h"
+
+/** false while a write is in progress */
+bool eeprom_is_ready();
+/** wait for the write in progress */
+void eeprom_busy_wait();
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+/** these wait for the previous write, then start the new one and return */
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+/** write only if the value differs */
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
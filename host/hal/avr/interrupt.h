@@ -0,0 +1,18 @@
+/**
+ * Host stand-in for avr-libc <avr/interrupt.h>
+ * An ISR is a plain C function the simulator calls when the peripheral
+ * raises the interrupt and SREG I bit is set.
+ */
+#pragma once
+#include "io.h"
+
+#define ISR(vector, ...) extern "C" void vector(void)
+
+/** vectors the simulator knows how to raise, weak defaults are in Sim.cpp */
+extern "C" void ADC_vect(void);
+extern "C" void USART_RX_vect(void);
+extern "C" void USART_UDRE_vect(void);
+
+/** these cost a little bit of virtual time, like any other HAL call */
+void cli();
+void sei();
@@ -0,0 +1,122 @@
+/**
+ * Host stand-in for avr-libc <avr/io.h>, ATmega328P subset.
+ * Registers are plain variables, the simulator (host/sim) looks at them
+ * as the time advances and plays the peripherals' part.  UDR0 is the
+ * exception: reading and writing it do different things.
+ */
+#pragma once
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+/** last EEPROM address */
+#define E2END 0x3FF
+
+/** status register, only the I bit is meaningful */
+extern volatile uint8_t SREG;
+#define SREG_I 7
+
+/** ADC */
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint16_t ADC;
+#define ADCW ADC
+
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX3 3
+#define MUX2 2
+#define MUX1 1
+#define MUX0 0
+
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+
+/** Timer/Counter0 */
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TCNT0;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t OCR0B;
+extern volatile uint8_t TIMSK0;
+
+/** Timer/Counter1 */
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t ICR1;
+extern volatile uint8_t TIMSK1;
+
+/** Timer/Counter2 */
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t TCNT2;
+extern volatile uint8_t OCR2A;
+extern volatile uint8_t OCR2B;
+extern volatile uint8_t TIMSK2;
+
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define WGM01 1
+#define WGM00 0
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define WGM13 4
+#define WGM12 3
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+
+/** USART0 */
+extern volatile uint8_t UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+extern volatile uint16_t UBRR0;
+/** reading takes the received byte, writing sends one */
+struct UsartDataRegister
+{
+  operator uint8_t();
+  UsartDataRegister &operator=(uint8_t b);
+};
+extern UsartDataRegister UDR0;
+
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ01 2
+#define UCSZ00 1
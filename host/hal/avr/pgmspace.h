@@ -0,0 +1,71 @@
+/**
+ * Host stand-in for avr-libc <avr/pgmspace.h>
+ * There is only one address space on the host.
+ */
+#pragma once
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+/** memcpy rather than a cast, these read fields of any type, like on the AVR */
+static inline uint8_t pgm_read_byte(const void *addr)
+{
+  uint8_t v;
+  memcpy(&v, addr, sizeof(v));
+  return v;
+}
+static inline uint16_t pgm_read_word(const void *addr)
+{
+  uint16_t v;
+  memcpy(&v, addr, sizeof(v));
+  return v;
+}
+static inline uint32_t pgm_read_dword(const void *addr)
+{
+  uint32_t v;
+  memcpy(&v, addr, sizeof(v));
+  return v;
+}
+static inline void *pgm_read_ptr(const void *addr)
+{
+  void *v;
+  memcpy(&v, addr, sizeof(v));
+  return v;
+}
+
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define strcpy_P strcpy
+
+/**
+ * avr-libc printf takes %S for a PROGMEM string, which is %s here - and a
+ * wide string to the host libc, hence the format is rewritten.
+ */
+static inline int sprintf_P(char *buf, const char *fmt, ...)
+{
+  char f[256];
+  size_t n = 0;
+  for(const char *p = fmt; *p != 0 && n < sizeof(f) - 1; p++)
+  {
+    f[n++] = *p;
+    if(*p != '%')
+      continue;
+    while(p[1] != 0 && strchr("-+ #0123456789.lh", p[1]) != 0 && n < sizeof(f) - 1)
+      f[n++] = *++p;
+    if(p[1] != 0 && n < sizeof(f) - 1)
+      f[n++] = (*++p == 'S') ? 's' : *p;
+  }
+  f[n] = 0;
+  va_list ap;
+  va_start(ap, fmt);
+  int res = vsprintf(buf, f, ap);
+  va_end(ap);
+  return res;
+}
@@ -0,0 +1,15 @@
+/**
+ * Host stand-in for avr-libc <avr/sleep.h>
+ * sleep_cpu() lets the simulator move the clock to the next interrupt.
+ */
+#pragma once
+#include "io.h"
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable();
+void sleep_disable();
+/** no-op unless sleep_enable() was called */
+void sleep_cpu();
@@ -0,0 +1,20 @@
+/**
+ * Host stand-in for avr-libc <util/crc16.h>
+ */
+#pragma once
+#include <stdint.h>
+
+/** CRC-CCITT polynomial 0x1021, MSB first, as in XMODEM */
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    if(crc & 0x8000)
+      crc = (crc << 1) ^ 0x1021;
+    else
+      crc <<= 1;
+  }
+  return crc;
+}
+
@@ -0,0 +1,137 @@
+/**
+ * Host stand-in for the Arduino core wiring functions, backed by the simulator
+ */
+#include "Arduino.h"
+#include "../sim/Sim.h"
+
+static uint8_t g_analogReference = DEFAULT;
+
+void cli()
+{
+  SREG &= ~_BV(SREG_I);
+}
+
+void sei()
+{
+  SREG |= _BV(SREG_I);
+  sim::tick();
+}
+
+static bool g_sleepEnabled = false;
+
+void set_sleep_mode(uint8_t mode)
+{
+  sim::tick();
+}
+
+void sleep_enable()
+{
+  g_sleepEnabled = true;
+}
+
+void sleep_disable()
+{
+  g_sleepEnabled = false;
+}
+
+void sleep_cpu()
+{
+  if(g_sleepEnabled)
+    sim::sleep();
+}
+
+unsigned long millis()
+{
+  sim::tick();
+  return (unsigned long)(sim::timer0Micros() / 1000);
+}
+
+unsigned long micros()
+{
+  sim::tick();
+  return (unsigned long)sim::timer0Micros();
+}
+
+/** waits for millis() to move by ms, whatever Timer0 prescaler is */
+void __attribute__((weak)) yield(void)
+{
+}
+
+void delay(unsigned long ms)
+{
+  uint64_t start = sim::timer0Micros();
+  uint64_t wait = (uint64_t)ms * 1000;
+  while(sim::timer0Micros() - start < wait)
+  {
+    yield();
+    sim::advance(100);
+  }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  sim::advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  sim::tick();
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  sim::tick();
+  sim::setPinDuty(pin, (val == LOW) ? 0 : 255);
+}
+
+int digitalRead(uint8_t pin)
+{
+  sim::tick();
+  return (sim::getPinDuty(pin) >= 128) ? HIGH : LOW;
+}
+
+void analogReference(uint8_t mode)
+{
+  g_analogReference = mode;
+}
+
+/** blocking conversion, like the real one */
+int analogRead(uint8_t pin)
+{
+  if(pin >= A0)
+    pin -= A0;
+  ADMUX = (g_analogReference << 6) | (pin & 0x07);
+  ADCSRA |= _BV(ADEN) | _BV(ADSC);
+  while(ADCSRA & _BV(ADSC))
+    sim::tick();
+  return ADC;
+}
+
+void analogWrite(uint8_t pin, int val)
+{
+  sim::tick();
+  switch(pin)
+  {
+    case 3: case 5: case 6: case 9: case 10: case 11:
+      sim::setPinDuty(pin, (uint8_t)constrain(val, 0, 255));
+      break;
+    default:
+      sim::setPinDuty(pin, (val < 128) ? 0 : 255);
+      break;
+  }
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+  sim::setInterruptHandler(interruptNum, userFunc);
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+  sim::setInterruptHandler(interruptNum, 0);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
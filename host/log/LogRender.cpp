@@ -0,0 +1,96 @@
+/**
+ * Log record rendering, see LogRender.h
+ */
+#include <stdio.h>
+#include "LogRender.h"
+
+bool LogArgs::varint(unsigned long &value)
+{
+  value = 0;
+  for(int shift = 0; !atEnd(); shift += 7)
+  {
+    uint8_t b = m_payload[m_pos++];
+    value |= (unsigned long)(b & 0x7F) << shift;
+    if((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool LogArgs::zigzag(long &value)
+{
+  unsigned long z;
+  if(!varint(z))
+    return false;
+  value = (z & 1) ? -(long)(z >> 1) - 1 : (long)(z >> 1);
+  return true;
+}
+
+bool LogArgs::string(std::string &s)
+{
+  if(atEnd())
+    return false;
+  size_t len = m_payload[m_pos++];
+  if(m_pos + len > m_payload.size())
+    return false;
+  s.assign(m_payload.begin() + m_pos, m_payload.begin() + m_pos + len);
+  m_pos += len;
+  return true;
+}
+
+std::string logRender(const char *format, LogArgs &args)
+{
+  std::string res;
+  char buf[64];
+  for(const char *p = format; *p != 0; p++)
+  {
+    if(*p != '%')
+    {
+      res += *p;
+      continue;
+    }
+    p++;
+    if(*p == '%')
+    {
+      res += '%';
+      continue;
+    }
+    if(*p == 'l')
+      p++;
+    if(*p == 0)
+      break;
+    long l;
+    unsigned long ul;
+    std::string s;
+    switch(*p)
+    {
+      case 'd':
+      case 'i':
+        if(!args.zigzag(l))
+          break;
+        snprintf(buf, sizeof(buf), "%ld", l);
+        res += buf;
+        continue;
+      case 'c':
+        if(!args.varint(ul))
+          break;
+        res += (char)ul;
+        continue;
+      case 'u':
+      case 'x':
+      case 'X':
+        if(!args.varint(ul))
+          break;
+        snprintf(buf, sizeof(buf), (*p == 'u') ? "%lu" : (*p == 'x') ? "%lx" : "%lX", ul);
+        res += buf;
+        continue;
+      case 's':
+        if(!args.string(s))
+          break;
+        res += s;
+        continue;
+    }
+    res += '?';
+  }
+  return res;
+}
@@ -0,0 +1,32 @@
+/**
+ * Log record arguments decoding and message rendering, see Trace.h for the
+ * record format.  Shared by fclog and its test.
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** log record arguments */
+class LogArgs
+{
+public:
+  LogArgs(const std::vector<uint8_t> &payload, size_t pos) :
+    m_payload(payload), m_pos(pos)
+  {
+  }
+  bool atEnd()
+  {
+    return m_pos >= m_payload.size();
+  }
+  bool varint(unsigned long &value);
+  bool zigzag(long &value);
+  bool string(std::string &s);
+
+private:
+  const std::vector<uint8_t> &m_payload;
+  size_t m_pos;
+};
+
+/** the message with its arguments, a missing argument is rendered as ? */
+std::string logRender(const char *format, LogArgs &args);
@@ -0,0 +1,19 @@
+/**
+ * Log messages of the firmware, generated from its sources by loggen
+ */
+#pragma once
+
+struct LogMessage
+{
+  unsigned id;
+  /** ERROR, WARN, INFO, DEBUG */
+  const char *level;
+  /** logXXX module w/o the log */
+  const char *module;
+  /** file:line */
+  const char *where;
+  const char *format;
+};
+
+extern const LogMessage g_logMessages[];
+extern const unsigned g_logMessageCount;
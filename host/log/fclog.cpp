@@ -0,0 +1,120 @@
+/**
+ * Log record renderer: reads what the controller sends, renders the bcLog
+ * frames in it, see Trace.h, passes the text through and drops the other
+ * frames.  The message formats are generated from the firmware sources by
+ * loggen, so this has to be rebuilt along with the firmware.
+ *
+ *   fclog [FILE]
+ *
+ * FILE defaults to stdin, e.g.
+ *   fancontroller_sim --seconds 60 | fclog
+ *   stty -F /dev/ttyUSB0 115200 raw && fclog /dev/ttyUSB0
+ *
+ * A record is printed as:
+ *   [ms] LEVEL Module: message
+ * ms being the low 16 bits of the controller nowMillis(), records lost on
+ * the way are reported from the gaps in their seq.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+#include "LogRender.h"
+#include "LogTable.h"
+
+/** the bits of BinaryCommand.h we need */
+static const uint8_t bcSof = 0xA5;
+static const uint8_t bcMaxPayload = 40;
+static const uint8_t bcLog = 0x42;
+
+/** CRC-CCITT, same as avr-libc _crc_xmodem_update */
+static uint16_t crcUpdate(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for(int i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+int main(int argc, char *argv[])
+{
+  int fd = 0;
+  if(argc > 1 && (fd = open(argv[1], O_RDONLY | O_NOCTTY)) < 0)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  std::map<unsigned, const LogMessage *> messages;
+  for(unsigned i = 0; i < g_logMessageCount; i++)
+    messages[g_logMessages[i].id] = &g_logMessages[i];
+
+  std::vector<uint8_t> in;
+  bool bEof = false;
+  int seq = -1;
+  while(!bEof || !in.empty())
+  {
+    uint8_t buf[256];
+    ssize_t n = bEof ? 0 : read(fd, buf, sizeof(buf));
+    if(n <= 0)
+      bEof = true;
+    else
+      in.insert(in.end(), buf, buf + n);
+    size_t pos = 0;
+    while(pos < in.size())
+    {
+      if(in[pos] != bcSof)
+      {
+        fputc(in[pos++], stdout);
+        continue;
+      }
+      // wait for the rest of what might be a frame
+      size_t avail = in.size() - pos;
+      if(avail < 2 && !bEof)
+        break;
+      uint8_t len = (avail < 2) ? 0 : in[pos + 1];
+      bool bFrame = (len >= 2 && len <= bcMaxPayload);
+      if(bFrame && avail < 4u + len)
+      {
+        if(!bEof)
+          break;
+        bFrame = false;
+      }
+      if(bFrame)
+      {
+        uint16_t crc = crcUpdate(0xFFFF, len);
+        for(uint8_t i = 0; i < len; i++)
+          crc = crcUpdate(crc, in[pos + 2 + i]);
+        bFrame = (in[pos + 2 + len] == (uint8_t)crc && in[pos + 3 + len] == (uint8_t)(crc >> 8));
+      }
+      if(!bFrame)
+      {
+        // a 0xA5 in the text
+        fputc(in[pos++], stdout);
+        continue;
+      }
+      std::vector<uint8_t> payload(in.begin() + pos + 2, in.begin() + pos + 2 + len);
+      pos += 4 + len;
+      if(payload[0] != bcLog || payload.size() < 6)
+        continue;
+      if(seq >= 0 && ((seq + 1) & 0xFF) != payload[1])
+        printf("[lost %d log records]\n", (payload[1] - seq - 1) & 0xFF);
+      seq = payload[1];
+      unsigned id = payload[2] | (payload[3] << 8);
+      unsigned ms = payload[4] | (payload[5] << 8);
+      LogArgs args(payload, 6);
+      auto it = messages.find(id);
+      if(it == messages.end())
+      {
+        printf("[%5u] unknown message 0x%04X\n", ms, id);
+        continue;
+      }
+      const LogMessage *m = it->second;
+      printf("[%5u] %-5s %s: %s\n", ms, m->level, m->module, logRender(m->format, args).c_str());
+    }
+    in.erase(in.begin(), in.begin() + pos);
+    fflush(stdout);
+  }
+  return 0;
+}
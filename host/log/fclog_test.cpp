@@ -0,0 +1,155 @@
+/**
+ * Log record round trip: the records are encoded by the firmware Trace.cpp
+ * and rendered the way fclog does it, with the message table loggen
+ * generates from this file.  Covers the message IDs, the zigzag and plain
+ * varints, the strings and the arguments which do not fit in a record.
+ *
+ *   fclog_test
+ *
+ * Prints the failed checks, the exit status is the # of them.
+ */
+#include <Arduino.h>
+#include <limits.h>
+#include <string>
+#include <vector>
+#include "Trace.h"
+#include "Fan.h"
+#include "TxQueue.h"
+#include "BinaryCommand.h"
+#include "LogRender.h"
+#include "LogTable.h"
+
+/** payload of the record sent last */
+static std::vector<uint8_t> g_sent;
+static int g_failed = 0;
+
+/** the firmware bits Trace.cpp sends the records with */
+bool BinaryCommand::sendFrame(TxChannel &out, const byte *payload, byte len)
+{
+  g_sent.assign(payload, payload + len);
+  return true;
+}
+unsigned long nowMillis()
+{
+  return 0x12345;
+}
+static byte g_txDebugBuf[2];
+TxChannel g_txDebug(g_txDebugBuf, sizeof(g_txDebugBuf));
+size_t TxChannel::write(uint8_t b)
+{
+  return 0;
+}
+int TxChannel::availableForWrite()
+{
+  return 0;
+}
+
+static void fail(int line, const char *what, const std::string &got, const std::string &expected)
+{
+  printf("fclog_test.cpp:%d: %s: got \"%s\", expected \"%s\"\n", line, what, got.c_str(), expected.c_str());
+  g_failed++;
+}
+
+/** the record sent last rendered is this, its header is as expected */
+static void expect(int line, const char *level, const std::string &expected)
+{
+  static int seq = -1;
+  if(g_sent.size() < 6 || g_sent.size() > logRecordMax || g_sent[0] != bcLog)
+  {
+    fail(line, "record", std::to_string(g_sent.size()) + " bytes", "a bcLog record");
+    return;
+  }
+  if(seq >= 0 && g_sent[1] != ((seq + 1) & 0xFF))
+    fail(line, "seq", std::to_string(g_sent[1]), std::to_string((seq + 1) & 0xFF));
+  seq = g_sent[1];
+  unsigned ms = g_sent[4] | (g_sent[5] << 8);
+  if(ms != 0x2345)
+    fail(line, "ms", std::to_string(ms), std::to_string(0x2345));
+  unsigned id = g_sent[2] | (g_sent[3] << 8);
+  const LogMessage *m = 0;
+  for(unsigned i = 0; i < g_logMessageCount && m == 0; i++)
+    if(g_logMessages[i].id == id)
+      m = &g_logMessages[i];
+  if(m == 0)
+  {
+    fail(line, "ID", std::to_string(id), "one loggen found");
+    return;
+  }
+  if(std::string(m->level) != level || std::string(m->module) != "Test")
+    fail(line, "level and module", std::string(m->level) + " " + m->module, std::string(level) + " Test");
+  LogArgs args(g_sent, 6);
+  std::string got = logRender(m->format, args);
+  if(got != expected)
+    fail(line, "message", got, expected);
+  if(!args.atEnd())
+    fail(line, "arguments", "more of them", "no more");
+  g_sent.clear();
+}
+
+/** the arguments of the record sent last are these bytes, checked before expect() */
+static void expectArgs(int line, const std::vector<uint8_t> &expected)
+{
+  std::vector<uint8_t> got;
+  if(g_sent.size() >= 6)
+    got.assign(g_sent.begin() + 6, g_sent.end());
+  if(got == expected)
+    return;
+  std::string sGot, sExpected;
+  char buf[4];
+  for(uint8_t b : got)
+    snprintf(buf, sizeof(buf), "%02X ", b), sGot += buf;
+  for(uint8_t b : expected)
+    snprintf(buf, sizeof(buf), "%02X ", b), sExpected += buf;
+  fail(line, "arguments", sGot, sExpected);
+}
+
+int main()
+{
+  // the same hash on both ends
+  LOG_ERROR(logTest, "no arguments");
+  expect(__LINE__, "ERROR", "no arguments");
+
+  // zigzag: 0, -1, 1, -2 are 0, 1, 2, 3, 63 and -64 the last ones in a byte
+  LOG_WARN(logTest, "signed %d %d %d %d %d %d", 0, -1, 1, -2, 63, -64);
+  expectArgs(__LINE__, { 0x00, 0x01, 0x02, 0x03, 0x7E, 0x7F });
+  expect(__LINE__, "WARN", "signed 0 -1 1 -2 63 -64");
+  LOG_INFO(logTest, "signed %d %d", 64, -65);
+  expectArgs(__LINE__, { 0x80, 0x01, 0x81, 0x01 });
+  expect(__LINE__, "INFO", "signed 64 -65");
+  short int sMin = SHRT_MIN;
+  LOG_DEBUG(logTest, "short %d %i", sMin, (short int)SHRT_MAX);
+  expect(__LINE__, "DEBUG", "short -32768 32767");
+  long lMin = -2147483647L - 1;
+  LOG_DEBUG(logTest, "long %ld %ld", lMin, 2147483647L);
+  expectArgs(__LINE__, { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0xFE, 0xFF, 0xFF, 0xFF, 0x0F });
+  expect(__LINE__, "DEBUG", "long -2147483648 2147483647");
+
+  // plain varints for the unsigned types, chars included
+  LOG_DEBUG(logTest, "unsigned %u %u %u %u", 0u, 127u, 128u, 16384u);
+  expectArgs(__LINE__, { 0x00, 0x7F, 0x80, 0x01, 0x80, 0x80, 0x01 });
+  expect(__LINE__, "DEBUG", "unsigned 0 127 128 16384");
+  LOG_DEBUG(logTest, "unsigned %lu %x %X %c", 4294967295UL, (byte)0xAB, 0xCDEFu, 'z');
+  expect(__LINE__, "DEBUG", "unsigned 4294967295 ab CDEF z");
+
+  // strings
+  char name[] = "cpu0";
+  LOG_INFO(logTest, "strings [%s] [%s] [%s]", "", name, (const char *)0);
+  expectArgs(__LINE__, { 0x00, 0x04, 'c', 'p', 'u', '0', 0x00 });
+  expect(__LINE__, "INFO", "strings [] [cpu0] []");
+
+  // 34 bytes for the arguments: a string is cut short, the rest dropped
+  std::string s40(40, 's');
+  LOG_DEBUG(logTest, "cut %s %u", s40.c_str(), 1u);
+  expect(__LINE__, "DEBUG", "cut " + std::string(33, 's') + " ?");
+  // an integer which does not fit is dropped, the smaller ones after it too
+  std::string s30(30, 's');
+  LOG_DEBUG(logTest, "dropped %s %lu %u", s30.c_str(), 4294967295UL, 7u);
+  expect(__LINE__, "DEBUG", "dropped " + s30 + " ? ?");
+  std::string s28(28, 's');
+  LOG_DEBUG(logTest, "fits %s %lu", s28.c_str(), 4294967295UL);
+  expect(__LINE__, "DEBUG", "fits " + s28 + " 4294967295");
+
+  if(g_failed == 0)
+    printf("fclog_test: all passed\n");
+  return g_failed;
+}
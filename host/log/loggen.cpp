@@ -0,0 +1,128 @@
+/**
+ * Log message table generator: finds the LOG_XXX(module, "format", ...) calls
+ * in the firmware sources and writes the table fclog renders the log records
+ * with, see Trace.h and LogTable.h.
+ *
+ *   loggen OUTPUT.cpp SOURCE...
+ *
+ * Fails if two different formats hash to the same message ID.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+
+struct Message
+{
+  std::string level;
+  std::string module;
+  std::string where;
+  /** as in the source, escapes and all */
+  std::string literal;
+  std::string format;
+};
+
+/** same as logHash() in Trace.h */
+static unsigned logHash(const std::string &s)
+{
+  uint32_t h = 2166136261u;
+  for(unsigned char c : s)
+    h = (h ^ c) * 16777619u;
+  return (h ^ (h >> 16)) & 0xFFFF;
+}
+
+/** the string the literal stands for, the usual escapes only */
+static std::string unescape(const std::string &literal)
+{
+  std::string res;
+  for(size_t i = 0; i < literal.size(); i++)
+  {
+    char c = literal[i];
+    if(c == '\\' && i + 1 < literal.size())
+    {
+      c = literal[++i];
+      if(c == 'n')
+        c = '\n';
+      else if(c == 't')
+        c = '\t';
+      else if(c == 'r')
+        c = '\r';
+    }
+    res += c;
+  }
+  return res;
+}
+
+static bool scan(const char *path, std::map<unsigned, Message> &messages)
+{
+  std::ifstream in(path);
+  if(!in)
+  {
+    fprintf(stderr, "loggen: can't read %s\n", path);
+    return false;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string text = ss.str();
+  static const std::regex re("LOG_(ERROR|WARN|INFO|DEBUG)\\s*\\(\\s*log(\\w+)\\s*,\\s*\"((?:[^\"\\\\]|\\\\.)*)\"");
+  for(std::sregex_iterator it(text.begin(), text.end(), re), end; it != end; ++it)
+  {
+    const std::smatch &m = *it;
+    Message msg;
+    msg.level = m[1];
+    msg.module = m[2];
+    msg.literal = m[3];
+    msg.format = unescape(msg.literal);
+    size_t line = 1 + std::count(text.begin(), text.begin() + m.position(0), '\n');
+    msg.where = std::string(path) + ":" + std::to_string(line);
+    unsigned id = logHash(msg.format);
+    auto found = messages.find(id);
+    if(found == messages.end())
+    {
+      messages[id] = msg;
+      continue;
+    }
+    // the same message logged in many places is fine
+    if(found->second.format != msg.format)
+    {
+      fprintf(stderr, "loggen: %s and %s: messages with the same ID 0x%04X, reword one\n",
+        found->second.where.c_str(), msg.where.c_str(), id);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3)
+  {
+    fprintf(stderr, "Usage: loggen OUTPUT.cpp SOURCE...\n");
+    return 2;
+  }
+  std::map<unsigned, Message> messages;
+  for(int i = 2; i < argc; i++)
+    if(!scan(argv[i], messages))
+      return 1;
+
+  FILE *out = fopen(argv[1], "w");
+  if(out == 0)
+  {
+    fprintf(stderr, "loggen: can't write %s\n", argv[1]);
+    return 1;
+  }
+  fprintf(out, "// generated by loggen, do not edit\n#include \"LogTable.h\"\n\n");
+  fprintf(out, "const LogMessage g_logMessages[] = {\n");
+  for(auto &it : messages)
+  {
+    const Message &m = it.second;
+    fprintf(out, "  {0x%04X, \"%s\", \"%s\", \"%s\", \"%s\"},\n", it.first, m.level.c_str(),
+      m.module.c_str(), m.where.c_str(), m.literal.c_str());
+  }
+  fprintf(out, "};\nconst unsigned g_logMessageCount = %u;\n", (unsigned)messages.size());
+  return (fclose(out) == 0) ? 0 : 1;
+}
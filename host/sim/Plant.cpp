@@ -0,0 +1,91 @@
+/**
+ * Simulated fans and box
+ */
+#include <math.h>
+#include "Arduino.h"
+#include "Plant.h"
+
+namespace sim
+{
+
+FanModel::FanModel(uint8_t pinPwm, uint8_t pinSensor) :
+  m_pinPwm(pinPwm), m_pinSensor(pinSensor)
+{
+}
+
+double FanModel::getDuty()
+{
+  return getPinDutyCycle(m_pinPwm);
+}
+
+double FanModel::getPwmHz()
+{
+  return getPinPwmHz(m_pinPwm);
+}
+
+void FanModel::onAdvance(uint64_t dt)
+{
+  double duty = getDuty();
+  if(stuckFrom >= 0)
+  {
+    double t = now() / 1e6;
+    stuck = (t >= stuckFrom && (stuckFor < 0 || t < stuckFrom + stuckFor));
+  }
+  if(stuck)
+  {
+    // jammed, stops dead
+    m_spinning = false;
+    m_rpm = 0;
+  }
+  else if(!m_spinning && duty >= dutyStart)
+    m_spinning = true;
+  else if(m_spinning && duty < dutyStop && m_rpm < rpmMin)
+    m_spinning = false;
+  double target = 0;
+  if(m_spinning && duty >= dutyStop)
+    target = rpmMin + (rpmMax - rpmMin) * (duty - dutyStop) / (1 - dutyStop);
+  double dts = dt / 1e6;
+  m_rpm += (target - m_rpm) * (1 - exp(-dts / tau));
+  if(target == 0 && m_rpm < 1)
+    m_rpm = 0;
+  // 2 pulses per revolution
+  m_phase += m_rpm / 30 * dts;
+}
+
+uint64_t FanModel::nextEvent()
+{
+  if(m_pinSensor == 0 || m_rpm <= 0)
+    return UINT64_MAX;
+  if(m_phase >= 1 - 1e-9)
+    return now();
+  return now() + (uint64_t)ceil((1 - m_phase) * 30e6 / m_rpm);
+}
+
+void FanModel::onEvent()
+{
+  // the speed could have changed since nextEvent() was called
+  if(m_phase < 1 - 1e-9)
+    return;
+  m_phase -= 1;
+  if(m_phase < 0 || m_phase >= 1)
+    m_phase = 0;
+  raiseInterrupt(digitalPinToInterrupt(m_pinSensor));
+}
+
+double ThermalModel::getEquilibrium()
+{
+  double airflow = 0;
+  for(int i = 0; i < m_numFans; i++)
+    airflow += m_fans[i]->getAirflow();
+  double h = heat;
+  if(heatPeriod > 0 && fmod(now() / 1e6, heatPeriod) >= heatPeriod / 2)
+    h = 0;
+  return ambient + h / (g0 + g1 * airflow);
+}
+
+void ThermalModel::onAdvance(uint64_t dt)
+{
+  temp += (getEquilibrium() - temp) * (1 - exp(-(dt / 1e6) / tau));
+}
+
+}
@@ -0,0 +1,108 @@
+/**
+ * Simulated world around the board: fans and the box they cool.
+ */
+#pragma once
+#include "Sim.h"
+
+namespace sim
+{
+
+/**
+ * PWM controlled fan with a 2 pulses per revolution tach.
+ * Starts once the duty reaches dutyStart, stalls below dutyStop,
+ * speed follows the duty with a first order lag.
+ */
+class FanModel : public Device
+{
+public:
+  FanModel(uint8_t pinPwm, uint8_t pinSensor);
+
+  /** RPM at 100% duty */
+  double rpmMax = 2000;
+  /** RPM at dutyStop */
+  double rpmMin = 400;
+  /** duty needed to start the fan from stop, 0..1 */
+  double dutyStart = 0.22;
+  /** below this duty the spinning fan stalls, 0..1 */
+  double dutyStop = 0.11;
+  /** spin up/down time constant, s */
+  double tau = 1.5;
+  /** stuck rotor: no rotation whatever the duty */
+  bool stuck = false;
+  /** when not negative, the rotor jams this many s in, for stuckFor s or for good */
+  double stuckFrom = -1;
+  double stuckFor = -1;
+
+  double getRPM()
+  {
+    return m_rpm;
+  }
+  /** commanded duty 0..1 */
+  double getDuty();
+  /** PWM frequency it is driven at */
+  double getPwmHz();
+  /** airflow relative to the max one, 0..1 */
+  double getAirflow()
+  {
+    return m_rpm / rpmMax;
+  }
+
+  uint64_t nextEvent();
+  void onEvent();
+  void onAdvance(uint64_t dt);
+
+private:
+  uint8_t m_pinPwm;
+  uint8_t m_pinSensor;
+  double m_rpm = 0;
+  bool m_spinning = false;
+  /** fraction of the tach period since the last edge */
+  double m_phase = 0;
+};
+
+/**
+ * Box with a heat source cooled by the fans, sensed by the LM35.
+ * Equilibrium temperature is ambient + heat / (g0 + g1 * airflow), airflow
+ * being the sum over the fans, the box gets there with a first order lag.
+ */
+class ThermalModel : public Device
+{
+public:
+  ThermalModel(FanModel **fans, int numFans) :
+    m_fans(fans), m_numFans(numFans)
+  {
+  }
+
+  /** ambient temperature, C */
+  double ambient = 25;
+  /** heat load in C of rise over ambient with no airflow */
+  double heat = 20;
+  /** when non zero, heat is switched on and off with this period, s */
+  double heatPeriod = 0;
+  /** conductance w/o airflow and per unit of airflow */
+  double g0 = 1;
+  double g1 = 3;
+  /** thermal time constant, s */
+  double tau = 60;
+
+  /** current box temperature, C */
+  double temp = 25;
+
+  /** box temperature the current heat and airflow lead to */
+  double getEquilibrium();
+
+  uint64_t nextEvent()
+  {
+    return UINT64_MAX;
+  }
+  void onEvent()
+  {
+  }
+  void onAdvance(uint64_t dt);
+
+private:
+  FanModel **m_fans;
+  int m_numFans;
+};
+
+}
@@ -0,0 +1,359 @@
+/**
+ * Simulated ATmega328P: virtual clock, registers, ADC, Timer0, Timer1 PWM,
+ * INTx, USART.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <random>
+#include <vector>
+#include "Arduino.h"
+#include "Sim.h"
+
+/**
+ * Registers
+ */
+volatile uint8_t SREG = 0;
+volatile uint8_t ADMUX = 0;
+volatile uint8_t ADCSRA = 0;
+volatile uint8_t ADCSRB = 0;
+volatile uint16_t ADC = 0;
+volatile uint8_t TCCR0A = 0;
+volatile uint8_t TCCR0B = 0;
+volatile uint8_t TCNT0 = 0;
+volatile uint8_t OCR0A = 0;
+volatile uint8_t OCR0B = 0;
+volatile uint8_t TIMSK0 = 0;
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint16_t TCNT1 = 0;
+volatile uint16_t OCR1A = 0;
+volatile uint16_t OCR1B = 0;
+volatile uint16_t ICR1 = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint8_t TCCR2A = 0;
+volatile uint8_t TCCR2B = 0;
+volatile uint8_t TCNT2 = 0;
+volatile uint8_t OCR2A = 0;
+volatile uint8_t OCR2B = 0;
+volatile uint8_t TIMSK2 = 0;
+
+/** default vectors, the firmware overrides those it uses */
+extern "C" void __attribute__((weak)) ADC_vect(void)
+{
+}
+extern "C" void __attribute__((weak)) USART_RX_vect(void)
+{
+  uint8_t b = UDR0;
+  (void)b;
+}
+extern "C" void __attribute__((weak)) USART_UDRE_vect(void)
+{
+  UCSR0B &= ~_BV(UDRIE0);
+}
+
+namespace sim
+{
+
+/** CPU clock */
+static const uint64_t F_CPU_HZ = 16000000;
+
+/** virtual time, us */
+static uint64_t g_now = 0;
+/** Timer0 driven fake time in 1/16 us */
+static uint64_t g_timer0Fake16 = 0;
+
+/** pacing against the wall clock */
+static double g_speed = 0;
+static uint64_t g_paceVirt = 0;
+static struct timespec g_paceWall;
+
+static std::vector<Device *> g_devices;
+
+static uint8_t g_pinDuty[numPins];
+static std::function<double()> g_analog[8];
+
+static void (*g_intHandler[2])(void) = {0, 0};
+static bool g_intPending[2] = {false, false};
+
+/** true while an ISR runs */
+static bool g_inISR = false;
+
+static std::mt19937 g_rng(1);
+
+uint64_t now()
+{
+  return g_now;
+}
+
+uint64_t timer0Micros()
+{
+  return g_timer0Fake16 / 16;
+}
+
+void setSpeed(double speed)
+{
+  g_speed = speed;
+  g_paceVirt = g_now;
+  clock_gettime(CLOCK_MONOTONIC, &g_paceWall);
+}
+
+/** sleep if the virtual clock got ahead of the wall clock */
+static void pace()
+{
+  if(g_speed <= 0)
+    return;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  double wallUs = (ts.tv_sec - g_paceWall.tv_sec) * 1e6 + (ts.tv_nsec - g_paceWall.tv_nsec) / 1e3;
+  double aheadUs = (g_now - g_paceVirt) / g_speed - wallUs;
+  if(aheadUs > 2000)
+    usleep((useconds_t)aheadUs);
+}
+
+uint8_t getPinDuty(uint8_t pin)
+{
+  return (pin < numPins) ? g_pinDuty[pin] : 0;
+}
+/** Timer1 TOP: ICR1 in the modes with WGM13 set, 8 bits in the Arduino default one */
+static uint16_t timer1Top()
+{
+  return (TCCR1B & _BV(WGM13)) ? ICR1 : 0xFF;
+}
+
+double getPinDutyCycle(uint8_t pin)
+{
+  uint16_t top = timer1Top();
+  if(pin == 9 && (TCCR1A & _BV(COM1A1)) && top != 0)
+    return (OCR1A >= top) ? 1.0 : (double)OCR1A / top;
+  if(pin == 10 && (TCCR1A & _BV(COM1B1)) && top != 0)
+    return (OCR1B >= top) ? 1.0 : (double)OCR1B / top;
+  return getPinDuty(pin) / 255.0;
+}
+
+double getPinPwmHz(uint8_t pin)
+{
+  static const double prescalers01[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  static const double prescalers2[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+  double p = 0;
+  double clocks = 0;
+  switch(pin)
+  {
+    case 5: case 6:
+      // fast PWM
+      p = prescalers01[TCCR0B & 0x07];
+      clocks = 256;
+      break;
+    case 9: case 10:
+      // phase correct, counts up and down
+      p = prescalers01[TCCR1B & 0x07];
+      clocks = 2.0 * timer1Top();
+      break;
+    case 3: case 11:
+      // phase correct 8 bits
+      p = prescalers2[TCCR2B & 0x07];
+      clocks = 510;
+      break;
+  }
+  return (p == 0 || clocks == 0) ? 0 : F_CPU_HZ / (p * clocks);
+}
+
+void setPinDuty(uint8_t pin, uint8_t duty)
+{
+  if(pin < numPins)
+    g_pinDuty[pin] = duty;
+}
+void setAnalogSource(uint8_t pin, std::function<double()> volts)
+{
+  if(pin >= A0)
+    pin -= A0;
+  if(pin < 8)
+    g_analog[pin] = volts;
+}
+void setInterruptHandler(uint8_t num, void (*handler)(void))
+{
+  if(num < 2)
+    g_intHandler[num] = handler;
+}
+void raiseInterrupt(uint8_t num)
+{
+  if(num < 2 && g_intHandler[num] != 0)
+    g_intPending[num] = true;
+}
+void addDevice(Device *dev)
+{
+  g_devices.push_back(dev);
+}
+
+/**
+ * ADC: single conversions started by ADSC, 13 ADC clocks each.
+ */
+class AdcDevice : public Device
+{
+public:
+  uint64_t nextEvent()
+  {
+    if(!m_busy && (ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADSC)))
+    {
+      static const uint8_t prescalers[] = { 2, 2, 4, 8, 16, 32, 64, 128 };
+      uint64_t clocks = 13 * prescalers[ADCSRA & 0x07];
+      m_busy = true;
+      m_doneAt = g_now + (clocks * 1000000 + F_CPU_HZ - 1) / F_CPU_HZ;
+    }
+    return m_busy ? m_doneAt : UINT64_MAX;
+  }
+  void onEvent()
+  {
+    m_busy = false;
+    ADC = sample();
+    ADCSRA = (ADCSRA & ~_BV(ADSC)) | _BV(ADIF);
+  }
+
+private:
+  bool m_busy = false;
+  uint64_t m_doneAt = 0;
+
+  uint16_t sample()
+  {
+    double ref;
+    switch(ADMUX >> 6)
+    {
+      case 3:
+        ref = 1.1;
+        break;
+      default:
+        ref = 5.0;
+        break;
+    }
+    uint8_t ch = ADMUX & 0x0F;
+    double volts = (ch < 8 && g_analog[ch]) ? g_analog[ch]() : 0;
+    // +-1 LSB of noise
+    long res = (long)(volts / ref * 1024) + (long)(g_rng() % 3) - 1;
+    return (uint16_t)constrain(res, 0L, 1023L);
+  }
+};
+static AdcDevice g_adcDevice;
+
+/** run the ISRs which are due, only if interrupts are enabled.  True if any was. */
+static bool deliverInterrupts()
+{
+  bool res = false;
+  if(g_inISR)
+    return res;
+  for(;;)
+  {
+    if(!(SREG & _BV(SREG_I)))
+      return res;
+    void (*isr)(void) = 0;
+    // in the AVR vector priority order
+    if(g_intPending[0])
+    {
+      g_intPending[0] = false;
+      isr = g_intHandler[0];
+    }
+    else if(g_intPending[1])
+    {
+      g_intPending[1] = false;
+      isr = g_intHandler[1];
+    }
+    else if((UCSR0B & _BV(RXCIE0)) && (UCSR0A & _BV(RXC0)))
+    {
+      // cleared by reading UDR0
+      isr = USART_RX_vect;
+    }
+    else if((UCSR0B & _BV(UDRIE0)) && (UCSR0A & _BV(UDRE0)))
+    {
+      // cleared by writing UDR0 or UDRIE0
+      isr = USART_UDRE_vect;
+    }
+    else if((ADCSRA & _BV(ADIE)) && (ADCSRA & _BV(ADIF)))
+    {
+      ADCSRA &= ~_BV(ADIF);
+      isr = ADC_vect;
+    }
+    if(isr == 0)
+      return res;
+    g_inISR = true;
+    SREG &= ~_BV(SREG_I);
+    (*isr)();
+    SREG |= _BV(SREG_I);
+    g_inISR = false;
+    res = true;
+  }
+}
+
+/** Timer0 prescaler as set by CS0x bits, 0 if stopped */
+static uint64_t timer0Prescaler()
+{
+  static const uint64_t prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  return prescalers[TCCR0B & 0x07];
+}
+
+/** move the clock to t, no events */
+static void moveClock(uint64_t t)
+{
+  if(t <= g_now)
+    return;
+  uint64_t dt = t - g_now;
+  g_now = t;
+  uint64_t p = timer0Prescaler();
+  if(p != 0)
+    g_timer0Fake16 += dt * 1024 / p;
+  for(size_t i = 0; i < g_devices.size(); i++)
+    g_devices[i]->onAdvance(dt);
+  serialPoll();
+  pace();
+}
+
+/** move the clock to target, or until wake() is true after an ISR */
+static void advanceTo(uint64_t target, bool (*wake)())
+{
+  for(;;)
+  {
+    if(deliverInterrupts() && wake != 0 && (*wake)())
+      return;
+    // find the earliest event
+    Device *next = &g_adcDevice;
+    uint64_t tNext = g_adcDevice.nextEvent();
+    for(size_t i = 0; i < g_devices.size(); i++)
+    {
+      uint64_t t = g_devices[i]->nextEvent();
+      if(t < tNext)
+      {
+        tNext = t;
+        next = g_devices[i];
+      }
+    }
+    if(tNext > target)
+      break;
+    moveClock(tNext);
+    next->onEvent();
+  }
+  moveClock(target);
+  deliverInterrupts();
+}
+
+void advance(uint64_t us)
+{
+  advanceTo(g_now + us, 0);
+}
+
+void idle(uint64_t us, bool (*wake)())
+{
+  advanceTo(g_now + us, wake);
+}
+
+void sleep()
+{
+  // Timer0 overflow interrupt, unless the timer is stopped
+  uint64_t p = timer0Prescaler();
+  idle((p == 0) ? 100000 : 256 * p * 1000000 / F_CPU_HZ, []() { return true; });
+}
+
+void tick()
+{
+  advance(1);
+}
+
+}
@@ -0,0 +1,109 @@
+/**
+ * Simulated ATmega328P board running the firmware on the host.
+ *
+ * The virtual clock only moves when the firmware calls into the HAL (every
+ * call costs a little bit of time, delay() costs what it says) or when the
+ * main loop is idle.  As the clock moves the simulator plays the part of the
+ * peripherals: ADC conversions, Timer0 driving millis(), Timer1 PWM, tach edges from the
+ * simulated fans, the serial line.  ISRs are called when their interrupt is
+ * raised and SREG I bit is set, i.e. never nested.
+ */
+#pragma once
+#include <stdint.h>
+#include <functional>
+
+namespace sim
+{
+
+/** virtual time since power up, in real (not Timer0 scaled) microseconds */
+uint64_t now();
+/** move the virtual clock by this many us, running peripherals and ISRs */
+void advance(uint64_t us);
+/** cost of a single HAL call */
+void tick();
+/**
+ * The firmware has nothing to do: move the virtual clock by up to this many
+ * us, stop early once an ISR made wake() true, e.g. signaled a task
+ */
+void idle(uint64_t us, bool (*wake)());
+/**
+ * The MCU sleeps: move the virtual clock until an ISR ran, at most till the
+ * next Timer0 overflow interrupt
+ */
+void sleep();
+
+/**
+ * How fast the virtual clock goes relative to the wall clock.
+ * 1 is real time, 100 is 100 times faster, 0 is as fast as possible.
+ */
+void setSpeed(double speed);
+
+/** fake microseconds as counted by millis()/micros(), follow Timer0 prescaler */
+uint64_t timer0Micros();
+
+/**
+ * Pins
+ */
+const uint8_t numPins = 22;
+/** last analogWrite() or digitalWrite() on the pin as a 0..255 duty */
+uint8_t getPinDuty(uint8_t pin);
+void setPinDuty(uint8_t pin, uint8_t duty);
+/**
+ * Duty cycle 0..1 the pin is driven at: by the timer compare output if it is
+ * connected to the pin, as set in the timer registers, by getPinDuty() if not
+ */
+double getPinDutyCycle(uint8_t pin);
+/** PWM frequency of the timer behind the pin, as set in its registers, 0 if none */
+double getPinPwmHz(uint8_t pin);
+/** analog input pin voltage comes from this function */
+void setAnalogSource(uint8_t pin, std::function<double()> volts);
+/** external interrupts INT0/INT1 */
+void setInterruptHandler(uint8_t num, void (*handler)(void));
+/** raise INTn, the handler runs as soon as interrupts are enabled */
+void raiseInterrupt(uint8_t num);
+
+/**
+ * Anything that needs to happen at a particular virtual time, e.g. a tach edge.
+ */
+class Device
+{
+public:
+  virtual ~Device()
+  {
+  }
+  /** virtual time of the next event, UINT64_MAX for none */
+  virtual uint64_t nextEvent() = 0;
+  /** time has come to now(), which is at or past nextEvent() */
+  virtual void onEvent() = 0;
+  /** time moved by dt us, for continuous models */
+  virtual void onAdvance(uint64_t dt)
+  {
+  }
+};
+/** simulator does not own the device */
+void addDevice(Device *dev);
+
+/**
+ * USART0 the firmware talks to, see the registers in avr/io.h
+ */
+/** use these file descriptors, -1 for none.  crlf translates \n into \r on input */
+void serialOpen(int fdIn, int fdOut, bool crlf);
+/** open a pty and use it, returns the slave name */
+const char *serialOpenPty();
+/** let the firmware ISR send what it has queued, then flush host side buffers */
+void serialFlush();
+/** flush host side buffers */
+void serialSync();
+/** take the bytes from the host, called as the time moves */
+void serialPoll();
+
+/**
+ * EEPROM, erased (all 0xFF) unless loaded from a file
+ */
+/** false if the file could not be read */
+bool eepromLoad(const char *path);
+bool eepromSave(const char *path);
+/** # of bytes actually written since power up */
+unsigned long eepromWrites();
+
+}
@@ -0,0 +1,92 @@
+/**
+ * Simulated EEPROM, 1KB as on the ATmega328P
+ */
+#include <stdio.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include "Sim.h"
+
+namespace sim
+{
+
+/** erased, i.e. all 0xFF, until loaded from a file */
+static struct Eeprom
+{
+  uint8_t data[E2END + 1];
+  Eeprom()
+  {
+    memset(data, 0xFF, sizeof(data));
+  }
+} g_eeprom;
+/** erase and write of a byte takes this long */
+static const uint64_t eepromWriteUs = 3400;
+/** when the write in progress completes */
+static uint64_t g_busyUntil = 0;
+static unsigned long g_writes = 0;
+
+bool eepromLoad(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if(f == 0)
+    return false;
+  size_t n = fread(g_eeprom.data, 1, sizeof(g_eeprom.data), f);
+  fclose(f);
+  return (n == sizeof(g_eeprom.data));
+}
+
+bool eepromSave(const char *path)
+{
+  FILE *f = fopen(path, "wb");
+  if(f == 0)
+    return false;
+  size_t n = fwrite(g_eeprom.data, 1, sizeof(g_eeprom.data), f);
+  return (fclose(f) == 0 && n == sizeof(g_eeprom.data));
+}
+
+unsigned long eepromWrites()
+{
+  return g_writes;
+}
+
+}
+
+bool eeprom_is_ready()
+{
+  sim::tick();
+  return (sim::now() >= sim::g_busyUntil);
+}
+
+void eeprom_busy_wait()
+{
+  uint64_t now = sim::now();
+  if(now < sim::g_busyUntil)
+    sim::advance(sim::g_busyUntil - now);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+  eeprom_busy_wait();
+  sim::tick();
+  return sim::g_eeprom.data[(uintptr_t)addr & E2END];
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+  for(size_t i = 0; i < n; i++)
+    ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+  eeprom_busy_wait();
+  sim::tick();
+  sim::g_eeprom.data[(uintptr_t)addr & E2END] = value;
+  sim::g_busyUntil = sim::now() + sim::eepromWriteUs;
+  sim::g_writes++;
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+  if(eeprom_read_byte(addr) != value)
+    eeprom_write_byte(addr, value);
+}
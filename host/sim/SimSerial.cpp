@@ -0,0 +1,240 @@
+/**
+ * Simulated USART0, the host end is stdin/stdout or a pty.
+ * A byte takes 10 bit times on the line either way, at the baud rate set
+ * in UBRR0.  RX has the 2 byte FIFO of the real thing, a byte coming into a
+ * full one is lost and DOR0 is set.  TX has the data register in front of
+ * the shift register, UDRE0 tells when the former is free.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <vector>
+#include <deque>
+#include "avr/io.h"
+#include "Sim.h"
+
+/**
+ * Registers
+ */
+volatile uint8_t UCSR0A = _BV(UDRE0);
+volatile uint8_t UCSR0B = 0;
+volatile uint8_t UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+volatile uint16_t UBRR0 = 0;
+UsartDataRegister UDR0;
+
+namespace sim
+{
+
+static int g_fdIn = -1;
+static int g_fdOut = -1;
+static bool g_crlf = false;
+/** bytes from the host which are not on the line yet */
+static std::deque<uint8_t> g_rxHost;
+/** bytes off the line to be written to the host */
+static std::vector<uint8_t> g_txHost;
+static uint64_t g_lastPoll = 0;
+/** CPU clock, same as in Sim.cpp */
+static const uint64_t F_CPU_HZ = 16000000;
+
+/** time one byte takes on the line, 10 bits, us */
+static uint64_t byteUs()
+{
+  uint64_t div = (UCSR0A & _BV(U2X0)) ? 8 : 16;
+  uint64_t baud = F_CPU_HZ / (div * (UBRR0 + 1));
+  return (10 * 1000000ULL + baud - 1) / baud;
+}
+
+class UsartDevice : public Device
+{
+public:
+  uint64_t nextEvent()
+  {
+    if(m_rxAt == UINT64_MAX && (UCSR0B & _BV(RXEN0)) && !g_rxHost.empty())
+    {
+      // back to back bytes follow each other on the line
+      uint64_t start = (m_rxLast > now()) ? m_rxLast : now();
+      m_rxAt = start + byteUs();
+    }
+    uint64_t t = m_rxAt;
+    if(m_bTxBusy && m_txDoneAt < t)
+      t = m_txDoneAt;
+    return t;
+  }
+  void onEvent()
+  {
+    if(m_rxAt <= now())
+      onRxDone();
+    if(m_bTxBusy && m_txDoneAt <= now())
+      onTxDone();
+  }
+
+  uint8_t read()
+  {
+    if(m_rxFifo.empty())
+      return m_rxLastRead;
+    m_rxLastRead = m_rxFifo.front();
+    m_rxFifo.pop_front();
+    if(m_rxFifo.empty())
+      UCSR0A &= ~_BV(RXC0);
+    UCSR0A &= ~_BV(DOR0);
+    return m_rxLastRead;
+  }
+  void write(uint8_t b)
+  {
+    if(!(UCSR0B & _BV(TXEN0)))
+      return;
+    UCSR0A &= ~_BV(TXC0);
+    if(!m_bTxBusy)
+      startTx(b);
+    else if(UCSR0A & _BV(UDRE0))
+    {
+      m_txData = b;
+      UCSR0A &= ~_BV(UDRE0);
+    }
+  }
+  /** anything being sent or about to be? */
+  bool isTxBusy()
+  {
+    return m_bTxBusy || (UCSR0B & _BV(UDRIE0));
+  }
+
+private:
+  uint64_t m_rxAt = UINT64_MAX;
+  uint64_t m_rxLast = 0;
+  std::deque<uint8_t> m_rxFifo;
+  uint8_t m_rxLastRead = 0;
+  bool m_bTxBusy = false;
+  uint64_t m_txDoneAt = 0;
+  uint8_t m_txShift = 0;
+  uint8_t m_txData = 0;
+
+  void onRxDone()
+  {
+    m_rxLast = m_rxAt;
+    m_rxAt = UINT64_MAX;
+    if(g_rxHost.empty())
+      return;
+    uint8_t b = g_rxHost.front();
+    g_rxHost.pop_front();
+    if(m_rxFifo.size() >= 2)
+    {
+      UCSR0A |= _BV(DOR0);
+      return;
+    }
+    m_rxFifo.push_back(b);
+    UCSR0A |= _BV(RXC0);
+  }
+  void startTx(uint8_t b)
+  {
+    m_txShift = b;
+    m_bTxBusy = true;
+    m_txDoneAt = now() + byteUs();
+  }
+  void onTxDone()
+  {
+    g_txHost.push_back(m_txShift);
+    if(m_txShift == '\n' || g_txHost.size() >= 256)
+      serialSync();
+    if(!(UCSR0A & _BV(UDRE0)))
+    {
+      startTx(m_txData);
+      UCSR0A |= _BV(UDRE0);
+      return;
+    }
+    m_bTxBusy = false;
+    UCSR0A |= _BV(TXC0);
+    // the line went idle, e.g. after a binary frame with no \n in it
+    serialSync();
+  }
+};
+static UsartDevice g_usart;
+static bool g_bAdded = false;
+
+void serialOpen(int fdIn, int fdOut, bool crlf)
+{
+  g_fdIn = fdIn;
+  g_fdOut = fdOut;
+  g_crlf = crlf;
+  if(g_fdIn >= 0)
+    fcntl(g_fdIn, F_SETFL, fcntl(g_fdIn, F_GETFL) | O_NONBLOCK);
+  if(!g_bAdded)
+    addDevice(&g_usart);
+  g_bAdded = true;
+}
+
+const char *serialOpenPty()
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if(fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+    return 0;
+  const char *name = ptsname(fd);
+  if(name == 0)
+    return 0;
+  // keep the slave open in raw mode so that we don't get EIO w/o a client
+  int fdSlave = open(name, O_RDWR | O_NOCTTY);
+  if(fdSlave >= 0)
+  {
+    struct termios tio;
+    tcgetattr(fdSlave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fdSlave, TCSANOW, &tio);
+  }
+  serialOpen(fd, fd, false);
+  return name;
+}
+
+void serialPoll()
+{
+  if(g_fdIn < 0 || now() - g_lastPoll < 500)
+    return;
+  g_lastPoll = now();
+  // a host writing faster than the line takes it is held up by the pty
+  while(g_rxHost.size() < 4096)
+  {
+    uint8_t b;
+    if(read(g_fdIn, &b, 1) != 1)
+      break;
+    if(g_crlf && b == '\n')
+      b = '\r';
+    g_rxHost.push_back(b);
+  }
+}
+
+void serialFlush()
+{
+  for(int i = 0; i < 1000 && g_bAdded && g_usart.isTxBusy(); i++)
+    advance(byteUs());
+  serialSync();
+}
+
+void serialSync()
+{
+  if(g_fdOut >= 0 && !g_txHost.empty())
+  {
+    size_t off = 0;
+    while(off < g_txHost.size())
+    {
+      ssize_t n = write(g_fdOut, &g_txHost[off], g_txHost.size() - off);
+      if(n <= 0)
+        break;
+      off += n;
+    }
+  }
+  g_txHost.clear();
+}
+
+}
+
+UsartDataRegister::operator uint8_t()
+{
+  sim::tick();
+  return sim::g_usart.read();
+}
+
+UsartDataRegister &UsartDataRegister::operator=(uint8_t b)
+{
+  sim::tick();
+  sim::g_usart.write(b);
+  return *this;
+}
@@ -0,0 +1,253 @@
+/**
+ * Host entry point: runs the firmware against the simulated board and world.
+ *
+ *   fancontroller_sim [options]
+ *     --seconds N      stop after N seconds of virtual time, default: run forever
+ *     --speed X        virtual/wall clock ratio, 1 is real time, 0 (default) is
+ *                      as fast as possible
+ *     --pty            talk over a pty instead of stdin/stdout, its name is
+ *                      printed on stderr
+ *     --link PATH      with --pty, also make a symlink to it at PATH
+ *     --ambient C      ambient temperature, default 25
+ *     --heat C         temperature rise over ambient with the fans stopped, default 20
+ *     --heat-period S  switch the heat on and off with this period
+ *     --pot F          potentiometer position 0..1, default 0.5
+ *     --stuck N        fan N (0 based) rotor is stuck
+ *     --stuck-from S   with --stuck, the rotor jams S seconds in rather than from the start
+ *     --stuck-for S    with --stuck-from, and frees itself S seconds later
+ *     --fan-duty N:S:T fan N (0 based) starts at duty S and stalls below T, 0..1
+ *     --quiet          do not print the summary on exit
+ *     --raw            no \n to \r translation on stdin, e.g. for binary frames
+ *     --eeprom FILE    EEPROM contents are loaded from and saved to FILE, the
+ *                      EEPROM starts erased if there is no such file
+ */
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include "Arduino.h"
+#include "Sim.h"
+#include "Plant.h"
+#include "../../pcb.h"
+
+/**
+ * Keeps time weighted averages for the summary
+ */
+class Summary : public sim::Device
+{
+public:
+  Summary(sim::ThermalModel &box, sim::FanModel **fans, int numFans) :
+    m_box(box), m_fans(fans), m_numFans(numFans)
+  {
+    m_tempMin = m_tempMax = box.temp;
+  }
+  uint64_t nextEvent()
+  {
+    return UINT64_MAX;
+  }
+  void onEvent()
+  {
+  }
+  void onAdvance(uint64_t dt)
+  {
+    double t = m_box.temp;
+    m_tempSum += t * dt;
+    if(t < m_tempMin)
+      m_tempMin = t;
+    if(t > m_tempMax)
+      m_tempMax = t;
+    for(int i = 0; i < m_numFans; i++)
+    {
+      double duty = m_fans[i]->getDuty();
+      m_dutySum[i] += duty * dt;
+      if(duty != m_dutyLast[i])
+        m_dutyChanges[i]++;
+      m_dutyLast[i] = duty;
+    }
+    m_time += dt;
+  }
+  void print(double wallS)
+  {
+    double s = m_time / 1e6;
+    fprintf(stderr, "sim: %.1fs virtual in %.2fs wall (x%.0f)\n", s, wallS, (wallS > 0) ? s / wallS : 0);
+    if(m_time == 0)
+      return;
+    fprintf(stderr, "sim: temp min=%.2fC avg=%.2fC max=%.2fC\n", m_tempMin, m_tempSum / m_time, m_tempMax);
+    for(int i = 0; i < m_numFans; i++)
+      fprintf(stderr, "sim: fan%d avg duty=%.1f%% changes=%lu rpm=%.0f pwm=%.0fHz\n",
+        i, 100 * m_dutySum[i] / m_time, m_dutyChanges[i], m_fans[i]->getRPM(), m_fans[i]->getPwmHz());
+  }
+
+private:
+  sim::ThermalModel &m_box;
+  sim::FanModel **m_fans;
+  int m_numFans;
+  double m_time = 0;
+  double m_tempSum = 0;
+  double m_tempMin;
+  double m_tempMax;
+  double m_dutySum[3] = {0, 0, 0};
+  double m_dutyLast[3] = {0, 0, 0};
+  unsigned long m_dutyChanges[3] = {0, 0, 0};
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+  g_stop = 1;
+}
+
+static double wallSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  double seconds = 0;
+  double speed = 0;
+  bool usePty = false;
+  const char *link = 0;
+  double pot = 0.5;
+  bool quiet = false;
+  int stuck = -1;
+  double stuckFrom = -1;
+  double stuckFor = -1;
+  bool raw = false;
+  const char *eeprom = 0;
+
+  sim::FanModel fan1(pinFan1pwm, pinFan1sen);
+  sim::FanModel fan2(pinFan2pwm, pinFan2sen);
+  sim::FanModel fan3(pinFan3pwm, pinFan3sen);
+  sim::FanModel *fans[] = { &fan1, &fan2, &fan3 };
+  const int numFans = sizeof(fans) / sizeof(fans[0]);
+  sim::ThermalModel box(fans, numFans);
+
+  static struct option options[] = {
+    {"seconds", required_argument, 0, 's'},
+    {"speed", required_argument, 0, 'x'},
+    {"pty", no_argument, 0, 'p'},
+    {"link", required_argument, 0, 'l'},
+    {"ambient", required_argument, 0, 'a'},
+    {"heat", required_argument, 0, 'h'},
+    {"heat-period", required_argument, 0, 'P'},
+    {"pot", required_argument, 0, 'o'},
+    {"stuck", required_argument, 0, 'k'},
+    {"stuck-from", required_argument, 0, 'F'},
+    {"stuck-for", required_argument, 0, 'D'},
+    {"fan-duty", required_argument, 0, 'd'},
+    {"quiet", no_argument, 0, 'q'},
+    {"raw", no_argument, 0, 'r'},
+    {"eeprom", required_argument, 0, 'e'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  while((c = getopt_long(argc, argv, "", options, 0)) != -1)
+  {
+    switch(c)
+    {
+      case 's': seconds = atof(optarg); break;
+      case 'x': speed = atof(optarg); break;
+      case 'p': usePty = true; break;
+      case 'l': link = optarg; break;
+      case 'a': box.ambient = atof(optarg); break;
+      case 'h': box.heat = atof(optarg); break;
+      case 'P': box.heatPeriod = atof(optarg); break;
+      case 'o': pot = atof(optarg); break;
+      case 'k': stuck = atoi(optarg); break;
+      case 'F': stuckFrom = atof(optarg); break;
+      case 'D': stuckFor = atof(optarg); break;
+      case 'd':
+      {
+        int n = -1;
+        double start = 0, stop = 0;
+        if(sscanf(optarg, "%d:%lf:%lf", &n, &start, &stop) != 3 || n < 0 || n >= numFans)
+        {
+          fprintf(stderr, "sim: bad --fan-duty %s\n", optarg);
+          return 1;
+        }
+        fans[n]->dutyStart = start;
+        fans[n]->dutyStop = stop;
+        break;
+      }
+      case 'q': quiet = true; break;
+      case 'r': raw = true; break;
+      case 'e': eeprom = optarg; break;
+      default:
+        fprintf(stderr, "see host/sim/main.cpp for the options\n");
+        return 1;
+    }
+  }
+  if(stuck >= 0 && stuck < numFans)
+  {
+    fans[stuck]->stuck = true;
+    fans[stuck]->stuckFrom = stuckFrom;
+    fans[stuck]->stuckFor = stuckFor;
+  }
+  box.temp = box.ambient;
+  if(eeprom != 0 && !sim::eepromLoad(eeprom))
+    fprintf(stderr, "sim: %s not loaded, EEPROM is erased\n", eeprom);
+
+  if(usePty)
+  {
+    const char *name = sim::serialOpenPty();
+    if(name == 0)
+    {
+      perror("pty");
+      return 1;
+    }
+    fprintf(stderr, "sim: serial port is %s\n", name);
+    if(link != 0)
+    {
+      unlink(link);
+      if(symlink(name, link) != 0)
+        perror("symlink");
+    }
+  }
+  else
+  {
+    sim::serialOpen(STDIN_FILENO, STDOUT_FILENO, !raw);
+  }
+
+  for(int i = 0; i < numFans; i++)
+    sim::addDevice(fans[i]);
+  sim::addDevice(&box);
+  Summary summary(box, fans, numFans);
+  sim::addDevice(&summary);
+  // LM35 is 10mV/C
+  sim::setAnalogSource(pinLM35, [&box]() { return box.temp / 100; });
+  sim::setAnalogSource(pinPotentiometer, [pot]() { return pot * 5; });
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  // what the Arduino core init() does: timer 0 fast PWM, 1 and 2 phase correct 8 bits, all /64
+  TCCR0A = _BV(WGM01) | _BV(WGM00);
+  TCCR0B = _BV(CS01) | _BV(CS00);
+  TCCR1A = _BV(WGM10);
+  TCCR1B = _BV(CS11) | _BV(CS10);
+  TCCR2A = _BV(WGM20);
+  TCCR2B = _BV(CS22);
+  SREG |= _BV(SREG_I);
+
+  double wallStart = wallSeconds();
+  sim::setSpeed(speed);
+  uint64_t end = (uint64_t)(seconds * 1e6);
+  setup();
+  while(!g_stop && (end == 0 || sim::now() < end))
+  {
+    // sleeps when there is nothing to do, see IdleSleep.h
+    loop();
+  }
+  sim::serialFlush();
+  if(eeprom != 0 && !sim::eepromSave(eeprom))
+    perror(eeprom);
+  if(!quiet)
+    summary.print(wallSeconds() - wallStart);
+  if(usePty && link != 0)
+    unlink(link);
+  return 0;
+}
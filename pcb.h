@@ -1,3 +1,15 @@
+/**
+ * Board revision: 8 for PCB v0.8, the default, 5 for PCB v0.5.
+ * On v0.8 fans 1 and 2 get 25kHz, fan 3 31.37kHz.  On v0.5 fans 1 and 2 are
+ * on Timer0 pins and get its 976Hz PWM, audible and out of the 4-wire fan
+ * spec, only fan 3 gets 25kHz.  See fansSetup().
+ */
+#ifndef PCB_VERSION
+#define PCB_VERSION 8
+#endif
+
+#if PCB_VERSION == 5
+#warning "PCB v0.5: fans 1 and 2 get 976Hz PWM, not 25kHz"
 /**
  * PCB v0.5 Definitions
  */
@@ -10,10 +22,10 @@ const short int pinFan2sen=3;
 const short int pinFan3pwm=9;
 const short int pinFan3sen=0;
 
+#elif PCB_VERSION == 8
 /**
  * PCB v0.8 Definitions
  */
-/* 
 const short int pinLM35=A0;
 const short int pinPotentiometer = A1;
 const short int pinFan1pwm=9;
@@ -22,5 +34,7 @@ const short int pinFan2pwm=10;
 const short int pinFan2sen=3;
 const short int pinFan3pwm=11;
 const short int pinFan3sen=0;
-*/
-const short int pinLed=13;
+#else
+#error "Unknown PCB_VERSION"
+#endif
+const short int pinLed=13;